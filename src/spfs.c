@@ -8,6 +8,7 @@
 #include "spfs.h"
 #include "spfs_file.h"
 #include "spfs_lowlevel.h"
+#include "spfs_cache.h"
 
 #undef _SPFS_DBG_PRE
 #undef _SPFS_DBG_POST
@@ -31,12 +32,14 @@ int SPFS_stat(spfs_t *fs, const char *path, struct spfs_stat *buf) {
   if (buf == NULL) ERRET(-SPFS_ERR_ARG);
   SPFS_LOCK(fs);
   ERRUNLOCK(fs, check(fs));
+  // make cached writes visible
+  ERRUNLOCK(fs, spfs_cache_flush(fs));
   pix_t dpix;
   spfs_pixhdr_t pixhdr;
   int res = spfs_file_find(fs, path, &dpix, &pixhdr);
   buf->dpix = dpix;
   buf->id = pixhdr.phdr.id;
-  buf->size = pixhdr.fi.size == SPFS_FILESZ_UNDEF ? 0 : pixhdr.fi.size;
+  buf->size = pixhdr.fi.size == SPFS_FILESZ_UNDEF ? 0 : SPFS_FI_SIZE(&pixhdr.fi);
   buf->type = pixhdr.fi.type;
   spfs_strncpy(buf->name, (const char *)pixhdr.name, SPFS_CFG_FILE_NAME_SZ);
 #if SPFS_CFG_FILE_META_SZ
@@ -65,7 +68,15 @@ spfs_file_t SPFS_open(spfs_t *fs, const char *path, int oflags, int mode) {
   spfs_fd_t *fd;
   pix_t dpix;
   spfs_pixhdr_t pixhdr;
-  int res = spfs_file_find(fs, path, &dpix, &pixhdr);
+  id_t id = (id_t)-1;
+  pix_t free_dpix = (pix_t)-1;
+  int res;
+  if (oflags & SPFS_O_CREAT) {
+    // look up the file, and prepare for creating it, in one pass
+    res = spfs_file_find_creat(fs, path, &dpix, &pixhdr, &id, &free_dpix);
+  } else {
+    res = spfs_file_find(fs, path, &dpix, &pixhdr);
+  }
   uint8_t notexist = (res == -SPFS_ERR_FILE_NOT_FOUND);
   if (notexist) res = SPFS_OK;
   ERRUNLOCK(fs, res);
@@ -78,7 +89,7 @@ spfs_file_t SPFS_open(spfs_t *fs, const char *path, int oflags, int mode) {
     ERRET(-SPFS_ERR_FILE_NOT_FOUND);
   }
 
-  if ((oflags & (SPFS_O_CREAT | SPFS_O_EXCL)) == (SPFS_O_CREAT | SPFS_O_EXCL)) {
+  if ((oflags & (SPFS_O_CREAT | SPFS_O_EXCL)) == (SPFS_O_CREAT | SPFS_O_EXCL) && !notexist) {
     // fail if exists
     SPFS_UNLOCK(fs);
     _fd_release(fs, fd);
@@ -87,7 +98,7 @@ spfs_file_t SPFS_open(spfs_t *fs, const char *path, int oflags, int mode) {
 
   if ((oflags & SPFS_O_CREAT) && notexist) {
     // create
-    res = spfs_file_create(fs, fd, path);
+    res = spfs_file_create_at(fs, fd, path, id, free_dpix);
     if (res) {
       _fd_release(fs, fd);
       ERRUNLOCK(fs, res);
@@ -123,6 +134,42 @@ spfs_file_t SPFS_creat(spfs_t *fs, const char *path) {
   return SPFS_open(fs, path, SPFS_O_WRONLY|SPFS_O_CREAT|SPFS_O_TRUNC, 0);
 }
 
+spfs_file_t SPFS_creat_fix(spfs_t *fs, const char *path, uint32_t size, uint8_t prealloc) {
+  dbg("name:%s size:"_SPIPRIi" prealloc:"_SPIPRIi"\n", path, size, prealloc);
+  SPFS_LOCK(fs);
+  ERRUNLOCK(fs, check(fs));
+  spfs_fd_t *fd;
+  int res = _fd_claim(fs, &fd);
+  ERRUNLOCK(fs, res);
+  res = spfs_file_create_fix(fs, fd, path, size, prealloc);
+  if (res) {
+    _fd_release(fs, fd);
+    ERRUNLOCK(fs, res);
+  }
+  fd->fd_oflags = SPFS_O_RDWR;
+  dbg("fh:"_SPIPRIi"\n", fd->hdl);
+  SPFS_UNLOCK(fs);
+  return fd->hdl;
+}
+
+spfs_file_t SPFS_creat_rot(spfs_t *fs, const char *path, uint32_t size) {
+  dbg("name:%s size:"_SPIPRIi"\n", path, size);
+  SPFS_LOCK(fs);
+  ERRUNLOCK(fs, check(fs));
+  spfs_fd_t *fd;
+  int res = _fd_claim(fs, &fd);
+  ERRUNLOCK(fs, res);
+  res = spfs_file_create_rot(fs, fd, path, size);
+  if (res) {
+    _fd_release(fs, fd);
+    ERRUNLOCK(fs, res);
+  }
+  fd->fd_oflags = SPFS_O_RDWR | SPFS_O_APPEND;
+  dbg("fh:"_SPIPRIi"\n", fd->hdl);
+  SPFS_UNLOCK(fs);
+  return fd->hdl;
+}
+
 int SPFS_read(spfs_t *fs, spfs_file_t fh, void *buf, uint32_t len) {
   spfs_fd_t *fd;
   dbg("fh:"_SPIPRIi" len:"_SPIPRIi"\n", fh, len);
@@ -131,16 +178,44 @@ int SPFS_read(spfs_t *fs, spfs_file_t fh, void *buf, uint32_t len) {
   int res = _fd_resolve(fs, fh, &fd);
   ERRUNLOCK(fs, res);
   if ((fd->fd_oflags & SPFS_O_RDONLY) == 0) ERRUNLOCK(fs, -SPFS_ERR_NOT_READABLE);
+  // make cached writes visible
+  res = spfs_cache_file_flush(fs, fd->fi.id);
+  ERRUNLOCK(fs, res);
   if (fd->fi.size == SPFS_FILESZ_UNDEF) {
     return 0;
   }
-  len = spfs_min(len, fd->fi.size - fd->offset);
+  len = spfs_min(len, SPFS_FI_SIZE(&fd->fi) - fd->offset);
   res = spfs_file_read(fs, fd, fd->offset, len, (uint8_t *)buf);
   SPFS_UNLOCK(fs);
   if (res < 0)  ERRET(res);
   else          return res;
 }
 
+#if SPFS_CFG_HAL_MAP
+int SPFS_read_zc(spfs_t *fs, spfs_file_t fh, spfs_zc_seg_t *segs, uint32_t seg_cnt,
+                 uint32_t len) {
+  spfs_fd_t *fd;
+  dbg("fh:"_SPIPRIi" segs:"_SPIPRIi" len:"_SPIPRIi"\n", fh, seg_cnt, len);
+  SPFS_LOCK(fs);
+  ERRUNLOCK(fs, check(fs));
+  int res = _fd_resolve(fs, fh, &fd);
+  ERRUNLOCK(fs, res);
+  if ((fd->fd_oflags & SPFS_O_RDONLY) == 0) ERRUNLOCK(fs, -SPFS_ERR_NOT_READABLE);
+  // make cached writes visible
+  res = spfs_cache_file_flush(fs, fd->fi.id);
+  ERRUNLOCK(fs, res);
+  if (fd->fi.size == SPFS_FILESZ_UNDEF) {
+    SPFS_UNLOCK(fs);
+    return 0;
+  }
+  len = spfs_min(len, SPFS_FI_SIZE(&fd->fi) - fd->offset);
+  res = spfs_file_read_zc(fs, fd, fd->offset, len, segs, seg_cnt);
+  SPFS_UNLOCK(fs);
+  if (res < 0)  ERRET(res);
+  else          return res;
+}
+#endif
+
 int SPFS_write(spfs_t *fs, spfs_file_t fh, const void *buf, uint32_t len) {
   spfs_fd_t *fd;
   dbg("fh:"_SPIPRIi" len:"_SPIPRIi"\n", fh, len);
@@ -151,9 +226,107 @@ int SPFS_write(spfs_t *fs, spfs_file_t fh, const void *buf, uint32_t len) {
   if ((fd->fd_oflags & SPFS_O_WRONLY) == 0) ERRUNLOCK(fs, -SPFS_ERR_NOT_WRITABLE);
 
   if (fd->fd_oflags & SPFS_O_APPEND) {
-    fd->offset = fd->fi.size;
+    fd->offset = spfs_cache_file_size(fs, fd);
   }
-  res = spfs_file_write(fs, fd, fd->offset, len, (const uint8_t *)buf);
+  res = spfs_cache_file_write(fs, fd, fd->offset, len, (const uint8_t *)buf);
+  SPFS_UNLOCK(fs);
+  if (res < 0)  ERRET(res);
+  else          return res;
+}
+
+int SPFS_pread(spfs_t *fs, spfs_file_t fh, void *buf, uint32_t len, uint32_t offs) {
+  spfs_fd_t *fd;
+  dbg("fh:"_SPIPRIi" len:"_SPIPRIi" offs:"_SPIPRIi"\n", fh, len, offs);
+  SPFS_LOCK(fs);
+  ERRUNLOCK(fs, check(fs));
+  int res = _fd_resolve(fs, fh, &fd);
+  ERRUNLOCK(fs, res);
+  if ((fd->fd_oflags & SPFS_O_RDONLY) == 0) ERRUNLOCK(fs, -SPFS_ERR_NOT_READABLE);
+  // make cached writes visible
+  res = spfs_cache_file_flush(fs, fd->fi.id);
+  ERRUNLOCK(fs, res);
+  uint32_t size = SPFS_FI_SIZE(&fd->fi);
+  if (size == SPFS_FILESZ_UNDEF || offs >= size) {
+    SPFS_UNLOCK(fs);
+    return 0;
+  }
+  len = spfs_min(len, size - offs);
+  // leave the file offset untouched
+  uint32_t fd_offs = fd->offset;
+  res = spfs_file_read(fs, fd, offs, len, (uint8_t *)buf);
+  fd->offset = fd_offs;
+  SPFS_UNLOCK(fs);
+  if (res < 0)  ERRET(res);
+  else          return res;
+}
+
+int SPFS_pwrite(spfs_t *fs, spfs_file_t fh, const void *buf, uint32_t len, uint32_t offs) {
+  spfs_fd_t *fd;
+  dbg("fh:"_SPIPRIi" len:"_SPIPRIi" offs:"_SPIPRIi"\n", fh, len, offs);
+  SPFS_LOCK(fs);
+  ERRUNLOCK(fs, check(fs));
+  int res = _fd_resolve(fs, fh, &fd);
+  ERRUNLOCK(fs, res);
+  if ((fd->fd_oflags & SPFS_O_WRONLY) == 0) ERRUNLOCK(fs, -SPFS_ERR_NOT_WRITABLE);
+
+  uint32_t sz = spfs_cache_file_size(fs, fd);
+  if (fd->fd_oflags & SPFS_O_APPEND) {
+    offs = sz;
+  }
+  if (offs > sz) offs = sz; // clamp, spfs does not allow empty regions
+  // leave the file offset untouched
+  uint32_t fd_offs = fd->offset;
+  res = spfs_cache_file_write(fs, fd, offs, len, (const uint8_t *)buf);
+  fd->offset = fd_offs;
+  SPFS_UNLOCK(fs);
+  if (res < 0)  ERRET(res);
+  else          return res;
+}
+
+int SPFS_readv(spfs_t *fs, spfs_file_t fh, const struct spfs_iov *iov, uint32_t iovcnt) {
+  spfs_fd_t *fd;
+  dbg("fh:"_SPIPRIi" iovcnt:"_SPIPRIi"\n", fh, iovcnt);
+  SPFS_LOCK(fs);
+  ERRUNLOCK(fs, check(fs));
+  int res = _fd_resolve(fs, fh, &fd);
+  ERRUNLOCK(fs, res);
+  if ((fd->fd_oflags & SPFS_O_RDONLY) == 0) ERRUNLOCK(fs, -SPFS_ERR_NOT_READABLE);
+  // make cached writes visible
+  res = spfs_cache_file_flush(fs, fd->fi.id);
+  ERRUNLOCK(fs, res);
+  if (fd->fi.size == SPFS_FILESZ_UNDEF) {
+    SPFS_UNLOCK(fs);
+    return 0;
+  }
+  uint32_t len = 0;
+  uint32_t i;
+  for (i = 0; i < iovcnt; i++) len += iov[i].iov_len;
+  len = spfs_min(len, SPFS_FI_SIZE(&fd->fi) - fd->offset);
+  res = spfs_file_readv(fs, fd, fd->offset, iov, len);
+  SPFS_UNLOCK(fs);
+  if (res < 0)  ERRET(res);
+  else          return res;
+}
+
+int SPFS_writev(spfs_t *fs, spfs_file_t fh, const struct spfs_iov *iov, uint32_t iovcnt) {
+  spfs_fd_t *fd;
+  dbg("fh:"_SPIPRIi" iovcnt:"_SPIPRIi"\n", fh, iovcnt);
+  SPFS_LOCK(fs);
+  ERRUNLOCK(fs, check(fs));
+  int res = _fd_resolve(fs, fh, &fd);
+  ERRUNLOCK(fs, res);
+  if ((fd->fd_oflags & SPFS_O_WRONLY) == 0) ERRUNLOCK(fs, -SPFS_ERR_NOT_WRITABLE);
+
+  // written through, persist cached writes first
+  res = spfs_cache_file_flush(fs, fd->fi.id);
+  ERRUNLOCK(fs, res);
+  if (fd->fd_oflags & SPFS_O_APPEND) {
+    fd->offset = spfs_cache_file_size(fs, fd);
+  }
+  uint32_t len = 0;
+  uint32_t i;
+  for (i = 0; i < iovcnt; i++) len += iov[i].iov_len;
+  res = spfs_file_writev(fs, fd, fd->offset, iov, len);
   SPFS_UNLOCK(fs);
   if (res < 0)  ERRET(res);
   else          return res;
@@ -166,9 +339,12 @@ int SPFS_close(spfs_t *fs, spfs_file_t fh) {
   ERRUNLOCK(fs, check(fs));
   int res = _fd_resolve(fs, fh, &fd);
   ERR(res);
+  id_t id = fd->fi.id;
+  res = spfs_cache_file_flush(fs, id);
   _fd_release(fs, fd);
+  spfs_cache_file_release(fs, id);
   SPFS_UNLOCK(fs);
-  return SPFS_OK;
+  ERRET(res);
 }
 
 int SPFS_remove(spfs_t *fs, const char *path) {
@@ -188,7 +364,10 @@ int SPFS_lseek(spfs_t *fs, spfs_file_t fh, int offs, uint8_t whence) {
   ERRUNLOCK(fs, check(fs));
   int res = _fd_resolve(fs, fh, &fd);
   ERRUNLOCK(fs, res);
-  uint32_t sz = fd->fi.size;
+  // make cached writes visible
+  res = spfs_cache_file_flush(fs, fd->fi.id);
+  ERRUNLOCK(fs, res);
+  uint32_t sz = spfs_cache_file_size(fs, fd);
   uint32_t set_offs = fd->offset;
   switch (whence) {
   case SPFS_SEEK_SET: set_offs = offs; break;
@@ -231,9 +410,14 @@ int SPFS_truncate(spfs_t *fs, const char *path, uint32_t offset) {
 
 int SPFS_opendir(spfs_t *fs, spfs_DIR *d, const char *path) {
   if (d == NULL) ERRET(-SPFS_ERR_ARG);
-  (void)fs; (void)path;
+  (void)path;
   d->dpix = 0;
-  return SPFS_OK;
+  SPFS_LOCK(fs);
+  ERRUNLOCK(fs, check(fs));
+  // make cached writes visible
+  int res = spfs_cache_flush(fs);
+  SPFS_UNLOCK(fs);
+  ERRET(res);
 }
 
 static int _spfs_readdir_v(spfs_t *fs, uint32_t lu_entry, spfs_vis_info_t *info, void *varg) {
@@ -258,11 +442,11 @@ static int _spfs_readdir_v(spfs_t *fs, uint32_t lu_entry, spfs_vis_info_t *info,
   if ((pixhdr.phdr.p_flags & SPFS_PHDR_FL_IDX)) {
     ERR(-SPFS_ERR_LU_PHDR_FLAG_MISMATCH);
   }
-  if (pixhdr.phdr.span == 0) {
+  if (pixhdr.phdr.span == 0 && pixhdr.fi.type != SPFS_PIXHDR_TY_DIR) {
     d->dpix = info->dpix+1;
     d->de.s.id = pixhdr.phdr.id;
     d->de.s.dpix = info->dpix;
-    d->de.s.size = pixhdr.fi.size;
+    d->de.s.size = SPFS_FI_SIZE(&pixhdr.fi);
     d->de.s.type = pixhdr.fi.type;
     spfs_strncpy(d->de.s.name, (const char *)pixhdr.name, SPFS_CFG_FILE_NAME_SZ);
 #if SPFS_CFG_FILE_META_SZ
@@ -284,7 +468,9 @@ struct spfs_dirent *SPFS_readdir(spfs_t *fs, spfs_DIR *d) {
     SPFS_UNLOCK(fs);
     return NULL;
   }
-  int res = spfs_page_visit(fs, d->dpix, 0, d, _spfs_readdir_v, 0);
+  spfs_vis_desc_t desc = {.v = _spfs_readdir_v, .varg = d, .flags = SPFS_VIS_FL_IX,
+                          .vblk = spfs_vis_blk_skip_unused};
+  int res = spfs_page_visit_desc(fs, d->dpix, 0, &desc);
   SPFS_UNLOCK(fs);
   if (res == SPFS_OK) {
     return &d->de;
@@ -101,6 +101,8 @@
 #define SPFS_ERR_NOT_READABLE           (SPFS_ERR_BASE+26)
 /** file not writable */
 #define SPFS_ERR_NOT_WRITABLE           (SPFS_ERR_BASE+27)
+/** medium not mapped to memory */
+#define SPFS_ERR_NOT_MAPPED             (SPFS_ERR_BASE+28)
 /** internal usage: do not use this as a base */
 #define _SPFS_ERR_INT                   (SPFS_ERR_BASE+100)
 #if SPFS_TEST
@@ -189,6 +191,22 @@ typedef enum {
   SPFS_MEM_BLOCK_LU,
   /** cache memory */
   SPFS_MEM_CACHE,
+  /** lookup page mirror memory */
+  SPFS_MEM_LU_MIRROR,
+  /** block statistics memory */
+  SPFS_MEM_BLOCK_STATS,
+  /** free page bitmap memory */
+  SPFS_MEM_PFREE_BITMAP,
+  /** free id bitmap memory */
+  SPFS_MEM_ID_BITMAP,
+  /** index page location cache memory */
+  SPFS_MEM_IX_CACHE,
+  /** file name hash index memory */
+  SPFS_MEM_NAME_HASH,
+  /** file name bloom filter memory */
+  SPFS_MEM_NAME_BLOOM,
+  /** read ahead buffer memory */
+  SPFS_MEM_READ_AHEAD,
   _SPFS_MEM_TYPES
 } spfs_mem_type_t;
 
@@ -208,6 +226,22 @@ typedef enum {
  */
 typedef int (*hal_read_t)(struct spfs_s *fs, uint32_t addr, uint8_t *dst,
     uint32_t size _SPFS_TEST_DEF(flags));
+/**
+ * Function prototype for reading several logical pages from medium in one
+ * call.
+ * It is guaranteed that a read_pages call always starts at a logical page
+ * boundary, reads whole consecutive logical pages, and never crosses any
+ * logical block boundaries. This lets the implementation read them in one
+ * transaction, e.g. one spi flash read command.
+ * @param fs      the filesystem struct
+ * @param addr    the address to read from
+ * @param dst     the memory to read to
+ * @param size    number of bytes to read
+ * @param flags   only in test builds for verification and debugging
+ * @return SPFS_OK on success. Anything else is considered an error.
+ */
+typedef int (*hal_read_pages_t)(struct spfs_s *fs, uint32_t addr, uint8_t *dst,
+    uint32_t size _SPFS_TEST_DEF(flags));
 /**
  * Function prototype for writing to medium.
  * It is guaranteed that a write call never will cross any logical page
@@ -224,6 +258,46 @@ typedef int (*hal_read_t)(struct spfs_s *fs, uint32_t addr, uint8_t *dst,
  */
 typedef int (*hal_write_t)(struct spfs_s *fs, uint32_t addr, const uint8_t *src,
     uint32_t size _SPFS_TEST_DEF(flags));
+/**
+ * One range in a vectored write to medium.
+ */
+typedef struct {
+  // the address to write to
+  uint32_t addr;
+  // the data to write
+  const uint8_t *src;
+  // number of bytes to write
+  uint32_t size;
+#if SPFS_TEST
+  // only in test builds for verification and debugging
+  uint32_t flags;
+#endif
+} spfs_iovec_t;
+/**
+ * Function prototype for writing several ranges to medium in one call.
+ * Each range follows the same rules as a hal_write_t call. Ranges never
+ * overlap, and are given in the order they would have been written by
+ * separate write calls. This lets the implementation program them in one
+ * transaction, e.g. by queueing them all to a flash controller.
+ * @param fs      the filesystem struct
+ * @param iov     the ranges to write
+ * @param cnt     number of ranges
+ * @return SPFS_OK on success. Anything else is considered an error.
+ */
+typedef int (*hal_writev_t)(struct spfs_s *fs, const spfs_iovec_t *iov,
+    uint32_t cnt);
+/**
+ * Function prototype for mapping medium to memory.
+ * Same guarantees as for reading applies, a range never crosses any logical
+ * page boundaries. The returned memory must stay valid and reflect the medium
+ * until the next write or erase.
+ * @param fs      the filesystem struct
+ * @param addr    the address of the range to map
+ * @param size    number of bytes to map
+ * @return pointer to the mapped range, or NULL if it cannot be mapped.
+ */
+typedef const uint8_t *(*hal_map_t)(struct spfs_s *fs, uint32_t addr,
+    uint32_t size);
 /**
  * Function prototype for erasing blocks on medium.
  * It is guaranteed that an erase call always start at an aligned address with
@@ -248,6 +322,22 @@ typedef int (*hal_erase_t)(struct spfs_s *fs, uint32_t addr, uint32_t size
  *   SPFS_MEM_BLOCK_LU: mandatory exact size,
  *   SPFS_MEM_FILEDESCS: enough memory for at least one filedescriptor,
  *   SPFS_MEM_CACHE: may be zero, but not recommended.
+ *   SPFS_MEM_LU_MIRROR: may be zero or less, only requested when
+ *                       SPFS_CFG_LU_MIRROR is enabled.
+ *   SPFS_MEM_BLOCK_STATS: exact size or zero, only requested when
+ *                         SPFS_CFG_BLOCK_STATS is enabled.
+ *   SPFS_MEM_PFREE_BITMAP: exact size or zero, only requested when
+ *                          SPFS_CFG_PFREE_BITMAP is enabled.
+ *   SPFS_MEM_ID_BITMAP: exact size or zero, only requested when
+ *                       SPFS_CFG_ID_BITMAP is enabled.
+ *   SPFS_MEM_IX_CACHE: may be zero or less, only requested when
+ *                      SPFS_CFG_IX_CACHE is nonzero.
+ *   SPFS_MEM_NAME_HASH: may be zero or less, only requested when
+ *                       SPFS_CFG_NAME_HASH is nonzero.
+ *   SPFS_MEM_NAME_BLOOM: may be zero or less, only requested when
+ *                        SPFS_CFG_NAME_BLOOM is nonzero.
+ *   SPFS_MEM_READ_AHEAD: may be zero or less, only requested when
+ *                        SPFS_CFG_HAL_READ_AHEAD is nonzero.
  * @param fs        the filesystem struct
  * @param type      what the memory will be used for
  * @param req_size  requested number of bytes to erase
@@ -266,6 +356,18 @@ typedef struct {
   hal_erase_t erase;
   // HAL function for requesting memory
   hal_malloc_t malloc;
+#if SPFS_CFG_HAL_WRITEV
+  // HAL function for writing several ranges to medium in one call, optional
+  hal_writev_t writev;
+#endif
+#if SPFS_CFG_HAL_MAP
+  // HAL function for mapping medium to memory, optional
+  hal_map_t map;
+#endif
+#if SPFS_CFG_HAL_READ_AHEAD
+  // HAL function for reading several logical pages in one call, optional
+  hal_read_pages_t read_pages;
+#endif
 #if SPFS_CFG_DYNAMIC
   // physical flash size in bytes
   uint32_t pflash_sz;
@@ -303,6 +405,36 @@ typedef struct {
 #endif
 } spfs_dyn_t;
 
+/* per logical block page statistics */
+typedef struct {
+  // number of free pages in block
+  uint16_t pfree;
+  // number of deleted pages in block
+  uint16_t pdele;
+  // block erase count
+  uint16_t era_cnt;
+} spfs_blk_stat_t;
+
+/* index page location cache entry */
+typedef struct {
+  // file id, zero if unused
+  id_t id;
+  // index span
+  spix_t span;
+  // data page of index page
+  pix_t dpix;
+} spfs_ixcache_ent_t;
+
+/* file name hash index entry */
+typedef struct {
+  // hash of file name
+  uint32_t hash;
+  // file id, zero if unused
+  id_t id;
+  // data page of index header
+  pix_t dpix;
+} spfs_namehash_ent_t;
+
 typedef struct {
   // work ram 1
   uint8_t *work1;
@@ -322,6 +454,86 @@ typedef struct {
   void *cache;
   // cache page count
   uint16_t cache_cnt;
+#if SPFS_CFG_LU_MIRROR
+  // ram copy of lu pages, excluding block headers, indexed by log block
+  uint8_t *lu_mirror;
+  // number of log blocks having their lu pages mirrored
+  bix_t lu_mirror_cnt;
+#endif
+#if SPFS_CFG_BLOCK_STATS
+  // page statistics per logical block, indexed by log block
+  spfs_blk_stat_t *blk_stat;
+#endif
+#if SPFS_CFG_PFREE_BITMAP
+  // bitmap of free data pages, bit set if free, indexed by data page
+  uint32_t *pfree_bm;
+#endif
+#if SPFS_CFG_ID_BITMAP
+  // bitmap of free ids, bit set if free, bit n representing id n+1
+  uint32_t *id_bm;
+  // word index where next free id search starts
+  uint32_t id_bm_cursor;
+#endif
+#if SPFS_CFG_ID_RECYCLE_RING
+  // ids of removed files, free for reuse
+  id_t id_ring[SPFS_CFG_ID_RECYCLE_RING];
+  // next write position in id ring
+  uint8_t id_ring_ix;
+  // number of ids in id ring
+  uint8_t id_ring_cnt;
+#endif
+#if SPFS_CFG_IX_CACHE
+  // index page locations, hashed on id and span
+  spfs_ixcache_ent_t *ixcache;
+  // number of index page location cache entries
+  uint16_t ixcache_cnt;
+#endif
+#if SPFS_CFG_NAME_HASH
+  // index header locations, open addressed on file name hash
+  spfs_namehash_ent_t *namehash;
+  // number of name hash entries
+  uint16_t namehash_cnt;
+  // set if some file did not fit, name hash misses are then not final
+  uint8_t namehash_partial;
+#endif
+#if SPFS_CFG_NAME_BLOOM
+  // bloom filter over names of all files
+  uint8_t *bloom;
+  // number of bits in bloom filter
+  uint32_t bloom_bits;
+#endif
+#if SPFS_CFG_DIR_SLOTS
+  // name directory file id, zero if there is none
+  id_t dir_id;
+  // name directory file index header data page
+  pix_t dir_dpix;
+#endif
+#if SPFS_CFG_HAL_WRITEV
+  // medium writes queued for one vectored write
+  struct {
+    spfs_iovec_t iov[SPFS_CFG_HAL_WRITEV];
+    // copies of queued data not outliving the queueing call
+    uint8_t pool[SPFS_CFG_HAL_WRITEV * 16];
+    // number of queued ranges
+    uint16_t cnt;
+    // used bytes of pool
+    uint16_t pool_used;
+    // set while writes are gathered
+    uint8_t gather;
+  } wrq;
+#endif
+#if SPFS_CFG_HAL_READ_AHEAD
+  // logical pages read ahead in one call
+  struct {
+    uint8_t *buf;
+    // first logical page in buffer
+    pix_t lpix;
+    // number of pages in buffer
+    uint16_t cnt;
+    // number of pages buffer can hold
+    uint16_t max;
+  } ra;
+#endif
 
   bix_t lbix_gc_free;
   pix_t dpix_free_page_cursor;
@@ -379,12 +591,44 @@ typedef struct spfs_dir {
   pix_t dpix;
 } spfs_DIR;
 
+/* scatter/gather buffer */
+struct spfs_iov {
+  void *iov_base;
+  uint32_t iov_len;
+};
+
+/* zero copy read segment, pointing into mapped medium */
+typedef struct {
+  const uint8_t *data;
+  uint32_t len;
+} spfs_zc_seg_t;
+
 
 int SPFS_stat(spfs_t *fs, const char *path, struct spfs_stat *buf);
 spfs_file_t SPFS_open(spfs_t *fs, const char *name, int oflags, int mode);
 spfs_file_t SPFS_creat(spfs_t *fs, const char *name);
+/* creates a file of fixed size. If preallocated, all its pages are allocated
+   and filled with 0xff, and writes only clearing bits are then made in place,
+   never allocating pages or collecting garbage */
+spfs_file_t SPFS_creat_fix(spfs_t *fs, const char *name, uint32_t size, uint8_t prealloc);
+/* creates a rotating file holding the last size bytes written to it. Data is
+   stored in a ring of size bytes, new data overwriting the oldest. Rotating
+   files are always appended to */
+spfs_file_t SPFS_creat_rot(spfs_t *fs, const char *name, uint32_t size);
 int SPFS_read(spfs_t *fs, spfs_file_t fh, void *buf, uint32_t len);
 int SPFS_write(spfs_t *fs, spfs_file_t fh, const void *buf, uint32_t len);
+int SPFS_pread(spfs_t *fs, spfs_file_t fh, void *buf, uint32_t len, uint32_t offs);
+int SPFS_pwrite(spfs_t *fs, spfs_file_t fh, const void *buf, uint32_t len, uint32_t offs);
+int SPFS_readv(spfs_t *fs, spfs_file_t fh, const struct spfs_iov *iov, uint32_t iovcnt);
+int SPFS_writev(spfs_t *fs, spfs_file_t fh, const struct spfs_iov *iov, uint32_t iovcnt);
+#if SPFS_CFG_HAL_MAP
+/* reads by pointing into mapped medium, one segment per data page touched,
+   returns number of segments populated. The segment pointers are only valid
+   until the next call modifying the file system, such as a write, a remove,
+   a truncate or a garbage collection, which may move or erase the pages */
+int SPFS_read_zc(spfs_t *fs, spfs_file_t fh, spfs_zc_seg_t *segs, uint32_t seg_cnt,
+                 uint32_t len);
+#endif
 int SPFS_close(spfs_t *fs, spfs_file_t fh);
 int SPFS_remove(spfs_t *fs, const char *path);
 int SPFS_lseek(spfs_t *fs, spfs_file_t fh, int offs, uint8_t whence);
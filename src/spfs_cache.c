@@ -10,6 +10,7 @@
 #include "spfs_compile_cfg.h"
 #include "spfs.h"
 #include "spfs_lowlevel.h"
+#include "spfs_file.h"
 #include "spfs_cache.h"
 
 #undef _SPFS_DBG_PRE
@@ -25,6 +26,9 @@
 #define free_list(_fs)  (&cache(_fs)->free)
 #define read_list(_fs)  (&cache(_fs)->read)
 #define write_list(_fs) (&cache(_fs)->write)
+#if SPFS_CFG_CACHE_2Q
+#define read_in_list(_fs) (&cache(_fs)->read_in)
+#endif
 
 static void _add_last(spfs_cache_list *l, spfs_cache_page *p) {
   if (l->head == NULL) {
@@ -91,27 +95,116 @@ static void _touch(spfs_cache_list *l, spfs_cache_page *p) {
   _add_last(l, p);
 }
 
+// Pages in the read and write lists are indexed by an open addressed hash
+// table with linear probing, keyed by type and lpix for read pages and by
+// type and id for write pages.
+static uint32_t _hash_slot(spfs_t *fs, uint8_t type, uint32_t key) {
+  return ((key * 2 + type) * 2654435761UL) & cache(fs)->hmask;
+}
+
+static spfs_cache_page *_hash_get(spfs_t *fs, uint8_t type, uint32_t key) {
+  spfs_cache_page **htab = cache(fs)->htab;
+  uint32_t slot = _hash_slot(fs, type, key);
+  while (htab[slot]) {
+    spfs_cache_page *p = htab[slot];
+    if ((p->flags & SPFS_CACHE_FL_TYPE_MASK) == type && p->key == key) return p;
+    slot = (slot + 1) & cache(fs)->hmask;
+  }
+  return NULL;
+}
+
+static void _hash_put(spfs_t *fs, spfs_cache_page *p) {
+  spfs_cache_page **htab = cache(fs)->htab;
+  uint32_t slot = _hash_slot(fs, p->flags & SPFS_CACHE_FL_TYPE_MASK, p->key);
+  while (htab[slot]) {
+    slot = (slot + 1) & cache(fs)->hmask;
+  }
+  htab[slot] = p;
+}
+
+static void _hash_del(spfs_t *fs, spfs_cache_page *p) {
+  spfs_cache_page **htab = cache(fs)->htab;
+  const uint32_t mask = cache(fs)->hmask;
+  uint32_t slot = _hash_slot(fs, p->flags & SPFS_CACHE_FL_TYPE_MASK, p->key);
+  while (htab[slot] != p) {
+    slot = (slot + 1) & mask;
+  }
+  // shift back following entries of the probe sequence into the hole
+  uint32_t hole = slot;
+  while (1) {
+    slot = (slot + 1) & mask;
+    spfs_cache_page *q = htab[slot];
+    if (q == NULL) break;
+    uint32_t home = _hash_slot(fs, q->flags & SPFS_CACHE_FL_TYPE_MASK, q->key);
+    if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+      htab[hole] = q;
+      hole = slot;
+    }
+  }
+  htab[hole] = NULL;
+}
+
+// Removes and returns the read page to evict, or NULL if there are none.
+// With 2Q, read pages are first put in the A1 fifo, and are moved to the lru
+// read list if read again while in the fifo. Pages read only once, as when
+// scanning the medium, then pass through the fifo without evicting frequently
+// read pages. The fifo is evicted first when holding more than a quarter of
+// the cache pages.
+static spfs_cache_page *_rd_evict(spfs_t *fs) {
+  spfs_cache_page *p = NULL;
+#if SPFS_CFG_CACHE_2Q
+  spfs_cache *c = cache(fs);
+  if (!_is_empty(read_in_list(fs))
+      && (c->read_in_cnt > spfs_max(1, fs->run.cache_cnt / 4) || _is_empty(read_list(fs)))) {
+    p = _remove_first(read_in_list(fs));
+    c->read_in_cnt--;
+  } else
+#endif
+  if (!_is_empty(read_list(fs))) {
+    p = _remove_first(read_list(fs));
+  }
+  if (p) _hash_del(fs, p);
+  return p;
+}
+
 // This function has two return codes, actual return value and **page,
-// If cache page was claimed, it will end up in *page.
+// If cache page was claimed, it will end up in *page, assigned to given key
+// being the lpix for read pages and the file id for write pages.
 // If, when claiming a page, data had to be persistenced, the write result goes
 // in return value.
-_SPFS_STATIC int spfs_cache_page_claim(spfs_t *fs, uint8_t flags, spfs_cache_page **page) {
+_SPFS_STATIC int spfs_cache_page_claim(spfs_t *fs, uint8_t flags, uint32_t key,
+                                       spfs_cache_page **page) {
   spfs_cache_page *p = NULL;
   int res = SPFS_OK;
   char wr = ((flags & SPFS_CACHE_FL_TYPE_MASK) == SPFS_CACHE_FL_TYPE_WR);
+  if (!wr) cache(fs)->misses++;
   if (!_is_empty(free_list(fs))) {
     p = _remove_first(free_list(fs));
-  } else if (!_is_empty(read_list(fs))) {
-    p = _remove_first(read_list(fs));
-  } else if (wr && !_is_empty(write_list(fs))) {
+  } else {
+    p = _rd_evict(fs);
+  }
+  if (p == NULL && wr && !_is_empty(write_list(fs))) {
     p = _remove_first(write_list(fs));
     res = spfs_cache_page_flush(fs, p);
+    if (res) {
+      // keep the cached data of the evicted page for a later flush
+      _add_last(write_list(fs), p);
+      *page = NULL;
+      return res;
+    }
+    _hash_del(fs, p);
   }
   if (p) {
+    p->key = key;
     if (wr) {
       p->flags = SPFS_CACHE_FL_TYPE_WR;
       _add_last(write_list(fs), p);
     } else {
+#if SPFS_CFG_CACHE_2Q
+      p->flags = SPFS_CACHE_FL_TYPE_RD | SPFS_CACHE_FL_RD_IN;
+      _add_last(read_in_list(fs), p);
+      cache(fs)->read_in_cnt++;
+#else
       if (flags & SPFS_CACHE_FL_RD_LU) {
         p->flags = SPFS_CACHE_FL_TYPE_RD | SPFS_CACHE_FL_RD_LU;
         _add_first(read_list(fs), p);
@@ -119,17 +212,58 @@ _SPFS_STATIC int spfs_cache_page_claim(spfs_t *fs, uint8_t flags, spfs_cache_pag
         p->flags = SPFS_CACHE_FL_TYPE_RD;
         _add_last(read_list(fs), p);
       }
+#endif
     }
+    _hash_put(fs, p);
   }
   *page = p;
   return res;
 }
+// returns an open writable file descriptor for given id, or NULL
+static spfs_fd_t *_wr_fd(spfs_t *fs, id_t id) {
+  uint16_t i;
+  spfs_fd_t *fds = (spfs_fd_t *)fs->run.fd_area;
+  for (i = 0; i < fs->run.fd_cnt; i++) {
+    if (fds->hdl > 0 && fds->fi.id == id && (fds->fd_oflags & SPFS_O_WRONLY)) {
+      return fds;
+    }
+    fds++;
+  }
+  return NULL;
+}
+
+// Persists the data of a dirty write cache page. The page stays assigned to
+// its file, emptied so further writes only persist what is added. If the
+// data cannot be persisted, the page stays dirty.
 _SPFS_STATIC int spfs_cache_page_flush(spfs_t *fs, spfs_cache_page *p) {
-  return 0;
+  if ((p->flags & SPFS_CACHE_FL_TYPE_MASK) != SPFS_CACHE_FL_TYPE_WR
+      || (p->flags & SPFS_CACHE_FL_WR_DIRTY) == 0) {
+    return SPFS_OK;
+  }
+  spfs_fd_t *fd = _wr_fd(fs, p->id);
+  if (fd == NULL) {
+    ERR(-SPFS_ERR_FILE_CLOSED);
+  }
+  dbg("flush id:"_SPIPRIid" offs:"_SPIPRIi" size:"_SPIPRIi"\n", p->id, p->offset, p->size);
+  uint32_t fd_offs = fd->offset;
+  int res = spfs_file_write(fs, fd, p->offset, p->size, p->buf);
+  fd->offset = fd_offs;
+  ERR(res < 0 ? res : 0);
+  p->flags &= ~SPFS_CACHE_FL_WR_DIRTY;
+  p->offset += p->size;
+  p->size = 0;
+  return SPFS_OK;
 }
 
 _SPFS_STATIC int spfs_cache_page_drop(spfs_t *fs, spfs_cache_page *p) {
+  _hash_del(fs, p);
   if ((p->flags & SPFS_CACHE_FL_TYPE_MASK) == SPFS_CACHE_FL_TYPE_RD) {
+#if SPFS_CFG_CACHE_2Q
+    if (p->flags & SPFS_CACHE_FL_RD_IN) {
+      _remove(read_in_list(fs), p);
+      cache(fs)->read_in_cnt--;
+    } else
+#endif
     _remove(read_list(fs), p);
   } else {
     _remove(write_list(fs), p);
@@ -138,28 +272,201 @@ _SPFS_STATIC int spfs_cache_page_drop(spfs_t *fs, spfs_cache_page *p) {
   return 0;
 }
 
-spfs_cache_page *spfs_cache_rdpage_lookup(spfs_t *fs, pix_t lpix){
-  spfs_cache_page *p = free_list(fs)->head;
-  while (p) {
-    if (p->lpix == lpix) {
-      _touch(free_list(fs), p);
-      return p;
+_SPFS_STATIC spfs_cache_page *spfs_cache_wrpage_lookup(spfs_t *fs, id_t id) {
+  if (fs->run.cache == NULL) return NULL;
+  return _hash_get(fs, SPFS_CACHE_FL_TYPE_WR, (uint32_t)id);
+}
+
+// Writes to a file through its write cache page. Writes shorter than a data
+// page are gathered in the page and persisted once the page is filled, or
+// when the file is flushed. Other writes are written through.
+_SPFS_STATIC int spfs_cache_file_write(spfs_t *fs, spfs_fd_t *fd, uint32_t offs, uint32_t len,
+                                       const uint8_t *src) {
+  int res;
+  const uint32_t dpage_sz = SPFS_DPAGE_SZ(fs);
+  if (fd->fi.type == SPFS_PIXHDR_TY_FIXFILE) {
+    // cap as when writing through, not to gather what cannot be persisted
+    if (offs >= fd->fi.x_size) ERR(-SPFS_ERR_EOF);
+    len = spfs_min(len, fd->fi.x_size - offs);
+  }
+  spfs_cache_page *p = spfs_cache_wrpage_lookup(fs, fd->fi.id);
+  if (fs->run.cache == NULL || len >= dpage_sz
+      || (fd->fd_oflags & (SPFS_O_DIRECT | SPFS_O_REWR))
+      || fd->fi.type == SPFS_PIXHDR_TY_ROTFILE) {
+    // rotating files move their offsets on each write, never cached
+    if (p) {
+      res = spfs_cache_page_flush(fs, p);
+      ERR(res);
+      spfs_cache_page_drop(fs, p);
     }
+    return spfs_file_write(fs, fd, offs, len, src);
+  }
+
+  uint32_t written = 0;
+  while (len) {
+    uint32_t plen = spfs_min(len, dpage_sz - (offs % dpage_sz));
+    if (p && p->size
+        && (SPFS_OFFS2SPIX(fs, p->offset) != SPFS_OFFS2SPIX(fs, offs)
+            || offs < p->offset || offs > p->offset + p->size)) {
+      // not adjacent to cached data, persist and reassign
+      res = spfs_cache_page_flush(fs, p);
+      ERR(res);
+    }
+    if (p == NULL) {
+      res = spfs_cache_page_claim(fs, SPFS_CACHE_FL_TYPE_WR, (uint32_t)fd->fi.id, &p);
+      ERR(res);
+      if (p == NULL) {
+        // no cache page to be had, write through
+        res = spfs_file_write(fs, fd, offs, len, src);
+        ERR(res < 0 ? res : 0);
+        return written + res;
+      }
+      p->size = 0;
+    }
+    if (p->size == 0) p->offset = offs;
+    dbg("cache id:"_SPIPRIid" offs:"_SPIPRIi" len:"_SPIPRIi"\n", p->id, offs, plen);
+    spfs_memcpy(&p->buf[offs - p->offset], src, plen);
+    p->size = spfs_max(p->size, offs + plen - p->offset);
+    p->flags |= SPFS_CACHE_FL_WR_DIRTY;
+    _touch(write_list(fs), p);
+    offs += plen;
+    src += plen;
+    len -= plen;
+    written += plen;
+    fd->offset = offs;
+    if ((p->offset + p->size) % dpage_sz == 0) {
+      // reached end of data page, persist it
+      res = spfs_cache_page_flush(fs, p);
+      ERR(res);
+    }
+  }
+  return written;
+}
+
+// Persists any cached data of given file.
+_SPFS_STATIC int spfs_cache_file_flush(spfs_t *fs, id_t id) {
+  spfs_cache_page *p = spfs_cache_wrpage_lookup(fs, id);
+  if (p == NULL) return SPFS_OK;
+  int res = spfs_cache_page_flush(fs, p);
+  ERRET(res);
+}
+
+// Releases the write cache page of given file if it is persisted and the file
+// is no longer open for writing.
+_SPFS_STATIC void spfs_cache_file_release(spfs_t *fs, id_t id) {
+  spfs_cache_page *p = spfs_cache_wrpage_lookup(fs, id);
+  if (p && (p->flags & SPFS_CACHE_FL_WR_DIRTY) == 0 && _wr_fd(fs, id) == NULL) {
+    spfs_cache_page_drop(fs, p);
+  }
+}
+
+// Persists cached data of all files.
+_SPFS_STATIC int spfs_cache_flush(spfs_t *fs) {
+  int res = SPFS_OK;
+  if (fs->run.cache == NULL) return SPFS_OK;
+  spfs_cache_page *p = write_list(fs)->head;
+  while (p && res == SPFS_OK) {
+    res = spfs_cache_page_flush(fs, p);
     p = p->_next;
   }
-  return NULL;
+  ERRET(res);
+}
+
+// Drops cached data of given file at or beyond given size.
+_SPFS_STATIC void spfs_cache_file_trunc(spfs_t *fs, id_t id, uint32_t size) {
+  spfs_cache_page *p = spfs_cache_wrpage_lookup(fs, id);
+  if (p == NULL) return;
+  if (p->offset >= size || p->size == 0) {
+    dbg("drop id:"_SPIPRIid"\n", id);
+    spfs_cache_page_drop(fs, p);
+  } else if (p->offset + p->size > size) {
+    p->size = size - p->offset;
+  }
+}
+
+// Returns file size including cached data, an empty file being of size 0.
+_SPFS_STATIC uint32_t spfs_cache_file_size(spfs_t *fs, spfs_fd_t *fd) {
+  uint32_t size = fd->fi.size == SPFS_FILESZ_UNDEF ? 0 : SPFS_FI_SIZE(&fd->fi);
+  spfs_cache_page *p = spfs_cache_wrpage_lookup(fs, fd->fi.id);
+  if (p == NULL || p->size == 0) return size;
+  return spfs_max(size, p->offset + p->size);
+}
+
+_SPFS_STATIC spfs_cache_page *spfs_cache_rdpage_lookup(spfs_t *fs, pix_t lpix){
+  spfs_cache_page *p = _hash_get(fs, SPFS_CACHE_FL_TYPE_RD, lpix);
+  if (p) {
+    cache(fs)->hits++;
+#if SPFS_CFG_CACHE_2Q
+    if (p->flags & SPFS_CACHE_FL_RD_IN) {
+      // read again while in A1 fifo, promote
+      _remove(read_in_list(fs), p);
+      cache(fs)->read_in_cnt--;
+      p->flags &= ~SPFS_CACHE_FL_RD_IN;
+      _add_last(read_list(fs), p);
+      return p;
+    }
+#endif
+    _touch(read_list(fs), p);
+  }
+  return p;
+}
+
+// Mirrors a write to medium in any read cache pages covering given range.
+// Medium writes can only clear bits, hence the cached data is and:ed.
+_SPFS_STATIC void spfs_cache_rdpage_update(spfs_t *fs, uint32_t addr, const uint8_t *src,
+                                           uint32_t len) {
+  if (fs->run.cache == NULL || len == 0) return;
+  const uint32_t lpage_sz = SPFS_CFG_LPAGE_SZ(fs);
+  pix_t lpix = SPFS_ADDR2LPIX(fs, addr);
+  const pix_t lpix_end = SPFS_ADDR2LPIX(fs, addr + len - 1);
+  for (; lpix <= lpix_end; lpix++) {
+    spfs_cache_page *p = _hash_get(fs, SPFS_CACHE_FL_TYPE_RD, lpix);
+    if (p) {
+      uint32_t paddr = SPFS_LPIX2ADDR(fs, lpix);
+      uint32_t start = spfs_max(addr, paddr);
+      uint32_t end = spfs_min(addr + len, paddr + lpage_sz);
+      uint8_t *dst = &p->buf[start - paddr];
+      const uint8_t *s = &src[start - addr];
+      while (start++ < end) {
+        *dst++ &= *s++;
+      }
+    }
+  }
+}
+
+// Drops any read cache pages covering given range.
+_SPFS_STATIC void spfs_cache_rdpage_invalidate(spfs_t *fs, uint32_t addr, uint32_t len) {
+  if (fs->run.cache == NULL || len == 0) return;
+  pix_t lpix = SPFS_ADDR2LPIX(fs, addr);
+  const pix_t lpix_end = SPFS_ADDR2LPIX(fs, addr + len - 1);
+  for (; lpix <= lpix_end; lpix++) {
+    spfs_cache_page *p = _hash_get(fs, SPFS_CACHE_FL_TYPE_RD, lpix);
+    if (p) spfs_cache_page_drop(fs, p);
+  }
 }
 
 _SPFS_STATIC int spfs_cache_init(spfs_t *fs, void *mem, uint32_t sz) {
   // portion up the cache memory given to us
   uint8_t *m = (uint8_t *)mem;
-  uint32_t pages = (sz - spfs_align(sizeof(spfs_cache), SPFS_ALIGN)) / (
-      spfs_align(sizeof(spfs_cache_page), SPFS_ALIGN) + SPFS_CFG_LPAGE_SZ(fs));
-  dbg("cache pages: " _SPIPRIi "\n", pages);
+  uint32_t pages = (sz - spfs_align(sizeof(spfs_cache), SPFS_ALIGN)) / SPFS_CACHE_PAGE_MEM_SZ(fs);
+  // hash table of largest power of two entries not exceeding two per page,
+  // always leaving free slots
+  uint32_t hsz = 1;
+  while (hsz * 2 <= pages * 2) hsz *= 2;
+  while (pages && spfs_align(sizeof(spfs_cache), SPFS_ALIGN)
+      + spfs_align(hsz * sizeof(spfs_cache_page *), SPFS_ALIGN)
+      + pages * (spfs_align(sizeof(spfs_cache_page), SPFS_ALIGN) + SPFS_CFG_LPAGE_SZ(fs)) > sz) {
+    pages--;
+  }
+  if (pages == 0) return SPFS_OK;
+  dbg("cache pages: " _SPIPRIi ", hash entries: " _SPIPRIi "\n", pages, hsz);
   spfs_memset(mem, 0x00, sz);
   fs->run.cache_cnt = pages;
   fs->run.cache = (void *)m;
   m += spfs_align(sizeof(spfs_cache), SPFS_ALIGN);
+  cache(fs)->htab = (spfs_cache_page **)m;
+  cache(fs)->hmask = hsz - 1;
+  m += spfs_align(hsz * sizeof(spfs_cache_page *), SPFS_ALIGN);
 
   uint32_t p;
   for (p = 0; p < pages; p++) {
@@ -10,6 +10,7 @@
 
 #include "spfs_compile_cfg.h"
 #include "spfs.h"
+#include "spfs_file.h"
 
 /*
 
@@ -34,7 +35,14 @@
  page taken to represent a LU page will be put in the beginning of the Read
  list making it least prioritized.
 
- Read cache pages are simply mirrors of logical pages.
+ With SPFS_CFG_CACHE_2Q, read pages are instead first put in a fifo, and only
+ pages read again while in the fifo enter the Read list. Scans of the medium
+ then only cycle the fifo.
+
+ Read cache pages are simply mirrors of logical pages. Medium reads within one
+ logical page are served from the read cache. On a miss, the whole logical
+ page is read into a read cache page if the read regards LU or meta data. Data
+ reads are not admitted, as file data would shred the cache.
 
  Write cache pages are more complicated. A write cache page (WCP) is assigned
  to file descriptors. As many file descriptors can be opened to the same file,
@@ -56,19 +64,25 @@
  a WCP. If so, the WCP is first flushed. This will update the actual length and
  data of the file to ensure consistency.
 
+ When a file is closed and no longer open for writing, its WCP is flushed
+ and released.
+
  When a file is removed, any related uncommitted WCPs are dropped.
 
  When a file is truncated, any related WCPs with offset beyond new end are
  dropped.
 
  Metadata updates such as LU, file headers etc updates the read cache and
- writes through.
+ writes through. All medium writes update covered read cache pages, and
+ erases drop them.
 
  */
 
 typedef struct spfs_cache_page_s {
   uint8_t flags;
   union {
+    // lookup key, lpix for read cache, id for write cache
+    uint32_t key;
     // type read cache
     struct {
       // read cache logical page index
@@ -99,19 +113,50 @@ typedef struct {
   spfs_cache_list read;
   spfs_cache_list write;
   spfs_cache_list free;
+  // page lookup hash table
+  spfs_cache_page **htab;
+  // hash table entries - 1, entries being a power of two
+  uint32_t hmask;
+#if SPFS_CFG_CACHE_2Q
+  // A1 fifo of read pages read once
+  spfs_cache_list read_in;
+  uint32_t read_in_cnt;
+#endif
+  // read page lookups served by the cache
+  uint32_t hits;
+  // read pages claimed on lookup misses
+  uint32_t misses;
 } spfs_cache;
 
+// cache memory needed per cache page, including hash table entries
+#define SPFS_CACHE_PAGE_MEM_SZ(_fs) \
+  ( spfs_align(sizeof(spfs_cache_page), SPFS_ALIGN) + SPFS_CFG_LPAGE_SZ(_fs) + \
+    2 * sizeof(spfs_cache_page *) )
+
 #define SPFS_CACHE_FL_TYPE_MASK     (1<<0)
 #define SPFS_CACHE_FL_TYPE_RD       (0<<0)
 #define SPFS_CACHE_FL_TYPE_WR       (1<<0)
 #define SPFS_CACHE_FL_RD_LU         (1<<1)
 #define SPFS_CACHE_FL_WR_DIRTY      (1<<2)
+#define SPFS_CACHE_FL_RD_IN         (1<<3)
 
 _SPFS_STATIC int spfs_cache_init(spfs_t *fs, void *mem, uint32_t sz);
-_SPFS_STATIC int spfs_cache_page_claim(spfs_t *fs, uint8_t flags, spfs_cache_page **page);
+_SPFS_STATIC int spfs_cache_page_claim(spfs_t *fs, uint8_t flags, uint32_t key,
+                                       spfs_cache_page **page);
 _SPFS_STATIC int spfs_cache_page_flush(spfs_t *fs, spfs_cache_page *p);
 _SPFS_STATIC int spfs_cache_page_drop(spfs_t *fs, spfs_cache_page *p);
 _SPFS_STATIC spfs_cache_page *spfs_cache_rdpage_lookup(spfs_t *fs, uint32_t lpix);
+_SPFS_STATIC void spfs_cache_rdpage_update(spfs_t *fs, uint32_t addr, const uint8_t *src,
+                                           uint32_t len);
+_SPFS_STATIC void spfs_cache_rdpage_invalidate(spfs_t *fs, uint32_t addr, uint32_t len);
+_SPFS_STATIC spfs_cache_page *spfs_cache_wrpage_lookup(spfs_t *fs, id_t id);
+_SPFS_STATIC int spfs_cache_file_write(spfs_t *fs, spfs_fd_t *fd, uint32_t offs, uint32_t len,
+                                       const uint8_t *src);
+_SPFS_STATIC int spfs_cache_file_flush(spfs_t *fs, id_t id);
+_SPFS_STATIC void spfs_cache_file_release(spfs_t *fs, id_t id);
+_SPFS_STATIC int spfs_cache_flush(spfs_t *fs);
+_SPFS_STATIC void spfs_cache_file_trunc(spfs_t *fs, id_t id, uint32_t size);
+_SPFS_STATIC uint32_t spfs_cache_file_size(spfs_t *fs, spfs_fd_t *fd);
 
 
 #endif /* _SPFS_CACHE_H_ */
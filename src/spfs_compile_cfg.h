@@ -57,6 +57,14 @@
 #ifndef SPFS_CFG_COPY_BUF_SZ
 #define SPFS_CFG_COPY_BUF_SZ            (128)
 #endif
+// Number of lu entries decoded and filtered in one go when visiting the
+// file system. Costs 4 bytes of stack per entry, max 32.
+#ifndef SPFS_CFG_LU_DECODE_ENTS
+#define SPFS_CFG_LU_DECODE_ENTS         (32)
+#endif
+#if SPFS_CFG_LU_DECODE_ENTS > 32
+#error SPFS_CFG_LU_DECODE_ENTS must not exceed 32
+#endif
 
 
 /**
@@ -91,6 +99,154 @@
 #define SPFS_CFG_GC_WEIGHT_USED(fs)       (0)
 #endif
 
+// Keeps a copy of the lu pages in ram, kept coherent on all lu writes. All
+// file system scans are then served from ram instead of reading the medium.
+// Costs (lupages per block * logical page size - block header size) bytes
+// per logical block. If the SPFS_MEM_LU_MIRROR memory given at mount is not
+// enough for all blocks, only the first blocks will be mirrored.
+#ifndef SPFS_CFG_LU_MIRROR
+#define SPFS_CFG_LU_MIRROR                (0)
+#endif
+
+// Keeps count of free and deleted pages and erase count for each logical
+// block in ram. GC will then pick candidates without scanning the medium,
+// and free page searches skip full blocks. Costs 6 bytes per logical block.
+// If no SPFS_MEM_BLOCK_STATS memory is given at mount, medium is scanned
+// instead.
+#ifndef SPFS_CFG_BLOCK_STATS
+#define SPFS_CFG_BLOCK_STATS              (0)
+#endif
+
+// Keeps a bitmap of all free data pages in ram, making free page allocation
+// a word scan instead of traversing the lu pages. Costs one bit per data
+// page. If no SPFS_MEM_PFREE_BITMAP memory is given at mount, the lu pages
+// are traversed instead.
+#ifndef SPFS_CFG_PFREE_BITMAP
+#define SPFS_CFG_PFREE_BITMAP             (0)
+#endif
+
+// Keeps a bitmap of all free file ids in ram, making id allocation a word
+// scan instead of repeatedly traversing the lu pages. Costs one bit per
+// possible id. If no SPFS_MEM_ID_BITMAP memory is given at mount, the lu
+// pages are traversed instead.
+#ifndef SPFS_CFG_ID_BITMAP
+#define SPFS_CFG_ID_BITMAP                (0)
+#endif
+
+// Number of ids of removed files remembered for reuse when there is no free
+// id bitmap, saving a traversal of the lu pages per recycled id. Costs
+// sizeof(id_t) bytes per entry. Zero disables.
+#ifndef SPFS_CFG_ID_RECYCLE_RING
+#define SPFS_CFG_ID_RECYCLE_RING          (4)
+#endif
+
+// Number of entries in a ram cache mapping file id and index span to the
+// data page of the index page, sparing a traversal of the lu pages for each
+// index page lookup. Costs sizeof(spfs_ixcache_ent_t) bytes per entry. If
+// less SPFS_MEM_IX_CACHE memory is given at mount, fewer entries are used.
+// Zero disables.
+#ifndef SPFS_CFG_IX_CACHE
+#define SPFS_CFG_IX_CACHE                 (0)
+#endif
+
+// Number of index pages, following the index header, whose data page each
+// file descriptor remembers. Seeking within a file then finds the index page
+// without traversing the lu pages. Costs sizeof(pix_t) bytes per entry and
+// file descriptor. Zero disables.
+#ifndef SPFS_CFG_FD_IX_CHAIN
+#define SPFS_CFG_FD_IX_CHAIN              (0)
+#endif
+
+// Number of entries in a ram index mapping a hash of file names to the data
+// page of the index header, built at mount. Looking up a file by name then
+// reads one index header instead of traversing the lu pages and reading all
+// index headers. Costs sizeof(spfs_namehash_ent_t) bytes per entry. If there
+// are more files than entries, lookups of names not indexed fall back to
+// traversing. Zero disables.
+#ifndef SPFS_CFG_NAME_HASH
+#define SPFS_CFG_NAME_HASH                (0)
+#endif
+
+// Number of bytes of a ram bloom filter over file names, built at mount and
+// updated on create. Looking up a name that does not exist is then mostly
+// answered without touching the medium. Names of removed files are not
+// cleared from the filter, and merely cost a lookup. If less
+// SPFS_MEM_NAME_BLOOM memory is given at mount, a smaller filter is used.
+// Zero disables.
+#ifndef SPFS_CFG_NAME_BLOOM
+#define SPFS_CFG_NAME_BLOOM               (0)
+#endif
+
+// Number of slots in a name directory file kept on medium, mapping hashes of
+// file names to file ids. Looking up a file by name then reads the probed
+// slots and the index header of the matching file instead of reading all
+// index headers. The directory is updated in place on create and remove, and
+// verified against the index headers at mount. It is built at mount if
+// missing or not matching the files, unless there is no room for it. Costs 8
+// bytes of medium per slot. If it runs full, it is removed and rebuilt at next
+// mount. Zero disables.
+#ifndef SPFS_CFG_DIR_SLOTS
+#define SPFS_CFG_DIR_SLOTS                (0)
+#endif
+
+// Number of medium writes gathered while writing a file, and submitted in one
+// call to the writev HAL function. New data pages are queued, and the queue
+// is submitted when full, before touching any queued range, before index
+// pages are written and when the file write ends. If no writev function is
+// configured, queued writes are submitted one by one through write. Costs
+// sizeof(spfs_iovec_t) + 16 bytes of ram per entry. Zero disables.
+#ifndef SPFS_CFG_HAL_WRITEV
+#define SPFS_CFG_HAL_WRITEV               (0)
+#endif
+
+// Number of logical pages read ahead in one call to the read_pages HAL
+// function when reading files. When data pages following each other in a file
+// also follow each other physically within a block, they are read in one call
+// into a read ahead buffer, and subsequent reads are served from it. Files
+// read sequentially are read ahead as far as possible, other reads only as far
+// as they go. If no read_pages function is configured, or if less than two
+// pages of SPFS_MEM_READ_AHEAD memory is given at mount, nothing is read
+// ahead. Costs one logical page size of ram per page. Zero disables.
+#ifndef SPFS_CFG_HAL_READ_AHEAD
+#define SPFS_CFG_HAL_READ_AHEAD           (0)
+#endif
+
+// Enables the map HAL function and SPFS_read_zc, reading files by handing out
+// pointers into memory mapped medium instead of copying, e.g. for XIP flash.
+#ifndef SPFS_CFG_HAL_MAP
+#define SPFS_CFG_HAL_MAP                  (0)
+#endif
+
+// Number of file size records in the index header. Extending a file whose
+// index header is not otherwise rewritten then appends its new size to the
+// records in place instead of replacing the index header page. The page is
+// replaced only when all records are used. A record holds the size and its
+// complement, so a record torn by power loss is skipped when read. Costs 8
+// bytes per record of the index header, and of the index entries in it. Zero
+// disables.
+#ifndef SPFS_CFG_IXHDR_SZ_LOG
+#define SPFS_CFG_IXHDR_SZ_LOG             (0)
+#endif
+
+// Number of index pages, following the index header, whose data page is
+// recorded in a root in the index header. Finding such an index page then
+// reads its root record instead of traversing the lu pages. Records are
+// written in place when an index page is created or first found, and marked
+// stale when it moves, until the index header is replaced. Costs 4 bytes per
+// record of the index header, and of the index entries in it. Zero disables.
+#ifndef SPFS_CFG_IX_ROOT
+#define SPFS_CFG_IX_ROOT                  (0)
+#endif
+
+// Replaces the lru replacement of read cache pages by simplified 2Q. Pages
+// read once go through a fifo of a quarter of the cache pages, and only pages
+// read again while in the fifo are moved to the lru. Scans of the medium, as
+// when mounting, collecting garbage or reading directories, then keep
+// frequently read pages cached.
+#ifndef SPFS_CFG_CACHE_2Q
+#define SPFS_CFG_CACHE_2Q                 (0)
+#endif
+
 // Data written with SPFS_O_SENSITIVE will be physically zeroed
 // on spiflash when the data is deleted. It will however add an
 // extra read call every time a page needs to be deleted. 
@@ -46,11 +46,13 @@ const char *spfs_strerror(int err) {
   ERRCASE(SPFS_ERR_FREE_PAGE_NOT_RESERVED);
   ERRCASE(SPFS_ERR_NOT_READABLE);
   ERRCASE(SPFS_ERR_NOT_WRITABLE);
+  ERRCASE(SPFS_ERR_NOT_MAPPED);
   CASE(SPFS_VIS_CONT);
   CASE(SPFS_VIS_CONT_LU_RELOAD);
   CASE(SPFS_VIS_STOP);
   ERRCASE(SPFS_ERR_VIS_END);
   ERRCASE(SPFS_ERR_ASSERT);
+  CASE(SPFS_VIS_SKIP_BLOCK);
   default: return "?";
   }
 
@@ -11,6 +11,7 @@
 #include "spfs.h"
 #include "spfs_lowlevel.h"
 #include "spfs_file.h"
+#include "spfs_cache.h"
 
 #undef _SPFS_DBG_PRE
 #undef _SPFS_DBG_POST
@@ -38,6 +39,12 @@ _SPFS_STATIC int _fd_claim(spfs_t *fs, spfs_fd_t **fd) {
     if (fds->hdl == 0) {
       *fd = fds;
       fds->hdl = i+1+fs->cfg.filehandle_offset;
+#if SPFS_CFG_FD_IX_CHAIN
+      spfs_memset(fds->ixchain, 0xff, sizeof(fds->ixchain));
+#endif
+#if SPFS_CFG_HAL_READ_AHEAD
+      fds->ra_offset = (uint32_t)-1;
+#endif
       break;
     }
     fds++;
@@ -76,15 +83,40 @@ static void _inform(spfs_t *fs, spfs_file_event_t event, id_t id, spfs_file_even
           id);
   switch (event) {
   case SPFS_F_EV_REMOVE_IX:
+#if SPFS_CFG_IX_CACHE
+    // the id may be reused, forget all its index pages when it is removed
+    if (data->remove.spix == 0) _ixcache_drop_id(fs, id);
+    else                        _ixcache_drop(fs, id, data->remove.spix);
+#endif
+#if SPFS_CFG_NAME_HASH
+    if (data->remove.spix == 0) _namehash_drop(fs, id);
+#endif
+    if (data->remove.spix == 0) spfs_cache_file_trunc(fs, id, 0);
     for (i = 0; i < fs->run.fd_cnt; i++) {
       if (fds->fi.id == id && data->remove.spix == 0 && fds->hdl > 0) {
         dbg("fd:"_SPIPRIi" id:"_SPIPRIid" removed, closing handle\n",
             fds->hdl, id);
         fds->hdl = 0;
       }
+#if SPFS_CFG_FD_IX_CHAIN
+      if (fds->fi.id == id && data->remove.spix > 0
+          && data->remove.spix <= SPFS_CFG_FD_IX_CHAIN) {
+        fds->ixchain[data->remove.spix - 1] = (pix_t)-1;
+      }
+#endif
+      fds++;
     }
     break;
   case SPFS_F_EV_UPDATE_IX:
+#if SPFS_CFG_IX_CACHE
+    _ixcache_put(fs, id, data->update.spix, data->update.dpix);
+#endif
+#if SPFS_CFG_NAME_HASH
+    if (data->update.spix == 0) _namehash_move(fs, id, data->update.dpix);
+#endif
+#if SPFS_CFG_DIR_SLOTS
+    if (data->update.spix == 0 && id == fs->run.dir_id) fs->run.dir_dpix = data->update.dpix;
+#endif
     for (i = 0; i < fs->run.fd_cnt; i++) {
       if (fds->fi.id == id) {
         if (data->update.spix == 0) {
@@ -96,6 +128,11 @@ static void _inform(spfs_t *fs, spfs_file_event_t event, id_t id, spfs_file_even
               fds->hdl, id, data->update.spix, data->update.dpix);
           fds->dpix_ix = data->update.dpix;
         }
+#if SPFS_CFG_FD_IX_CHAIN
+        if (data->update.spix > 0 && data->update.spix <= SPFS_CFG_FD_IX_CHAIN) {
+          fds->ixchain[data->update.spix - 1] = data->update.dpix;
+        }
+#endif
       }
       fds++;
     }
@@ -113,6 +150,135 @@ static void _inform(spfs_t *fs, spfs_file_event_t event, id_t id, spfs_file_even
   }
 }
 
+#if SPFS_CFG_IX_ROOT
+// returns medium address of the index root record of given index span in the
+// index header at given page
+#define _IX_ROOT_ADDR(_fs, _dpix_ixhdr, _ixspix) \
+  ( SPFS_DPIXHDR2ADDR(_fs, _dpix_ixhdr) + SPFS_PIXHDR_IX_ROOT_OFFS + 4*((_ixspix)-1) )
+
+// reads the index root record of given index span from the index header at
+// given page
+static int _ix_root_rd(spfs_t *fs, pix_t dpix_ixhdr, spix_t ixspix, uint32_t *rec) {
+  uint8_t buf[4];
+  int res = _medium_read(fs, _IX_ROOT_ADDR(fs, dpix_ixhdr, ixspix), buf, 4, SPFS_T_META);
+  ERR(res);
+  bstr8 bs;
+  bstr8_init(&bs, buf);
+  *rec = bstr8_rd(&bs, 32);
+  ERRET(res);
+}
+
+// records given index page of given index span in the root of the index header
+// at given page, in place. If another page is recorded, the record is marked
+// stale instead. Page -1 means the index page is removed.
+static int _ix_root_set(spfs_t *fs, pix_t dpix_ixhdr, spix_t ixspix, pix_t dpix) {
+  if (ixspix == 0 || ixspix > SPFS_CFG_IX_ROOT || dpix_ixhdr == (pix_t)-1) return SPFS_OK;
+  uint32_t rec;
+  int res = _ix_root_rd(fs, dpix_ixhdr, ixspix, &rec);
+  ERR(res);
+  if (rec == SPFS_IX_ROOT_UNDEF) {
+    // dpix 0 cannot be told from a stale record, leave it to the lu pages
+    if (dpix == (pix_t)-1 || dpix == SPFS_IX_ROOT_STALE) return SPFS_OK;
+    rec = dpix;
+  } else if (rec != SPFS_IX_ROOT_STALE && rec != dpix) {
+    rec = SPFS_IX_ROOT_STALE;
+  } else {
+    return SPFS_OK;
+  }
+  dbg("ixhdr dpix:"_SPIPRIpg" root spix:"_SPIPRIsp" set "_SPIPRIi"\n", dpix_ixhdr, ixspix, rec);
+  uint8_t buf[4];
+  bstr8 bs;
+  bstr8_init(&bs, buf);
+  bstr8_wr(&bs, 32, rec);
+  res = _medium_write(fs, _IX_ROOT_ADDR(fs, dpix_ixhdr, ixspix), buf, 4,
+                      SPFS_C_UP | SPFS_T_META | _SPFS_HAL_WR_FL_OVERWRITE);
+  ERRET(res);
+}
+
+// resets given packed index root records of index pages marked stale, or
+// beyond given file size unless undefined, for a new index header
+static void _ix_root_refresh(spfs_t *fs, uint8_t *roots, uint32_t size) {
+  spix_t ixspix;
+  bstr8 bs;
+  bstr8_init(&bs, roots);
+  for (ixspix = 1; ixspix <= SPFS_CFG_IX_ROOT; ixspix++) {
+    bstr8_setp(&bs, 32*(ixspix-1));
+    uint32_t rec = bstr8_rd(&bs, 32);
+    if (rec == SPFS_IX_ROOT_STALE
+        || (size != SPFS_FILESZ_UNDEF && (size == 0 || ixspix > SPFS_OFFS2IXSPIX(fs, size-1)))) {
+      bstr8_setp(&bs, 32*(ixspix-1));
+      bstr8_wr(&bs, 32, SPFS_IX_ROOT_UNDEF);
+    }
+  }
+}
+
+// checks the page header of the index page recorded in an index root, as the
+// page may have been removed and reused since. Returns 1 if the page is the
+// index page of given span for given file id, else 0.
+static int _ix_root_check(spfs_t *fs, id_t id, spix_t ixspix, pix_t dpix) {
+  uint8_t buf[SPFS_PHDR_MAX_SZ];
+  spfs_phdr_t phdr;
+  int res = _medium_read(fs, SPFS_DPIX2ADDR(fs, dpix) + SPFS_DPHDROFFS(fs), buf,
+                         SPFS_PHDR_SZ(fs), SPFS_T_META);
+  ERR(res);
+  _phdr_rdmem(fs, buf, &phdr);
+  return phdr.id == id && phdr.span == ixspix && (phdr.p_flags & SPFS_PHDR_FL_IDX) == 0;
+}
+#endif
+
+// finds index page with given span for given file id, using index chains
+// of open file descriptors and the index root of the index header at given
+// page, if not -1, before traversing the lu pages. The index root is only
+// read here, it is recorded when index pages are written.
+static int _ix_find(spfs_t *fs, id_t id, spix_t ixspix, pix_t dpix_ixhdr, pix_t *dpix) {
+#if SPFS_CFG_FD_IX_CHAIN
+  uint16_t i;
+  spfs_fd_t *fds = (spfs_fd_t *)fs->run.fd_area;
+  if (ixspix > 0 && ixspix <= SPFS_CFG_FD_IX_CHAIN) {
+    for (i = 0; i < fs->run.fd_cnt; i++) {
+      if (fds[i].hdl > 0 && fds[i].fi.id == id && fds[i].ixchain[ixspix - 1] != (pix_t)-1) {
+        *dpix = fds[i].ixchain[ixspix - 1];
+        dbg("id:"_SPIPRIid" spix:"_SPIPRIsp" from fd:"_SPIPRIi" dpix:"_SPIPRIpg"\n",
+            id, ixspix, fds[i].hdl, *dpix);
+        return SPFS_OK;
+      }
+    }
+  }
+#endif
+  int res;
+#if SPFS_CFG_IX_ROOT
+  uint32_t rec = SPFS_IX_ROOT_UNDEF;
+  if (ixspix > 0 && ixspix <= SPFS_CFG_IX_ROOT && dpix_ixhdr != (pix_t)-1) {
+    res = _ix_root_rd(fs, dpix_ixhdr, ixspix, &rec);
+    ERR(res);
+  }
+  if (rec != SPFS_IX_ROOT_UNDEF && rec != SPFS_IX_ROOT_STALE) {
+    res = _ix_root_check(fs, id, ixspix, rec);
+    ERR(res < 0 ? res : SPFS_OK);
+    if (res == 0) rec = SPFS_IX_ROOT_UNDEF;
+  }
+  if (rec != SPFS_IX_ROOT_UNDEF && rec != SPFS_IX_ROOT_STALE) {
+    *dpix = rec;
+    dbg("id:"_SPIPRIid" spix:"_SPIPRIsp" from root dpix:"_SPIPRIpg"\n", id, ixspix, *dpix);
+  } else {
+    res = spfs_page_find(fs, id, ixspix, SPFS_PAGE_FIND_FL_IX, dpix);
+    ERR(res);
+  }
+#else
+  (void)dpix_ixhdr;
+  res = spfs_page_find(fs, id, ixspix, SPFS_PAGE_FIND_FL_IX, dpix);
+  ERR(res);
+#endif
+#if SPFS_CFG_FD_IX_CHAIN
+  if (ixspix > 0 && ixspix <= SPFS_CFG_FD_IX_CHAIN) {
+    for (i = 0; i < fs->run.fd_cnt; i++) {
+      if (fds[i].hdl > 0 && fds[i].fi.id == id) fds[i].ixchain[ixspix - 1] = *dpix;
+    }
+  }
+#endif
+  return SPFS_OK;
+}
+
 // calculate number of needed meta pages when writing to a file with given
 // current size, from given offset and length
 static uint32_t _calc_write_meta_pages(spfs_t *fs, uint32_t cursz, uint32_t offset, uint32_t len) {
@@ -191,15 +357,45 @@ static int _ixhdr_update(spfs_t *fs, _ixhdr_update_t *update,
 #endif
   res = spfs_page_ixhdr_write(fs, dst_dpix, &pixhdr, SPFS_C_UP);
   ERR(res);
+#if SPFS_CFG_IX_ROOT
+  // the index root is not part of the unpacked header, carry it over
+  uint8_t roots[4*SPFS_CFG_IX_ROOT];
+  res = _medium_read(fs, SPFS_DPIXHDR2ADDR(fs, src_dpix) + SPFS_PIXHDR_IX_ROOT_OFFS,
+                     roots, sizeof(roots), SPFS_T_META);
+  ERR(res);
+  _ix_root_refresh(fs, roots, pixhdr.fi.size);
+  res = _medium_write(fs, SPFS_DPIXHDR2ADDR(fs, dst_dpix) + SPFS_PIXHDR_IX_ROOT_OFFS,
+                      roots, sizeof(roots), SPFS_C_UP | SPFS_T_META | _SPFS_HAL_WR_FL_OVERWRITE);
+  ERR(res);
+#endif
   res = _page_copy(fs, _dpix2lpix(fs, dst_dpix), _dpix2lpix(fs, src_dpix),
                    1);
   ERRET(res);
 }
 
+#if SPFS_CFG_IXHDR_SZ_LOG
+// appends a size record to the index header at given page in place. Returns 1
+// if appended, or 0 if all records are used and the page must be replaced.
+static int _ixhdr_log_sz(spfs_t *fs, pix_t dpix, uint32_t size) {
+  uint8_t mem[SPFS_PIXHDR_MAX_SZ];
+  uint32_t addr = SPFS_DPIXHDR2ADDR(fs, dpix);
+  int res = _medium_read(fs, addr, mem, SPFS_PIXHDR_SZ(fs), SPFS_T_META);
+  ERR(res);
+  int rec = _pixhdr_logmem_sz(fs, mem, size);
+  if (rec < 0) return 0;
+  dbg("ixhdr dpix:"_SPIPRIpg" size record "_SPIPRIi":"_SPIPRIi"\n", dpix, rec, size);
+  uint32_t offs = SPFS_PIXHDR_SZ_LOG_OFFS + SPFS_PIXHDR_SZ_REC_SZ*rec;
+  res = _medium_write(fs, addr + offs, &mem[offs], SPFS_PIXHDR_SZ_REC_SZ,
+                      SPFS_C_UP | SPFS_T_META | _SPFS_HAL_WR_FL_OVERWRITE);
+  ERR(res);
+  return 1;
+}
+#endif
+
 static int _ix_get_entry(spfs_t *fs, id_t id, spix_t dspix, pix_t *entry_dpix, pix_t *ixdpix) {
   spix_t ixspix = SPFS_DSPIX2IXSPIX(fs, dspix);
   pix_t found_ixdpix;
-  int res = spfs_page_find(fs, id, ixspix, SPFS_PAGE_FIND_FL_IX, &found_ixdpix);
+  int res = _ix_find(fs, id, ixspix, (pix_t)-1, &found_ixdpix);
   ERR(res);
   if (ixdpix) *ixdpix = found_ixdpix;
   spix_t ix_rel_entry;
@@ -240,15 +436,235 @@ static int _ixhdr_rewrite_flags(spfs_t *fs, pix_t dpix, uint8_t f_flags) {
 
 
 
-static int _file_mknod(spfs_t *fs, const char *name, uint8_t type, uint32_t x_sz,
-                            const uint8_t *meta, spfs_fd_t *fd) {
+#if SPFS_CFG_DIR_SLOTS
+// Name directory slots are a 32 bit name hash followed by a 32 bit file id,
+// little endian. Slots are only ever rewritten by clearing bits, a free slot
+// is all ones and a removed slot is all zeroes. A slot is entered before its
+// file is created and cleared after its file is removed. Slot updates are not
+// journaled, instead the directory is verified against the index headers at
+// mount and rebuilt if they disagree, as after an interrupted update or after
+// files were changed by a build without name directory. Slots of files never
+// created are weeded out when verifying the index header.
+#define _SPFS_DIR_SLOT_SZ         (8)
+#define _SPFS_DIR_SZ              (SPFS_CFG_DIR_SLOTS * _SPFS_DIR_SLOT_SZ)
+#define _SPFS_DIR_SLOT_FREE       (0xffffffff)
+#define _SPFS_DIR_SLOT_DELE       (0)
+// number of slots read in one go when probing
+#define _SPFS_DIR_PROBE_SLOTS     (8)
+// number of ids with matching name hash resolved in one traversal
+#define _SPFS_DIR_FIND_IDS        (4)
+
+#define _SPFS_DIR_OP_FIND         (0)
+#define _SPFS_DIR_OP_PUT          (1)
+#define _SPFS_DIR_OP_DROP         (2)
+
+static uint32_t _dir_rd32(const uint8_t *m) {
+  return m[0] | (m[1] << 8) | (m[2] << 16) | ((uint32_t)m[3] << 24);
+}
+
+static void _dir_wr32(uint8_t *m, uint32_t v) {
+  m[0] = v; m[1] = v >> 8; m[2] = v >> 16; m[3] = v >> 24;
+}
+
+// mixes name hash and id of a file into the sum verifying the directory
+static uint32_t _dir_sum(uint32_t hash, uint32_t id) {
+  return hash ^ (id * 0x9e3779b1);
+}
+
+// sets up a file descriptor for the name directory file
+static void _dir_fd(spfs_t *fs, spfs_fd_t *fd, uint32_t oflags) {
+  spfs_memset(fd, 0, sizeof(spfs_fd_t));
+  fd->dpix_ix = (pix_t)-1;
+  fd->dpix_ixhdr = fs->run.dir_dpix;
+  fd->fi.id = fs->run.dir_id;
+  fd->fi.size = _SPFS_DIR_SZ;
+  fd->fi.x_size = _SPFS_DIR_SZ;
+  fd->fi.type = SPFS_PIXHDR_TY_DIR;
+  fd->fi.f_flags = 0xff;
+  fd->fd_oflags = oflags;
+#if SPFS_CFG_HAL_READ_AHEAD
+  fd->ra_offset = (uint32_t)-1;
+#endif
+}
+
+// reads or rewrites cnt slots in the name directory file
+static int _dir_io(spfs_t *fs, uint32_t slot, uint8_t *buf, uint32_t cnt, uint8_t wr) {
+  spfs_fd_t dfd;
+  _dir_fd(fs, &dfd, SPFS_O_REWR);
+  int res = wr
+      ? spfs_file_write(fs, &dfd, slot * _SPFS_DIR_SLOT_SZ, cnt * _SPFS_DIR_SLOT_SZ, buf)
+      : spfs_file_read(fs, &dfd, slot * _SPFS_DIR_SLOT_SZ, cnt * _SPFS_DIR_SLOT_SZ, buf);
+  ERR(res < 0 ? res : SPFS_OK);
+  return SPFS_OK;
+}
+
+typedef struct {
+  const char *name;
+  const id_t *ids;
+  uint32_t cnt;
+  spfs_pixhdr_t *pixhdr;
+  pix_t dpix;
+} _dir_resolve_varg_t;
+static int _dir_resolve_v(spfs_t *fs, uint32_t lu_entry, spfs_vis_info_t *info, void *varg) {
+  _dir_resolve_varg_t *arg = (_dir_resolve_varg_t *)varg;
+  id_t id = lu_entry >> SPFS_LU_FLAG_BITS;
+  uint32_t i;
+  for (i = 0; i < arg->cnt && arg->ids[i] != id; i++);
+  if (i == arg->cnt) return SPFS_VIS_CONT;
+  int res = _page_ixhdr_read(fs, info->dpix, arg->pixhdr, 0);
+  ERR(res);
+  if (arg->pixhdr->phdr.span == 0
+      && spfs_strncmp(arg->name, (char *)arg->pixhdr->name, SPFS_CFG_FILE_NAME_SZ) == 0) {
+    arg->dpix = info->dpix;
+    return SPFS_VIS_STOP;
+  }
+  return SPFS_VIS_CONT;
+}
+
+// finds the index header of the file with given name among the files with
+// given ids, in one traversal. Returns -SPFS_ERR_FILE_NOT_FOUND if none has
+// the name.
+static int _dir_resolve(spfs_t *fs, const char *name, const id_t *ids, uint32_t cnt,
+                        pix_t *dpix, spfs_pixhdr_t *pixhdr) {
   int res;
-  dbg("name:\"%s\" type:" _SPIPRIi "\n", name, type);
-  pix_t free_dpix = (pix_t)-1;
-  id_t id = (id_t)-1;
-  res = _id_find_free(fs, &id, name);
+  if (cnt == 1) {
+    // the index cache may know where it is
+    res = spfs_page_find(fs, ids[0], 0, SPFS_PAGE_FIND_FL_IX, dpix);
+    if (res == -SPFS_ERR_PAGE_NOT_FOUND) return -SPFS_ERR_FILE_NOT_FOUND; // file never created
+    ERR(res);
+    res = _page_ixhdr_read(fs, *dpix, pixhdr, 0);
+    ERR(res);
+    if (spfs_strncmp(name, (char *)pixhdr->name, SPFS_CFG_FILE_NAME_SZ)) return -SPFS_ERR_FILE_NOT_FOUND;
+    return SPFS_OK;
+  }
+  _dir_resolve_varg_t arg = {.name = name, .ids = ids, .cnt = cnt, .pixhdr = pixhdr};
+  spfs_vis_desc_t desc = {.v = _dir_resolve_v, .varg = &arg, .flags = SPFS_VIS_FL_IX,
+                          .vblk = spfs_vis_blk_skip_unused};
+  res = spfs_page_visit_desc(fs, fs->run.dpix_find_cursor, fs->run.dpix_find_cursor, &desc);
+  if (res == -SPFS_ERR_VIS_END) return -SPFS_ERR_FILE_NOT_FOUND;
+  ERR(res);
+  *dpix = arg.dpix;
+  return SPFS_OK;
+}
+
+// walks the probe sequence for given name hash. Depending on op, returns the
+// first free slot or the slot with given file id, or finds the file with
+// given name, filling in dpix and pixhdr. If there is no such slot or file,
+// -SPFS_ERR_FILE_NOT_FOUND is returned.
+static int _dir_probe(spfs_t *fs, uint8_t op, uint32_t hash, const char *name, id_t id,
+                      pix_t *dpix, spfs_pixhdr_t *pixhdr) {
+  uint8_t buf[_SPFS_DIR_PROBE_SLOTS * _SPFS_DIR_SLOT_SZ];
+  id_t ids[_SPFS_DIR_FIND_IDS];
+  uint32_t idcnt = 0;
+  uint32_t slot = hash % SPFS_CFG_DIR_SLOTS;
+  uint32_t n = 0;
+  int res;
+  while (n < SPFS_CFG_DIR_SLOTS) {
+    uint32_t cnt = spfs_min(_SPFS_DIR_PROBE_SLOTS, SPFS_CFG_DIR_SLOTS - slot);
+    cnt = spfs_min(cnt, SPFS_CFG_DIR_SLOTS - n);
+    res = _dir_io(fs, slot, buf, cnt, 0);
+    ERR(res);
+    uint32_t i;
+    for (i = 0; i < cnt; i++) {
+      uint32_t shash = _dir_rd32(&buf[i * _SPFS_DIR_SLOT_SZ]);
+      uint32_t sid = _dir_rd32(&buf[i * _SPFS_DIR_SLOT_SZ + 4]);
+      if (sid == _SPFS_DIR_SLOT_FREE) {
+        if (op == _SPFS_DIR_OP_PUT) return slot + i;
+        n = SPFS_CFG_DIR_SLOTS;
+        break;
+      }
+      if (sid == _SPFS_DIR_SLOT_DELE || shash != hash) continue;
+      if (op == _SPFS_DIR_OP_DROP && sid == id) return slot + i;
+      if (op == _SPFS_DIR_OP_FIND) {
+        ids[idcnt++] = (id_t)sid;
+        if (idcnt == _SPFS_DIR_FIND_IDS) {
+          res = _dir_resolve(fs, name, ids, idcnt, dpix, pixhdr);
+          if (res != -SPFS_ERR_FILE_NOT_FOUND) ERRET(res);
+          idcnt = 0;
+        }
+      }
+    }
+    n += cnt;
+    slot = (slot + cnt) % SPFS_CFG_DIR_SLOTS;
+  }
+  if (idcnt) {
+    res = _dir_resolve(fs, name, ids, idcnt, dpix, pixhdr);
+    if (res != -SPFS_ERR_FILE_NOT_FOUND) ERRET(res);
+  }
+  return -SPFS_ERR_FILE_NOT_FOUND;
+}
+
+// removes the name directory file, it is rebuilt at next mount
+static int _dir_remove(spfs_t *fs) {
+  spfs_fd_t dfd;
+  spfs_pixhdr_t pixhdr;
+  _dir_fd(fs, &dfd, 0);
+  // an unfinished directory may not be filled
+  int res = _page_ixhdr_read(fs, fs->run.dir_dpix, &pixhdr, 0);
+  ERR(res);
+  dfd.fi.size = pixhdr.fi.size;
+  dbg("removing name directory id:"_SPIPRIid"\n", fs->run.dir_id);
+  fs->run.dir_id = 0;
+  res = spfs_file_fremove(fs, &dfd);
+  ERRET(res);
+}
+
+// enters file with given name and id in the name directory. If the directory
+// is full, it is removed.
+static int _dir_put(spfs_t *fs, const char *name, id_t id) {
+  uint32_t hash = _namehash_calc(name);
+  int res = _dir_probe(fs, _SPFS_DIR_OP_PUT, hash, name, id, NULL, NULL);
+  if (res == -SPFS_ERR_FILE_NOT_FOUND) {
+    dbg("name directory full\n");
+    res = _dir_remove(fs);
+    ERRET(res);
+  }
+  ERR(res < 0 ? res : SPFS_OK);
+  uint8_t slot[_SPFS_DIR_SLOT_SZ];
+  _dir_wr32(&slot[0], hash);
+  _dir_wr32(&slot[4], id);
+  dbg("name:\"%s\" id:"_SPIPRIid" slot:"_SPIPRIi"\n", name, id, res);
+  res = _dir_io(fs, (uint32_t)res, slot, 1, 1);
+  ERRET(res);
+}
+
+// clears slot of file with given name and id from the name directory
+static int _dir_drop(spfs_t *fs, const char *name, id_t id) {
+  uint32_t hash = _namehash_calc(name);
+  int res = _dir_probe(fs, _SPFS_DIR_OP_DROP, hash, name, id, NULL, NULL);
+  if (res == -SPFS_ERR_FILE_NOT_FOUND) return SPFS_OK;
+  ERR(res < 0 ? res : SPFS_OK);
+  uint8_t slot[_SPFS_DIR_SLOT_SZ];
+  spfs_memset(slot, 0x00, sizeof(slot));
+  dbg("name:\"%s\" id:"_SPIPRIid" slot:"_SPIPRIi"\n", name, id, res);
+  res = _dir_io(fs, (uint32_t)res, slot, 1, 1);
+  ERRET(res);
+}
+
+// looks up file by name in the name directory
+static int _dir_find(spfs_t *fs, const char *name, pix_t *dpix, spfs_pixhdr_t *pixhdr) {
+  int res = _dir_probe(fs, _SPFS_DIR_OP_FIND, _namehash_calc(name), name, 0, dpix, pixhdr);
+  if (res == -SPFS_ERR_FILE_NOT_FOUND) return res;
   ERR(res);
-  res = _page_allocate_free(fs, &free_dpix, id, SPFS_LU_FL_INDEX);
+  dbg("name:\"%s\" directory dpix:"_SPIPRIpg"\n", name, *dpix);
+  return SPFS_OK;
+}
+#endif
+
+// creates a file index header with given free id at given free page
+static int _file_mknod_at(spfs_t *fs, const char *name, uint8_t type, uint32_t x_sz,
+                          const uint8_t *meta, spfs_fd_t *fd, id_t id, pix_t free_dpix) {
+  int res;
+  dbg("name:\"%s\" type:" _SPIPRIi " id:" _SPIPRIid " dpix:" _SPIPRIpg "\n",
+      name, type, id, free_dpix);
+#if SPFS_CFG_DIR_SLOTS
+  if (fs->run.dir_id && type != SPFS_PIXHDR_TY_DIR) {
+    // enter in directory before creating, so the directory covers all files
+    res = _dir_put(fs, name, id);
+    ERR(res);
+  }
+#endif
+  res = _lu_page_allocate(fs, free_dpix, id, SPFS_LU_FL_INDEX);
   ERR(res);
   spfs_pixhdr_t ixphdr;
   ixphdr.phdr.id = id;
@@ -271,28 +687,80 @@ static int _file_mknod(spfs_t *fs, const char *name, uint8_t type, uint32_t x_sz
 #endif
   res = spfs_page_ixhdr_write(fs, free_dpix, &ixphdr, SPFS_C_UP);
   ERR(res);
+#if SPFS_CFG_IX_CACHE
+  // forget anything left from a previous file with the id
+  _ixcache_drop_id(fs, id);
+  _ixcache_put(fs, id, 0, free_dpix);
+#endif
+#if SPFS_CFG_NAME_HASH
+  if (type != SPFS_PIXHDR_TY_DIR) _namehash_put(fs, _namehash_calc(name), id, free_dpix);
+#endif
+#if SPFS_CFG_NAME_BLOOM
+  if (type != SPFS_PIXHDR_TY_DIR) _bloom_add(fs, _namehash_calc(name));
+#endif
   if (fd) {
     fd->offset = 0;
     fd->dpix_ixhdr = free_dpix;
+    fd->dpix_ix = free_dpix;
     spfs_memcpy(&fd->fi, &ixphdr.fi, sizeof(spfs_fi_t));
   }
   ERRET(res);
 }
 
+static int _file_mknod(spfs_t *fs, const char *name, uint8_t type, uint32_t x_sz,
+                            const uint8_t *meta, spfs_fd_t *fd) {
+  int res;
+  pix_t free_dpix = (pix_t)-1;
+  id_t id = (id_t)-1;
+  spfs_pixhdr_t pixhdr;
+  res = spfs_file_find_creat(fs, name, NULL, &pixhdr, &id, &free_dpix);
+  if (res == SPFS_OK) res = -SPFS_ERR_NAME_CONFLICT;
+  if (res == -SPFS_ERR_FILE_NOT_FOUND) res = SPFS_OK;
+  ERR(res);
+  res = _file_mknod_at(fs, name, type, x_sz, meta, fd, id, free_dpix);
+  ERRET(res);
+}
+
 _SPFS_STATIC int spfs_file_create(spfs_t *fs, spfs_fd_t *fd, const char *name) {
   int res = _file_mknod(fs, name, SPFS_PIXHDR_TY_FILE, -1, NULL, fd);
   ERRET(res);
 }
 
-_SPFS_STATIC int spfs_file_create_fix(spfs_t *fs, spfs_fd_t *fd, const char *name, uint32_t fixed_size) {
+// creates a file with id and free page from spfs_file_find_creat
+_SPFS_STATIC int spfs_file_create_at(spfs_t *fs, spfs_fd_t *fd, const char *name,
+                                     id_t id, pix_t free_dpix) {
+  int res = _file_mknod_at(fs, name, SPFS_PIXHDR_TY_FILE, -1, NULL, fd, id, free_dpix);
+  ERRET(res);
+}
+
+// Creates a fixed size file. If preallocated, all data and index pages are
+// allocated up front and the file is filled with 0xff, so later writes only
+// clearing bits are made in place.
+_SPFS_STATIC int spfs_file_create_fix(spfs_t *fs, spfs_fd_t *fd, const char *name, uint32_t fixed_size,
+                                      uint8_t prealloc) {
+  if (fixed_size == 0 || fixed_size == SPFS_FILESZ_UNDEF) ERR(-SPFS_ERR_ARG);
+  spfs_fd_t pfd;
+  if (fd == NULL) fd = &pfd;
   int res = _file_mknod(fs, name, SPFS_PIXHDR_TY_FIXFILE, fixed_size, NULL, fd);
+  ERR(res);
+  if (prealloc) {
+    fd->fd_oflags = 0;
+    res = spfs_file_writev(fs, fd, 0, NULL, fixed_size);
+    ERR(res < 0 ? res : SPFS_OK);
+    // back at the start of the file
+    fd->offset = 0;
+    fd->dpix_ix = fd->dpix_ixhdr;
+    res = SPFS_OK;
+  }
   ERRET(res);
 }
 
-//_SPFS_STATIC int spfs_file_create_rot(spfs_t *fs, spfs_fd_t *fd, const char *name, uint32_t rot_size) {
-//  int res = _file_mknod(fs, name, SPFS_PIXHDR_TY_ROTFILE, rot_size, NULL, fd);
-//  ERRET(res);
-//}
+_SPFS_STATIC int spfs_file_create_rot(spfs_t *fs, spfs_fd_t *fd, const char *name, uint32_t rot_size) {
+  // the size of a full ring is twice that of the ring, at most
+  if (rot_size == 0 || rot_size > SPFS_FILESZ_UNDEF / 2) ERR(-SPFS_ERR_ARG);
+  int res = _file_mknod(fs, name, SPFS_PIXHDR_TY_ROTFILE, rot_size, NULL, fd);
+  ERRET(res);
+}
 
 typedef struct {
   spfs_pixhdr_t *pixhdr;
@@ -318,8 +786,9 @@ static int _file_find_v(spfs_t *fs, uint32_t lu_entry, spfs_vis_info_t *info, vo
   if (arg->pixhdr->phdr.p_flags & SPFS_PHDR_FL_IDX) {
     ERR(-SPFS_ERR_LU_PHDR_FLAG_MISMATCH);
   }
-  // make sure the index has span 0, meaning index header
-  if (arg->pixhdr->phdr.span) {
+  // make sure the index has span 0, meaning index header, and not a
+  // name directory file
+  if (arg->pixhdr->phdr.span || arg->pixhdr->fi.type == SPFS_PIXHDR_TY_DIR) {
     return SPFS_VIS_CONT;
   }
 
@@ -330,12 +799,67 @@ static int _file_find_v(spfs_t *fs, uint32_t lu_entry, spfs_vis_info_t *info, vo
   }
   return SPFS_VIS_CONT;
 }
+
+#if SPFS_CFG_NAME_HASH
+// looks up file by name in the name hash, verifying the index header.
+// Returns -SPFS_ERR_FILE_NOT_FOUND if the name is not indexed.
+static int _file_find_hashed(spfs_t *fs, const char *name, pix_t *dpix, spfs_pixhdr_t *pixhdr) {
+  uint32_t hash = _namehash_calc(name);
+  uint16_t i;
+  uint16_t ix = hash % fs->run.namehash_cnt;
+  for (i = 0; i < fs->run.namehash_cnt; i++) {
+    spfs_namehash_ent_t *e = &fs->run.namehash[ix];
+    if (e->id == 0) break;
+    if (e->hash == hash) {
+      int res = _page_ixhdr_read(fs, e->dpix, pixhdr, 0);
+      ERR(res);
+      if (pixhdr->phdr.id == e->id && pixhdr->phdr.span == 0
+          && (pixhdr->phdr.p_flags & SPFS_PHDR_FL_IDX) == 0
+          && spfs_strncmp(name, (char *)pixhdr->name, SPFS_CFG_FILE_NAME_SZ) == 0) {
+        *dpix = e->dpix;
+        dbg("name:\"%s\" hashed dpix:"_SPIPRIpg"\n", name, *dpix);
+        return SPFS_OK;
+      }
+    }
+    if (++ix == fs->run.namehash_cnt) ix = 0;
+  }
+  return -SPFS_ERR_FILE_NOT_FOUND;
+}
+#endif
+
 _SPFS_STATIC int spfs_file_find(spfs_t *fs, const char *name, pix_t *dpix, spfs_pixhdr_t *pixhdr) {
   dbg("name:\"%s\"\n", name);
   spfs_assert(pixhdr);
+#if SPFS_CFG_NAME_BLOOM
+  if (!_bloom_test(fs, _namehash_calc(name))) {
+    dbg("name:\"%s\" not in bloom filter\n", name);
+    return -SPFS_ERR_FILE_NOT_FOUND;
+  }
+#endif
+#if SPFS_CFG_NAME_HASH
+  if (fs->run.namehash) {
+    pix_t hdpix;
+    int res = _file_find_hashed(fs, name, &hdpix, pixhdr);
+    if (res == SPFS_OK) {
+      if (dpix) *dpix = hdpix;
+      return SPFS_OK;
+    }
+    if (res != -SPFS_ERR_FILE_NOT_FOUND || !fs->run.namehash_partial) ERR(res);
+  }
+#endif
+#if SPFS_CFG_DIR_SLOTS
+  if (fs->run.dir_id) {
+    pix_t ddpix;
+    int res = _dir_find(fs, name, &ddpix, pixhdr);
+    ERR(res);
+    if (dpix) *dpix = ddpix;
+    return SPFS_OK;
+  }
+#endif
   _file_find_varg_t arg = {.name = name, .pixhdr = pixhdr};
-  int res = spfs_page_visit(fs, fs->run.dpix_find_cursor, fs->run.dpix_find_cursor, &arg,
-                   _file_find_v, 0);
+  spfs_vis_desc_t desc = {.v = _file_find_v, .varg = &arg, .flags = SPFS_VIS_FL_IX,
+                          .vblk = spfs_vis_blk_skip_unused};
+  int res = spfs_page_visit_desc(fs, fs->run.dpix_find_cursor, fs->run.dpix_find_cursor, &desc);
   if (res == -SPFS_ERR_VIS_END) res = -SPFS_ERR_FILE_NOT_FOUND;
   ERR(res);
   fs->run.dpix_find_cursor = arg.dpix;
@@ -349,6 +873,73 @@ _SPFS_STATIC int spfs_file_find(spfs_t *fs, const char *name, pix_t *dpix, spfs_
 
 
 
+// Looks up file by name like spfs_file_find. If not found,
+// -SPFS_ERR_FILE_NOT_FOUND is returned and a free id and free page for
+// creating the file are given in id and free_dpix. The lookup, id search and
+// free page search are made in one traversal.
+_SPFS_STATIC int spfs_file_find_creat(spfs_t *fs, const char *name, pix_t *dpix,
+                                      spfs_pixhdr_t *pixhdr, id_t *id, pix_t *free_dpix) {
+  dbg("name:\"%s\"\n", name);
+  spfs_assert(pixhdr);
+  int res;
+#if SPFS_CFG_NAME_BLOOM
+  if (!_bloom_test(fs, _namehash_calc(name))) {
+    // name surely not present, only need free id and page
+    res = _id_page_find_free(fs, id, free_dpix, NULL, 0);
+    ERR(res);
+    dbg("name:\"%s\" not in bloom filter, free id:"_SPIPRIid" dpix:"_SPIPRIpg"\n", name, *id, *free_dpix);
+    return -SPFS_ERR_FILE_NOT_FOUND;
+  }
+#endif
+#if SPFS_CFG_NAME_HASH
+  if (fs->run.namehash) {
+    pix_t hdpix;
+    res = _file_find_hashed(fs, name, &hdpix, pixhdr);
+    if (res == SPFS_OK) {
+      if (dpix) *dpix = hdpix;
+      return SPFS_OK;
+    }
+    if (res != -SPFS_ERR_FILE_NOT_FOUND) ERR(res);
+    if (!fs->run.namehash_partial) {
+      // name surely not present, only need free id and page
+      res = _id_page_find_free(fs, id, free_dpix, NULL, 0);
+      ERR(res);
+      dbg("name:\"%s\" not found, free id:"_SPIPRIid" dpix:"_SPIPRIpg"\n", name, *id, *free_dpix);
+      return -SPFS_ERR_FILE_NOT_FOUND;
+    }
+  }
+#endif
+#if SPFS_CFG_DIR_SLOTS
+  if (fs->run.dir_id) {
+    pix_t ddpix;
+    res = _dir_find(fs, name, &ddpix, pixhdr);
+    if (res == SPFS_OK) {
+      if (dpix) *dpix = ddpix;
+      return SPFS_OK;
+    }
+    if (res != -SPFS_ERR_FILE_NOT_FOUND) ERR(res);
+    res = _id_page_find_free(fs, id, free_dpix, NULL, 0);
+    ERR(res);
+    dbg("name:\"%s\" not found, free id:"_SPIPRIid" dpix:"_SPIPRIpg"\n", name, *id, *free_dpix);
+    return -SPFS_ERR_FILE_NOT_FOUND;
+  }
+#endif
+  _file_find_varg_t arg = {.name = name, .pixhdr = pixhdr};
+  spfs_vis_desc_t desc = {.v = _file_find_v, .varg = &arg, .flags = SPFS_VIS_FL_IX,
+                          .vblk = spfs_vis_blk_skip_unused};
+  spfs_vis_desc_t *descs[1] = {&desc};
+  res = _id_page_find_free(fs, id, free_dpix, descs, 1);
+  if (res != SPFS_VIS_STOP) {
+    ERR(res);
+    dbg("name:\"%s\" not found, free id:"_SPIPRIid" dpix:"_SPIPRIpg"\n", name, *id, *free_dpix);
+    return -SPFS_ERR_FILE_NOT_FOUND;
+  }
+  fs->run.dpix_find_cursor = arg.dpix;
+  if (dpix) *dpix = arg.dpix;
+  dbg("name:\"%s\" found dpix:"_SPIPRIpg " id:"_SPIPRIid" sz:"_SPIPRIi" type:"_SPIPRIi"\n",
+      name, arg.dpix, pixhdr->phdr.id, pixhdr->fi.size, pixhdr->fi.type);
+  ERRET(SPFS_OK);
+}
 
 _SPFS_STATIC int spfs_file_visit(spfs_t *fs,
                                  spfs_fi_t *fi, pix_t dpix_ixhdr,
@@ -358,6 +949,10 @@ _SPFS_STATIC int spfs_file_visit(spfs_t *fs,
                                  spfs_file_visitor_t v, spfs_file_ix_visitor_t vix,
                                  uint32_t v_flags) {
   int res = SPFS_OK;
+  uint32_t end = offset + len;
+  // number of bytes to visit from the start of a rotating file ring once end is
+  // reached
+  uint32_t wrap_len = 0;
 
   // check if this is a fixed file, cap it if so
   if (fi->type == SPFS_PIXHDR_TY_FIXFILE) {
@@ -366,22 +961,28 @@ _SPFS_STATIC int spfs_file_visit(spfs_t *fs,
     }
     if (offset + len > fi->x_size) {
       len = fi->x_size - offset;
+      end = offset + len;
       dbg("fixed file, capping length to "_SPIPRIi"\n", len);
     }
   }
-//  // check if this is a rotating file, adjust offset if so
-//  else if (fi->type == SPFS_PIXHDR_TY_ROTFILE) { // TODO
-//    if (fi->size > fi->x_size) {
-//      // rotating file is filled, adjust offset
-//      offset += fi->size - fi->x_size;
-//    }
-//  }
+  // check if this is a rotating file, offsets are relative to its head and
+  // wrap at the end of its ring if so
+  else if (fi->type == SPFS_PIXHDR_TY_ROTFILE) {
+    offset += SPFS_FI_ROT_HEAD(fi);
+    if (offset >= fi->x_size) offset -= fi->x_size;
+    end = offset + len;
+    if (end > fi->x_size) {
+      wrap_len = end - fi->x_size;
+      end = fi->x_size;
+      dbg("rotating file, wrapping "_SPIPRIi" bytes\n", wrap_len);
+    }
+  }
 
   spfs_file_vis_info_t info =
     {.offset = offset, .ixspix = -1, .fi = fi,
      .dpix_ix = -1, .dpix_ixhdr = dpix_ixhdr, .v_flags = v_flags};
 
-  while (info.offset < offset+len) {
+  while (info.offset < end) {
     if (SPFS_OFFS2IXSPIX(fs, info.offset) != info.ixspix) {
       // need to load a new index page
       if (vix) res = vix(fs, 0, res, &info, varg);
@@ -403,7 +1004,7 @@ _SPFS_STATIC int spfs_file_visit(spfs_t *fs,
       } else {
         dbg("reading index id:"_SPIPRIid" spix:"_SPIPRIid"\n", info.fi->id, info.ixspix);
         info.ix_constructed = 0;
-        res = spfs_page_find(fs, fi->id, info.ixspix, SPFS_PAGE_FIND_FL_IX, &info.dpix_ix);
+        res = _ix_find(fs, fi->id, info.ixspix, info.dpix_ixhdr, &info.dpix_ix);
         ERRGO(res);
         uint32_t addr = SPFS_DPIX2ADDR(fs, info.dpix_ix);
         res = _medium_read(fs, addr, fs->run.work2, SPFS_CFG_LPAGE_SZ(fs), SPFS_T_META);
@@ -419,11 +1020,16 @@ _SPFS_STATIC int spfs_file_visit(spfs_t *fs,
     pix_t dpix = barr8_get(&info.ixarr, info.ixent);
     spfs_assert(create_memory_ix || dpix < (pix_t)SPFS_DPAGES_MAX(fs));
     uint32_t dlen = SPFS_DPAGE_SZ(fs) - (info.offset % SPFS_DPAGE_SZ(fs));
-    info.len = spfs_min(offset+len-info.offset, dlen);
+    info.len = spfs_min(end-info.offset, dlen);
     // callback
     if (v) res = v(fs, dpix, &info, varg);
     ERRGO(res);
     info.offset += info.len;
+    if (info.offset == end && wrap_len) {
+      info.offset = 0;
+      end = wrap_len;
+      wrap_len = 0;
+    }
   }
   err:
   info.len = 0;
@@ -438,23 +1044,88 @@ _SPFS_STATIC int spfs_file_visit(spfs_t *fs,
 }
 
 typedef struct {
-  uint8_t *dst;
+  // buffers to read to
+  const struct spfs_iov *iov;
+  // current buffer
+  uint32_t iov_ix;
+  // offset in current buffer
+  uint32_t iov_offs;
   uint32_t bytes_written;
+#if SPFS_CFG_HAL_READ_AHEAD
+  // total number of bytes to read
+  uint32_t len;
+  // set if reading sequentially, reading ahead beyond what is read
+  uint8_t ra_seq;
+#endif
 } _file_read_varg_t;
+#if SPFS_CFG_HAL_READ_AHEAD
+// reads given data page and the pages following it in the file, as long as they
+// also follow it physically within its block, in one call. Reads at most given
+// number of pages, and nothing if the page is already read ahead.
+static int _file_read_ahead(spfs_t *fs, pix_t dpix, spfs_file_vis_info_t *info, uint32_t max) {
+  pix_t lpix = _dpix2lpix(fs, dpix);
+  if (_medium_ra_hit(fs, lpix)) return SPFS_OK;
+  // not beyond buffer, file end, current index page or block
+  uint32_t spix = SPFS_OFFS2SPIX(fs, info->offset);
+  max = spfs_min(max, fs->run.ra.max);
+  max = spfs_min(max, (info->fi->size - 1) / SPFS_DPAGE_SZ(fs) - spix + 1);
+  max = spfs_min(max, SPFS_IX_ENT_CNT(fs, info->ixspix) - info->ixent);
+  max = spfs_min(max, SPFS_DPAGES_P_BLK(fs) - SPFS_DPIX2DBLKPIX(fs, dpix));
+  uint32_t cnt = 1;
+  while (cnt < max && barr8_get(&info->ixarr, info->ixent + cnt) == dpix + cnt) cnt++;
+  if (cnt < 2) return SPFS_OK;
+  int res = _medium_read_ahead(fs, lpix, cnt, SPFS_T_DATA);
+  ERRET(res);
+}
+#endif
 static int _file_read_v(spfs_t *fs, pix_t dpix, spfs_file_vis_info_t *info, void *varg) {
-  int res;
+  int res = SPFS_OK;
   dbg("read dpix:"_SPIPRIpg"\n", dpix);
   _file_read_varg_t *arg = (_file_read_varg_t *)varg;
+#if SPFS_CFG_HAL_READ_AHEAD
+  if (fs->run.ra.max && fs->cfg.read_pages) {
+    uint32_t ra_pages = arg->ra_seq ? fs->run.ra.max
+        : spfs_ceil(info->offset % SPFS_DPAGE_SZ(fs) + arg->len - arg->bytes_written,
+                    SPFS_DPAGE_SZ(fs));
+    if (ra_pages > 1) {
+      res = _file_read_ahead(fs, dpix, info, ra_pages);
+      ERR(res);
+    }
+  }
+#endif
   uint32_t addr = SPFS_DPIX2ADDR(fs, dpix) + (info->offset % SPFS_DPAGE_SZ(fs));
-  res = _medium_read(fs, addr, arg->dst, info->len, SPFS_T_DATA);
-  ERR(res);
-  arg->dst += info->len;
-  arg->bytes_written += info->len;
+  uint32_t len = info->len;
+  // one read per buffer the page data ends up in
+  while (len) {
+    const struct spfs_iov *iov = &arg->iov[arg->iov_ix];
+    uint32_t plen = spfs_min(len, iov->iov_len - arg->iov_offs);
+    if (plen) {
+      res = _medium_read(fs, addr, (uint8_t *)iov->iov_base + arg->iov_offs, plen, SPFS_T_DATA);
+      ERR(res);
+    }
+    addr += plen;
+    len -= plen;
+    arg->iov_offs += plen;
+    arg->bytes_written += plen;
+    if (arg->iov_offs == iov->iov_len) {
+      arg->iov_ix++;
+      arg->iov_offs = 0;
+    }
+  }
   ERRET(res);
 }
 _SPFS_STATIC int spfs_file_read(spfs_t *fs, spfs_fd_t *fd, uint32_t offs, uint32_t len, uint8_t *dst) {
+  struct spfs_iov iov = {.iov_base = dst, .iov_len = len};
+  return spfs_file_readv(fs, fd, offs, &iov, len);
+}
+_SPFS_STATIC int spfs_file_readv(spfs_t *fs, spfs_fd_t *fd, uint32_t offs,
+                                 const struct spfs_iov *iov, uint32_t len) {
   int res = SPFS_OK;
-  _file_read_varg_t arg = {.dst = dst, .bytes_written = 0};
+  _file_read_varg_t arg = {.iov = iov, .iov_ix = 0, .iov_offs = 0, .bytes_written = 0};
+#if SPFS_CFG_HAL_READ_AHEAD
+  arg.len = len;
+  arg.ra_seq = offs == fd->ra_offset;
+#endif
   uint32_t offs_ixdpix = SPFS_OFFS2IXSPIX(fs, offs);
 
   if (offs_ixdpix == SPFS_OFFS2IXSPIX(fs, fd->offset) || offs_ixdpix == 0) {
@@ -465,6 +1136,9 @@ _SPFS_STATIC int spfs_file_read(spfs_t *fs, spfs_fd_t *fd, uint32_t offs, uint32
                         _file_read_v, NULL, fd->fd_oflags);
 
   fd->offset = offs + arg.bytes_written;
+#if SPFS_CFG_HAL_READ_AHEAD
+  fd->ra_offset = fd->offset;
+#endif
 
   ERR(res);
 
@@ -472,6 +1146,51 @@ _SPFS_STATIC int spfs_file_read(spfs_t *fs, spfs_fd_t *fd, uint32_t offs, uint32
   return res;
 }
 
+#if SPFS_CFG_HAL_MAP
+typedef struct {
+  spfs_zc_seg_t *segs;
+  uint32_t seg_cnt;
+  uint32_t bytes_mapped;
+} _file_read_zc_varg_t;
+static int _file_read_zc_v(spfs_t *fs, pix_t dpix, spfs_file_vis_info_t *info, void *varg) {
+  dbg("map dpix:"_SPIPRIpg"\n", dpix);
+  _file_read_zc_varg_t *arg = (_file_read_zc_varg_t *)varg;
+  uint32_t addr = SPFS_DPIX2ADDR(fs, dpix) + (info->offset % SPFS_DPAGE_SZ(fs));
+  const uint8_t *data = fs->cfg.map ? fs->cfg.map(fs, addr, info->len) : NULL;
+  if (data == NULL) ERR(-SPFS_ERR_NOT_MAPPED);
+  arg->segs[arg->seg_cnt].data = data;
+  arg->segs[arg->seg_cnt].len = info->len;
+  arg->seg_cnt++;
+  arg->bytes_mapped += info->len;
+  return SPFS_OK;
+}
+_SPFS_STATIC int spfs_file_read_zc(spfs_t *fs, spfs_fd_t *fd, uint32_t offs, uint32_t len,
+                                   spfs_zc_seg_t *segs, uint32_t seg_cnt) {
+  int res = SPFS_OK;
+  if (seg_cnt == 0) return 0;
+  // each data page is a segment of its own, cap to what fits
+  uint32_t max_len = SPFS_DPAGE_SZ(fs) - (offs % SPFS_DPAGE_SZ(fs))
+      + (seg_cnt - 1) * SPFS_DPAGE_SZ(fs);
+  len = spfs_min(len, max_len);
+  _file_read_zc_varg_t arg = {.segs = segs, .seg_cnt = 0, .bytes_mapped = 0};
+  uint32_t offs_ixdpix = SPFS_OFFS2IXSPIX(fs, offs);
+
+  if (offs_ixdpix == SPFS_OFFS2IXSPIX(fs, fd->offset) || offs_ixdpix == 0) {
+    // prime the index page search to start at known ix_dpix, if known that is
+    fs->run.dpix_find_cursor = offs_ixdpix ? fd->dpix_ix : fd->dpix_ixhdr;
+  }
+  res = spfs_file_visit(fs, &fd->fi, fd->dpix_ixhdr, offs, len, 0, &arg,
+                        _file_read_zc_v, NULL, fd->fd_oflags);
+
+  fd->offset = offs + arg.bytes_mapped;
+
+  ERR(res);
+
+  res = arg.seg_cnt;
+  return res;
+}
+#endif
+
 
 #define SPFS_FWR_IXDIRTY_NO       (0)
 #define SPFS_FWR_IXDIRTY_REWRITE  (1)
@@ -479,13 +1198,99 @@ _SPFS_STATIC int spfs_file_read(spfs_t *fs, spfs_fd_t *fd, uint32_t offs, uint32
 #define SPFS_FWR_IXDIRTY_NEW      (4)
 
 typedef struct {
-  // data to write
-  const uint8_t *src;
+  // buffers to write from, or NULL to leave the written range erased
+  const struct spfs_iov *iov;
+  // current buffer
+  uint32_t iov_ix;
+  // offset in current buffer
+  uint32_t iov_offs;
   // number of bytes currently written to medium
   uint32_t bytes_written;
   // dirty state of index in work memory 2
   uint8_t ixdirty;
 } _file_write_varg_t;
+// returns length of next chunk of source data, at most len
+static uint32_t _file_write_src_chunk(_file_write_varg_t *arg, uint32_t len, const uint8_t **src) {
+  if (arg->iov == NULL) {
+    // no source, all 0xff
+    *src = NULL;
+    return len;
+  }
+  const struct spfs_iov *iov = &arg->iov[arg->iov_ix];
+  uint32_t plen = spfs_min(len, iov->iov_len - arg->iov_offs);
+  *src = (const uint8_t *)iov->iov_base + arg->iov_offs;
+  arg->iov_offs += plen;
+  if (arg->iov_offs == iov->iov_len) {
+    arg->iov_ix++;
+    arg->iov_offs = 0;
+  }
+  return plen;
+}
+// copies next len bytes of source data to memory
+static void _file_write_src_cpy(_file_write_varg_t *arg, uint8_t *dst, uint32_t len) {
+  while (len) {
+    const uint8_t *src;
+    uint32_t plen = _file_write_src_chunk(arg, len, &src);
+    if (src) spfs_memcpy(dst, src, plen);
+    else     spfs_memset(dst, 0xff, plen);
+    dst += plen;
+    len -= plen;
+  }
+}
+// writes next len bytes of source data to medium, one write per source buffer
+static int _file_write_src_medium(spfs_t *fs, _file_write_varg_t *arg, uint32_t addr,
+                                  uint32_t len, uint32_t wr_flags, uint8_t queue) {
+  int res = SPFS_OK;
+  (void)queue;
+  while (len) {
+    const uint8_t *src;
+    uint32_t plen = _file_write_src_chunk(arg, len, &src);
+    // 0xff leaves erased or and:ed bytes as they are
+    if (plen && src) {
+#if SPFS_CFG_HAL_WRITEV
+      if (queue) res = _medium_write_q(fs, addr, src, plen, wr_flags, 0);
+      else
+#endif
+      res = _medium_write(fs, addr, src, plen, wr_flags);
+      ERR(res);
+    }
+    addr += plen;
+    len -= plen;
+  }
+  ERRET(res);
+}
+// checks if the next len bytes of source data only clear bits of the data on
+// medium at addr, so they can be written in place. Source is not consumed.
+static int _file_write_src_clears(spfs_t *fs, const _file_write_varg_t *arg, uint32_t addr,
+                                  uint32_t len) {
+  _file_write_varg_t peek = *arg;
+  uint8_t buf[SPFS_CFG_COPY_BUF_SZ];
+  while (len) {
+    uint32_t rlen = spfs_min(len, SPFS_CFG_COPY_BUF_SZ);
+    int res = _medium_read(fs, addr, buf, rlen, SPFS_T_DATA);
+    ERR(res);
+    uint32_t i = 0;
+    while (i < rlen) {
+      const uint8_t *src;
+      uint32_t plen = _file_write_src_chunk(&peek, rlen - i, &src);
+      uint32_t j;
+      for (j = 0; j < plen; j++) {
+        if ((src ? src[j] : 0xff) & ~buf[i + j]) return 0;
+      }
+      i += plen;
+    }
+    addr += rlen;
+    len -= rlen;
+  }
+  return 1;
+}
+// returns size of given rotating file info once given number of bytes more
+// are written to it
+static uint32_t _file_rot_size(const spfs_fi_t *fi, uint32_t len) {
+  uint32_t size = fi->size == SPFS_FILESZ_UNDEF ? 0 : fi->size;
+  if (size < fi->x_size && len <= fi->x_size - size) return size + len;
+  return fi->x_size + (size % fi->x_size + len % fi->x_size) % fi->x_size;
+}
 /**
  *  Visited each time a new index page is about to be loaded.
  *  The current (modified by _file_write_v) index is in work2 buffer.
@@ -512,6 +1317,11 @@ static int _file_write_vix(spfs_t *fs, uint8_t final, int respre,
   // Also, one/both pages may simply be updated or must be fully rewritten.
 
   int res = SPFS_OK;
+#if SPFS_CFG_HAL_WRITEV
+  // data pages must be on medium before any index referring to them
+  res = _medium_wrq_flush(fs);
+  ERR(res);
+#endif
   // current filesize as in persisted data pages - not yet in index
   uint32_t data_filesz = info->offset;
   // if the memory image also is the index header
@@ -520,6 +1330,12 @@ static int _file_write_vix(spfs_t *fs, uint8_t final, int respre,
   uint8_t ixhdr_sz_update =
       (info->fi->size != SPFS_FILESZ_UNDEF && info->fi->size < data_filesz)
       || info->fi->size == SPFS_FILESZ_UNDEF;
+  if (info->fi->type == SPFS_PIXHDR_TY_ROTFILE) {
+    // rotating files are written within their ring, the size following what
+    // is written is set once all is written
+    data_filesz = _file_rot_size(info->fi, arg->bytes_written);
+    ixhdr_sz_update = final && info->fi->size != data_filesz;
+  }
 
   //
   // first write the stuff from memory - this might also be the ix hdr
@@ -531,8 +1347,18 @@ static int _file_write_vix(spfs_t *fs, uint8_t final, int respre,
     dbg("ix update, mem is also ix hdr\n");
     spfs_assert(arg->ixdirty != SPFS_FWR_IXDIRTY_NEW);
     if (ixhdr_sz_update) {
-      if (info->fi->size != SPFS_FILESZ_UNDEF) arg->ixdirty = SPFS_FWR_IXDIRTY_REPLACE;
-      _pixhdr_wrmem_sz(fs, fs->run.work2 + SPFS_DPIXHDROFFS(fs), data_filesz);
+#if SPFS_CFG_IXHDR_SZ_LOG
+      if (info->fi->size != SPFS_FILESZ_UNDEF && arg->ixdirty != SPFS_FWR_IXDIRTY_REPLACE
+          && _pixhdr_logmem_sz(fs, fs->run.work2 + SPFS_DPIXHDROFFS(fs), data_filesz) >= 0) {
+        // size record appended, rewrite
+        dbg("ix update, size record "_SPIPRIi"\n", data_filesz);
+        arg->ixdirty = SPFS_FWR_IXDIRTY_REWRITE;
+      } else
+#endif
+      {
+        if (info->fi->size != SPFS_FILESZ_UNDEF) arg->ixdirty = SPFS_FWR_IXDIRTY_REPLACE;
+        _pixhdr_wrmem_sz(fs, fs->run.work2 + SPFS_DPIXHDROFFS(fs), data_filesz);
+      }
     }
   }
 
@@ -544,12 +1370,24 @@ static int _file_write_vix(spfs_t *fs, uint8_t final, int respre,
     res = _page_allocate_free(fs, &new_dpix_ix, info->fi->id, SPFS_LU_FL_INDEX);
     ERR(res);
     // TODO do we need to mark the old first that it is about to be deleted?
+#if SPFS_CFG_IX_ROOT
+    if (ixhdr_in_mem) {
+      _ix_root_refresh(fs, fs->run.work2 + SPFS_DPIXHDROFFS(fs) + SPFS_PIXHDR_IX_ROOT_OFFS,
+                       SPFS_FILESZ_UNDEF);
+    }
+#endif
 
     // write updated index page
     dbg("ix update, new ix, dpix:"_SPIPRIpg", from mem\n", new_dpix_ix);
     res = _medium_write(fs, SPFS_DPIX2ADDR(fs, new_dpix_ix),
                         fs->run.work2, SPFS_CFG_LPAGE_SZ(fs), SPFS_T_META | SPFS_C_UP);
     ERR(res);
+#if SPFS_CFG_IX_ROOT
+    // record the new page, or mark the root stale, before the old page is
+    // deleted so the root never refers to a deleted page
+    res = _ix_root_set(fs, info->dpix_ixhdr, info->ixspix, new_dpix_ix);
+    ERR(res);
+#endif
     if (arg->ixdirty != SPFS_FWR_IXDIRTY_NEW) {
       // have an old existing index page, delete it
       dbg("ix update, deleting old ix dpix:"_SPIPRIpg"\n", info->dpix_ix);
@@ -570,12 +1408,26 @@ static int _file_write_vix(spfs_t *fs, uint8_t final, int respre,
                         fs->run.work2, SPFS_CFG_LPAGE_SZ(fs),
                         SPFS_T_META | SPFS_C_UP | _SPFS_HAL_WR_FL_OVERWRITE);
     ERR(res);
+#if SPFS_CFG_IX_ROOT
+    res = _ix_root_set(fs, info->dpix_ixhdr, info->ixspix, info->dpix_ix);
+    ERR(res);
+#endif
   }
 
   //
   // then, see if we need to update the index header
   //
+  uint8_t ixhdr_sz_logged = 0;
+#if SPFS_CFG_IXHDR_SZ_LOG
   if (!ixhdr_in_mem && ixhdr_sz_update) {
+    // try appending a size record to the index header instead of replacing it
+    res = _ixhdr_log_sz(fs, info->dpix_ixhdr, data_filesz);
+    ERR(res < 0 ? res : SPFS_OK);
+    ixhdr_sz_logged = res;
+    res = SPFS_OK;
+  }
+#endif
+  if (!ixhdr_in_mem && ixhdr_sz_update && !ixhdr_sz_logged) {
     // here, the index header must be updated to the new size - and it is not in memory
     dbg("ixhdr update, size:"_SPIPRIi", dpix:"_SPIPRIpg"\n", data_filesz, info->dpix_ixhdr);
     pix_t new_dpix_ixhdr;
@@ -640,9 +1492,9 @@ static int _file_write_v(spfs_t *fs, pix_t dpix,
     // *** this is a rewrite of existing page
 
     dbg("rewriting existing page\n");
-    res = _medium_write(fs, SPFS_DPIX2ADDR(fs, dpix) + page_offset,
-        arg->src, info->len,
-        SPFS_T_DATA | SPFS_C_UP | _SPFS_HAL_WR_FL_OVERWRITE | _SPFS_HAL_WR_FL_IGNORE_BITS);
+    res = _file_write_src_medium(fs, arg, SPFS_DPIX2ADDR(fs, dpix) + page_offset,
+        info->len,
+        SPFS_T_DATA | SPFS_C_UP | _SPFS_HAL_WR_FL_OVERWRITE | _SPFS_HAL_WR_FL_IGNORE_BITS, 0);
     ERR(res);
 #if SPFS_CFG_SENSITIVE_DATA
     if (info->v_flags & SPFS_O_SENS) {
@@ -659,24 +1511,63 @@ static int _file_write_v(spfs_t *fs, pix_t dpix,
     dbg("appending new page\n");
     res = _page_allocate_free(fs, &new_dpix_ixentry, info->fi->id, SPFS_LU_FL_DATA);
     ERR(res);
-    // create new page with data
-    spfs_memset(work, 0xff, SPFS_CFG_LPAGE_SZ(fs));
-    _phdr_wrmem(fs, work + SPFS_DPHDROFFS(fs), &phdr);
-    spfs_memcpy(work + page_offset, arg->src, info->len);
-    // and write it
-    res = _medium_write(fs, SPFS_DPIX2ADDR(fs, new_dpix_ixentry), work,
-              SPFS_CFG_LPAGE_SZ(fs), SPFS_T_DATA | SPFS_C_UP);
-    ERR(res);
+#if SPFS_CFG_HAL_WRITEV
+    if (fs->run.wrq.gather) {
+      // queue data straight from source and a copy of the page header, the
+      // rest of the free page is already 0xff
+      uint8_t phdr_mem[SPFS_PHDR_MAX_SZ];
+      spfs_memset(phdr_mem, 0xff, sizeof(phdr_mem));
+      _phdr_wrmem(fs, phdr_mem, &phdr);
+      res = _file_write_src_medium(fs, arg, SPFS_DPIX2ADDR(fs, new_dpix_ixentry) + page_offset,
+                                   info->len, SPFS_T_DATA | SPFS_C_UP, 1);
+      ERR(res);
+      res = _medium_write_q(fs, SPFS_DPIX2ADDR(fs, new_dpix_ixentry) + SPFS_DPHDROFFS(fs),
+                            phdr_mem, SPFS_PHDR_SZ(fs), SPFS_T_DATA | SPFS_C_UP, 1);
+      ERR(res);
+    } else
+#endif
+    {
+      // create new page with data
+      spfs_memset(work, 0xff, SPFS_CFG_LPAGE_SZ(fs));
+      _phdr_wrmem(fs, work + SPFS_DPHDROFFS(fs), &phdr);
+      _file_write_src_cpy(arg, work + page_offset, info->len);
+      // and write it
+      res = _medium_write(fs, SPFS_DPIX2ADDR(fs, new_dpix_ixentry), work,
+                SPFS_CFG_LPAGE_SZ(fs), SPFS_T_DATA | SPFS_C_UP);
+      ERR(res);
+    }
     ixdirty = SPFS_FWR_IXDIRTY_REWRITE; // as the existing index entry is 0xff.., we can just rewrite it
 
   } else {
 
     // *** this represents either rewriting end of an existing data page filled
-    //     with 0xff (no new data page needed, no index header update), or
+    //     with 0xff (no new data page needed, no index header update),
+    //     rewriting a fixed file page in place, or
     //     updating an existing datapage with data overwriting the previous
 
     uint8_t new_datapage = 1;
-    if (info->len == SPFS_DPAGE_SZ(fs)) {
+    uint8_t in_place = 0;
+    if (info->fi->type == SPFS_PIXHDR_TY_FIXFILE) {
+      // fixed files are rewritten in place where only bits are cleared, so
+      // preallocated fixed files are written without allocating pages
+      res = _file_write_src_clears(fs, arg, SPFS_DPIX2ADDR(fs, dpix) + page_offset, info->len);
+      ERR(res < 0 ? res : SPFS_OK);
+      in_place = res;
+      res = SPFS_OK;
+    }
+    if (in_place) {
+      dbg("rewriting fixed file page in place\n");
+      res = _file_write_src_medium(fs, arg, SPFS_DPIX2ADDR(fs, dpix) + page_offset,
+          info->len, SPFS_T_DATA | SPFS_C_UP | _SPFS_HAL_WR_FL_OVERWRITE, 0);
+      ERR(res);
+#if SPFS_CFG_SENSITIVE_DATA
+      if (info->v_flags & SPFS_O_SENS) {
+        res = spfs_page_hdr_write(fs, dpix, &phdr, SPFS_C_UP | _SPFS_HAL_WR_FL_OVERWRITE);
+        ERR(res);
+      }
+#endif
+      new_datapage = 0;
+    } else if (info->len == SPFS_DPAGE_SZ(fs)) {
       // update existing full page, no need to merge with existing
       dbg("overwriting full page\n");
       spfs_assert(page_offset == 0);
@@ -684,14 +1575,14 @@ static int _file_write_v(spfs_t *fs, pix_t dpix,
       ERR(res);
       spfs_memset(work, 0xff, SPFS_CFG_LPAGE_SZ(fs));
       _phdr_wrmem(fs, work + SPFS_DPHDROFFS(fs), &phdr);
-      spfs_memcpy(work, arg->src, info->len);
+      _file_write_src_cpy(arg, work, info->len);
     } else {
       // partial rewrite of page, either at end (the 0xffs) or amidst existing data
       if (info->fi->size == SPFS_FILESZ_UNDEF || info->offset >= info->fi->size) {
         // .. just at the end of page where no data is yet written -> simply rewrite
         dbg("appending existing page\n");
-        res = _medium_write(fs, SPFS_DPIX2ADDR(fs, dpix) + page_offset,
-            arg->src, info->len, SPFS_T_DATA | SPFS_C_UP);
+        res = _file_write_src_medium(fs, arg, SPFS_DPIX2ADDR(fs, dpix) + page_offset,
+            info->len, SPFS_T_DATA | SPFS_C_UP, 0);
         ERR(res);
 #if SPFS_CFG_SENSITIVE_DATA
         if (info->v_flags & SPFS_O_SENS  ) {
@@ -717,7 +1608,7 @@ static int _file_write_v(spfs_t *fs, pix_t dpix,
         _phdr_wrmem(fs, work + SPFS_DPHDROFFS(fs), &phdr);
 #endif
         // overwrite with new data
-        spfs_memcpy(work + page_offset, arg->src, info->len);
+        _file_write_src_cpy(arg, work + page_offset, info->len);
       }
     }
 
@@ -747,14 +1638,17 @@ static int _file_write_v(spfs_t *fs, pix_t dpix,
 
   // update index dirty status
   arg->ixdirty |= ixdirty;
-  // advance counters
-  arg->src += info->len;
-  arg->bytes_written += info->len;
   // update entry in memory index page
   barr8_set(&info->ixarr, info->ixent, new_dpix_ixentry);
+  arg->bytes_written += info->len;
   ERRET(res);
 }
 _SPFS_STATIC int spfs_file_write(spfs_t *fs, spfs_fd_t *fd, uint32_t offs, uint32_t len, const uint8_t *src) {
+  struct spfs_iov iov = {.iov_base = (void *)(intptr_t)src, .iov_len = len};
+  return spfs_file_writev(fs, fd, offs, &iov, len);
+}
+_SPFS_STATIC int spfs_file_writev(spfs_t *fs, spfs_fd_t *fd, uint32_t offs,
+                                  const struct spfs_iov *iov, uint32_t len) {
   int res = SPFS_OK;
   pix_t offs_ixdpix = SPFS_OFFS2IXSPIX(fs, offs);
 
@@ -764,32 +1658,56 @@ _SPFS_STATIC int spfs_file_write(spfs_t *fs, spfs_fd_t *fd, uint32_t offs, uint3
     fs->run.dpix_find_cursor = offs_ixdpix ? fd->dpix_ix : fd->dpix_ixhdr;
   }
 
-//  if (fd->fi.type == SPFS_PIXHDR_TY_ROTFILE) {
-//    if (len > fd->fi.x_size) {
-//      // ignore data that will be overwritten by rotation
-//      src += len - fd->fi.x_size;
-//      len = fd->fi.x_size;
-//    }
-//  }
-
   // check if this is a rewrite, cap it if needed or error
+  uint32_t size = SPFS_FI_SIZE(&fd->fi);
   if (fd->fd_oflags & SPFS_O_REWR) {
-    if (fd->fi.size == SPFS_FILESZ_UNDEF || offs >= fd->fi.size) {
+    if (size == SPFS_FILESZ_UNDEF || offs >= size) {
       ERR(-SPFS_ERR_EOF);
     }
-    if (offs + len > fd->fi.size) {
-      len = fd->fi.size - offs;
+    if (offs + len > size) {
+      len = size - offs;
       dbg("rewrite, capping length to "_SPIPRIi"\n", len);
     }
   }
 
   dbg("write id:"_SPIPRIid", size "_SPIPRIi", @ offset "_SPIPRIi", "_SPIPRIi" bytes\n",
       fd->fi.id, fd->fi.size, offs, len);
-  _file_write_varg_t arg = {.src = src, .bytes_written = 0};
-  res = spfs_file_visit(fs, &fd->fi, fd->dpix_ixhdr, offs, len, 1, &arg,
+  _file_write_varg_t arg = {.iov = iov, .iov_ix = 0, .iov_offs = 0, .bytes_written = 0};
+
+  uint32_t skip = 0;
+  if (fd->fi.type == SPFS_PIXHDR_TY_ROTFILE) {
+    // always appended, overwriting the oldest data once the ring is full
+    uint32_t held = size == SPFS_FILESZ_UNDEF ? 0 : size;
+    if (len > fd->fi.x_size) {
+      // ignore data that will be overwritten by rotation
+      skip = len - fd->fi.x_size;
+      dbg("rotating file, skipping "_SPIPRIi" bytes\n", skip);
+      uint32_t rem = skip;
+      while (rem) {
+        const uint8_t *src;
+        rem -= _file_write_src_chunk(&arg, rem, &src);
+      }
+      arg.bytes_written = skip;
+    }
+    // offset from the head where the written data starts
+    offs = (held + skip % fd->fi.x_size) % fd->fi.x_size;
+  }
+
+#if SPFS_CFG_HAL_WRITEV
+  uint8_t gather = _medium_wrq_begin(fs);
+#endif
+  res = spfs_file_visit(fs, &fd->fi, fd->dpix_ixhdr, offs, len - skip, 1, &arg,
                         _file_write_v, _file_write_vix, fd->fd_oflags);
+#if SPFS_CFG_HAL_WRITEV
+  int wrq_res = _medium_wrq_end(fs, gather);
+  if (res >= SPFS_OK) res = wrq_res;
+#endif
 
-  fd->offset = offs + arg.bytes_written;
+  if (fd->fi.type == SPFS_PIXHDR_TY_ROTFILE) {
+    fd->offset = fd->fi.size == SPFS_FILESZ_UNDEF ? 0 : SPFS_FI_SIZE(&fd->fi);
+  } else {
+    fd->offset = offs + arg.bytes_written;
+  }
 
   ERR(res);
 
@@ -797,6 +1715,13 @@ _SPFS_STATIC int spfs_file_write(spfs_t *fs, spfs_fd_t *fd, uint32_t offs, uint3
   return res;
 }
 
+// returns given file info, with a rotating file seen from the start of its ring
+// so each of its pages is visited once
+static spfs_fi_t _file_rot_flat(const spfs_fi_t *fi) {
+  spfs_fi_t flat = *fi;
+  if (flat.type == SPFS_PIXHDR_TY_ROTFILE) flat.size = SPFS_FI_SIZE(fi);
+  return flat;
+}
 static int _file_remove_vix(spfs_t *fs, uint8_t final, int respre,
                            spfs_file_vis_info_t *info, void *varg) {
   if (info->ixspix == (spix_t)-1) return SPFS_OK; // no ix loaded
@@ -819,16 +1744,32 @@ _SPFS_STATIC int spfs_file_fremove(spfs_t *fs, spfs_fd_t *fd) {
   int res;
   dbg("remove id:"_SPIPRIid", size "_SPIPRIi"\n", fd->fi.id, fd->fi.size);
   pix_t dpix_ixhdr = fd->dpix_ixhdr;
+#if SPFS_CFG_DIR_SLOTS
+  // need the name for clearing the directory slot
+  spfs_pixhdr_t pixhdr;
+  if (fs->run.dir_id) {
+    res = _page_ixhdr_read(fs, dpix_ixhdr, &pixhdr, 0);
+    ERR(res);
+  }
+#endif
   if (fd->fi.size != SPFS_FILESZ_UNDEF) {
-    res = spfs_file_visit(fs, &fd->fi, dpix_ixhdr, 0, fd->fi.size, 0, NULL,
+    spfs_fi_t fi = _file_rot_flat(&fd->fi);
+    res = spfs_file_visit(fs, &fi, dpix_ixhdr, 0, fi.size, 0, NULL,
                           _file_remove_v, _file_remove_vix, fd->fd_oflags);
     ERR(res);
   }
   dbg("delete index header dpix:"_SPIPRIpg"\n", dpix_ixhdr);
   res = _lu_page_delete(fs, dpix_ixhdr);
   ERR(res);
+  _id_mark(fs, fd->fi.id, 1);
   spfs_file_event_data_t evdata = {.remove={.spix = 0}};
   _inform(fs, SPFS_F_EV_REMOVE_IX, fd->fi.id, &evdata);
+#if SPFS_CFG_DIR_SLOTS
+  if (fs->run.dir_id) {
+    res = _dir_drop(fs, (char *)pixhdr.name, fd->fi.id);
+    ERR(res);
+  }
+#endif
 
   ERRET(res);
 }
@@ -838,15 +1779,23 @@ _SPFS_STATIC int spfs_file_remove(spfs_t *fs, const char *path) {
   int res = spfs_file_find(fs, path, &dpix_ixhdr, &pixhdr);
   ERR(res);
   if (pixhdr.fi.size != SPFS_FILESZ_UNDEF) {
-    res = spfs_file_visit(fs, &pixhdr.fi, dpix_ixhdr, 0, pixhdr.fi.size, 0, NULL,
+    spfs_fi_t fi = _file_rot_flat(&pixhdr.fi);
+    res = spfs_file_visit(fs, &fi, dpix_ixhdr, 0, fi.size, 0, NULL,
                           _file_remove_v, _file_remove_vix, 0);
     ERR(res);
   }
   dbg("delete index header dpix:"_SPIPRIpg"\n", dpix_ixhdr);
   res = _lu_page_delete(fs, dpix_ixhdr);
   ERR(res);
+  _id_mark(fs, pixhdr.fi.id, 1);
   spfs_file_event_data_t evdata = {.remove={.spix = 0}};
   _inform(fs, SPFS_F_EV_REMOVE_IX, pixhdr.fi.id, &evdata);
+#if SPFS_CFG_DIR_SLOTS
+  if (fs->run.dir_id) {
+    res = _dir_drop(fs, (char *)pixhdr.name, pixhdr.fi.id);
+    ERR(res);
+  }
+#endif
 
   ERRET(res);
 }
@@ -890,9 +1839,17 @@ static int _file_trunc_vix(spfs_t *fs, uint8_t final, int respre,
     // this is the ix header, set size also
     dbg("update index hdr, set size "_SPIPRIi"\n", arg->target_size);
     _pixhdr_wrmem_sz(fs, fs->run.work2 + SPFS_DPIXHDROFFS(fs), arg->target_size);
+#if SPFS_CFG_IX_ROOT
+    _ix_root_refresh(fs, fs->run.work2 + SPFS_DPIXHDROFFS(fs) + SPFS_PIXHDR_IX_ROOT_OFFS,
+                     arg->target_size);
+#endif
   }
   if (arg->ixaction == SPFS_FTR_IXDIRTY_DELETE) {
     dbg("delete index dpix:"_SPIPRIpg" spix:"_SPIPRIsp"\n", info->dpix_ix, info->ixspix);
+#if SPFS_CFG_IX_ROOT
+    res = _ix_root_set(fs, info->dpix_ixhdr, info->ixspix, (pix_t)-1);
+    ERR(res);
+#endif
     res = _lu_page_delete(fs, info->dpix_ix);
     ERR(res);
     spfs_file_event_data_t evdata = {.remove={.spix = info->ixspix}};
@@ -907,11 +1864,16 @@ static int _file_trunc_vix(spfs_t *fs, uint8_t final, int respre,
     res = _medium_write(fs, SPFS_DPIX2ADDR(fs, new_dpix_ix), fs->run.work2,
               SPFS_CFG_LPAGE_SZ(fs), SPFS_T_META | SPFS_C_UP);
     ERR(res);
+#if SPFS_CFG_IX_ROOT
+    res = _ix_root_set(fs, info->dpix_ixhdr, info->ixspix, new_dpix_ix);
+    ERR(res);
+#endif
     res = _lu_page_delete(fs, info->dpix_ix);
     ERR(res);
     spfs_file_event_data_t evdata = {.update={.spix = info->ixspix, .dpix = new_dpix_ix}};
     _inform(fs, SPFS_F_EV_UPDATE_IX, info->fi->id, &evdata);
     if (info->ixspix == 0) {
+      info->dpix_ixhdr = new_dpix_ix;
       spfs_file_event_data_t evdata_size = {.size = arg->target_size};
       _inform(fs, SPFS_F_EV_NEW_SIZE, info->fi->id, &evdata_size);
     }
@@ -970,14 +1932,54 @@ static int _file_trunc_v(spfs_t *fs, pix_t dpix,
   barr8_set(&info->ixarr, info->ixent, new_dpix_ixentry);
   ERRET(res);
 }
+/**
+ * Truncates a rotating file to zero. Rotating files know where their head is
+ * by their size only, so they cannot be truncated to anything else. All pages
+ * of the ring are deleted, and the index header is replaced by one without
+ * entries.
+ */
+static int _file_rot_reset(spfs_t *fs, spfs_fi_t *fi, pix_t dpix_ixhdr, uint32_t v_flags) {
+  spfs_fi_t flat = _file_rot_flat(fi);
+  int res = spfs_file_visit(fs, &flat, dpix_ixhdr, 0, flat.size, 0, NULL,
+                            _file_remove_v, _file_remove_vix, v_flags);
+  ERR(res);
+  res = _medium_read(fs, SPFS_DPIX2ADDR(fs, dpix_ixhdr), fs->run.work2,
+                     SPFS_CFG_LPAGE_SZ(fs), SPFS_T_META);
+  ERR(res);
+  spfs_memset(fs->run.work2, 0xff, SPFS_DPIXHDROFFS(fs));
+  _pixhdr_wrmem_sz(fs, fs->run.work2 + SPFS_DPIXHDROFFS(fs), 0);
+#if SPFS_CFG_IX_ROOT
+  _ix_root_refresh(fs, fs->run.work2 + SPFS_DPIXHDROFFS(fs) + SPFS_PIXHDR_IX_ROOT_OFFS, 0);
+#endif
+  pix_t new_dpix_ixhdr;
+  res = _page_allocate_free(fs, &new_dpix_ixhdr, fi->id, SPFS_LU_FL_INDEX);
+  ERR(res);
+  res = _medium_write(fs, SPFS_DPIX2ADDR(fs, new_dpix_ixhdr), fs->run.work2,
+            SPFS_CFG_LPAGE_SZ(fs), SPFS_T_META | SPFS_C_UP);
+  ERR(res);
+  res = _lu_page_delete(fs, dpix_ixhdr);
+  ERR(res);
+  fs->run.pused--;
+  spfs_file_event_data_t evdata_movement = {.update={.spix = 0, .dpix = new_dpix_ixhdr}};
+  _inform(fs, SPFS_F_EV_UPDATE_IX, fi->id, &evdata_movement);
+  spfs_file_event_data_t evdata_size = {.size = 0};
+  _inform(fs, SPFS_F_EV_NEW_SIZE, fi->id, &evdata_size);
+  ERRET(res);
+}
 _SPFS_STATIC int spfs_file_ftruncate(spfs_t *fs, spfs_fd_t *fd, uint32_t target_size) {
   int res;
   pix_t dpix_ixhdr = fd->dpix_ixhdr;
-  uint32_t current_size = fd->fi.size;
+  uint32_t current_size = SPFS_FI_SIZE(&fd->fi);
   dbg("ftruncate id:"_SPIPRIid" to size "_SPIPRIi" from "_SPIPRIi"\n", fd->fi.id, target_size, current_size);
+  spfs_cache_file_trunc(fs, fd->fi.id, target_size);
   if (current_size == SPFS_FILESZ_UNDEF || current_size <= target_size) {
     ERRET(SPFS_OK);
   }
+  if (fd->fi.type == SPFS_PIXHDR_TY_ROTFILE) {
+    if (target_size) ERR(-SPFS_ERR_ARG);
+    res = _file_rot_reset(fs, &fd->fi, dpix_ixhdr, fd->fd_oflags);
+    ERRET(res);
+  }
   _file_trunc_varg_t arg = {.target_size = target_size,
                             .ixaction = SPFS_FTR_IXDIRTY_UNDEFINED,
                             .ixhdr_updated = 0 };
@@ -992,11 +1994,17 @@ _SPFS_STATIC int spfs_file_truncate(spfs_t *fs, const char *path, uint32_t targe
   spfs_pixhdr_t pixhdr;
   res = spfs_file_find(fs, path, &dpix_ixhdr, &pixhdr);
   ERR(res);
-  uint32_t current_size = pixhdr.fi.size;
+  uint32_t current_size = SPFS_FI_SIZE(&pixhdr.fi);
   dbg("truncate path:%s to size "_SPIPRIi" from "_SPIPRIi"\n", path, target_size, current_size);
+  spfs_cache_file_trunc(fs, pixhdr.fi.id, target_size);
   if (current_size == SPFS_FILESZ_UNDEF || current_size <= target_size) {
     ERRET(SPFS_OK);
   }
+  if (pixhdr.fi.type == SPFS_PIXHDR_TY_ROTFILE) {
+    if (target_size) ERR(-SPFS_ERR_ARG);
+    res = _file_rot_reset(fs, &pixhdr.fi, dpix_ixhdr, 0);
+    ERRET(res);
+  }
   _file_trunc_varg_t arg = {.target_size = target_size,
                             .ixaction = SPFS_FTR_IXDIRTY_UNDEFINED,
                             .ixhdr_updated = 0 };
@@ -1005,3 +2013,136 @@ _SPFS_STATIC int spfs_file_truncate(spfs_t *fs, const char *path, uint32_t targe
                         _file_trunc_v, _file_trunc_vix, 0);
   ERRET(res);
 }
+
+#if SPFS_CFG_DIR_SLOTS
+typedef struct {
+  spfs_pixhdr_t pixhdr;
+  pix_t dpix;
+  // set when entering files in a new directory
+  uint8_t build;
+  // number of files and sum over their name hashes and ids
+  uint32_t cnt;
+  uint32_t sum;
+} _dir_load_varg_t;
+static int _dir_load_v(spfs_t *fs, uint32_t lu_entry, spfs_vis_info_t *info, void *varg) {
+  _dir_load_varg_t *arg = (_dir_load_varg_t *)varg;
+  id_t id = spfs_signext(lu_entry >> SPFS_LU_FLAG_BITS, SPFS_BITS_ID(fs));
+  if ((lu_entry & ((1<<SPFS_LU_FLAG_BITS)-1))
+      || id == SPFS_IDDELE || id == SPFS_IDFREE || id == SPFS_IDJOUR)
+    return SPFS_VIS_CONT;
+  spfs_pixhdr_t pixhdr;
+  int res = _page_ixhdr_read(fs, info->dpix, &pixhdr, 0);
+  ERR(res);
+  if (pixhdr.phdr.span) return SPFS_VIS_CONT;
+  if (!arg->build) {
+    // looking for the directory, summing up the files it should cover
+    if (pixhdr.fi.type == SPFS_PIXHDR_TY_DIR) {
+      if (arg->dpix == (pix_t)-1) {
+        arg->dpix = info->dpix;
+        spfs_memcpy(&arg->pixhdr, &pixhdr, sizeof(spfs_pixhdr_t));
+      }
+    } else {
+      arg->cnt++;
+      arg->sum += _dir_sum(_namehash_calc((char *)pixhdr.name), pixhdr.phdr.id);
+    }
+    return SPFS_VIS_CONT;
+  }
+  // building the directory
+  if (pixhdr.fi.type == SPFS_PIXHDR_TY_DIR) return SPFS_VIS_CONT;
+  res = _dir_put(fs, (char *)pixhdr.name, pixhdr.phdr.id);
+  ERR(res);
+  // directory was full and removed
+  if (fs->run.dir_id == 0) return SPFS_VIS_STOP;
+  // directory access clobbered the lu page buffer
+  return SPFS_VIS_CONT_LU_RELOAD;
+}
+
+// checks that the entered slots of the name directory are those of the
+// summed up files
+static int _dir_verify(spfs_t *fs, uint32_t cnt, uint32_t sum) {
+  uint8_t buf[_SPFS_DIR_PROBE_SLOTS * _SPFS_DIR_SLOT_SZ];
+  uint32_t slot, i;
+  for (slot = 0; slot < SPFS_CFG_DIR_SLOTS; slot += _SPFS_DIR_PROBE_SLOTS) {
+    uint32_t scnt = spfs_min(_SPFS_DIR_PROBE_SLOTS, SPFS_CFG_DIR_SLOTS - slot);
+    int res = _dir_io(fs, slot, buf, scnt, 0);
+    ERR(res);
+    for (i = 0; i < scnt; i++) {
+      uint32_t shash = _dir_rd32(&buf[i * _SPFS_DIR_SLOT_SZ]);
+      uint32_t sid = _dir_rd32(&buf[i * _SPFS_DIR_SLOT_SZ + 4]);
+      if (sid == _SPFS_DIR_SLOT_FREE || sid == _SPFS_DIR_SLOT_DELE) continue;
+      cnt--;
+      sum -= _dir_sum(shash, sid);
+    }
+  }
+  return (cnt == 0 && sum == 0) ? SPFS_OK : -SPFS_ERR_FILE_NOT_FOUND;
+}
+
+// Finds the name directory file and verifies it, or builds it if missing,
+// unfinished or not matching the files. If there is no room for it, the file
+// system is used without name directory.
+_SPFS_STATIC int spfs_file_dir_load(spfs_t *fs) {
+  int res;
+  _dir_load_varg_t arg = {.dpix = (pix_t)-1};
+  spfs_vis_desc_t desc = {.v = _dir_load_v, .varg = &arg, .flags = SPFS_VIS_FL_IX,
+                          .vblk = spfs_vis_blk_skip_unused};
+  fs->run.dir_id = 0;
+  res = spfs_page_visit_desc(fs, 0, 0, &desc);
+  if (res == -SPFS_ERR_VIS_END) res = SPFS_OK;
+  ERR(res);
+  if (arg.dpix != (pix_t)-1) {
+    fs->run.dir_dpix = arg.dpix;
+    fs->run.dir_id = arg.pixhdr.phdr.id;
+    if ((arg.pixhdr.fi.f_flags & SPFS_PIXHDR_FL_DIR_DONE) == 0) {
+      res = _dir_verify(fs, arg.cnt, arg.sum);
+      if (res == SPFS_OK) {
+        dbg("name directory id:"_SPIPRIid" @ dpix:"_SPIPRIpg"\n", fs->run.dir_id, fs->run.dir_dpix);
+        return SPFS_OK;
+      }
+      if (res != -SPFS_ERR_FILE_NOT_FOUND) ERR(res);
+      dbg("name directory id:"_SPIPRIid" stale\n", fs->run.dir_id);
+    } else {
+      dbg("name directory id:"_SPIPRIid" unfinished\n", fs->run.dir_id);
+    }
+    res = _dir_remove(fs);
+    ERR(res);
+  }
+
+  // create directory and fill it with free slots
+  id_t id;
+  pix_t free_dpix;
+  res = _id_page_find_free(fs, &id, &free_dpix, NULL, 0);
+  if (res == -SPFS_ERR_OUT_OF_PAGES || res == -SPFS_ERR_OUT_OF_IDS) {
+    dbg("no room for name directory\n");
+    return SPFS_OK;
+  }
+  ERR(res);
+  res = _file_mknod_at(fs, "", SPFS_PIXHDR_TY_DIR, _SPFS_DIR_SZ, NULL, NULL, id, free_dpix);
+  ERR(res);
+  fs->run.dir_id = id;
+  fs->run.dir_dpix = free_dpix;
+  spfs_fd_t dfd;
+  _dir_fd(fs, &dfd, 0);
+  dfd.fi.size = SPFS_FILESZ_UNDEF;
+  res = spfs_file_writev(fs, &dfd, 0, NULL, _SPFS_DIR_SZ);
+  if (res == -SPFS_ERR_OUT_OF_PAGES) {
+    dbg("no room for name directory\n");
+    res = _dir_remove(fs);
+    ERRET(res);
+  }
+  ERR(res < 0 ? res : SPFS_OK);
+
+  // enter all files
+  arg.build = 1;
+  res = spfs_page_visit_desc(fs, 0, 0, &desc);
+  if (res == -SPFS_ERR_VIS_END) res = SPFS_OK;
+  ERR(res);
+  if (fs->run.dir_id == 0) {
+    dbg("too many files for name directory\n");
+    return SPFS_OK;
+  }
+  res = _ixhdr_rewrite_flags(fs, fs->run.dir_dpix, 0xff & ~SPFS_PIXHDR_FL_DIR_DONE);
+  ERR(res);
+  dbg("name directory id:"_SPIPRIid" built @ dpix:"_SPIPRIpg"\n", fs->run.dir_id, fs->run.dir_dpix);
+  ERRET(res);
+}
+#endif
@@ -28,6 +28,14 @@ typedef struct spfs_fd_s {
   spfs_fi_t fi;
   /** descriptor flags */
   uint32_t fd_oflags;
+#if SPFS_CFG_FD_IX_CHAIN
+  /** data page indices for index pages with span 1 and up, -1 if unknown */
+  pix_t ixchain[SPFS_CFG_FD_IX_CHAIN];
+#endif
+#if SPFS_CFG_HAL_READ_AHEAD
+  /** file offset where last read ended, reads starting there are sequential */
+  uint32_t ra_offset;
+#endif
 } spfs_fd_t;
 
 
@@ -95,6 +103,8 @@ typedef int (* spfs_file_ix_visitor_t)(spfs_t *fs, uint8_t final, int res,
 
 
 _SPFS_STATIC int spfs_file_find(spfs_t *fs, const char *name, pix_t *dpix, spfs_pixhdr_t *pixhdr);
+_SPFS_STATIC int spfs_file_find_creat(spfs_t *fs, const char *name, pix_t *dpix,
+                                      spfs_pixhdr_t *pixhdr, id_t *id, pix_t *free_dpix);
 
 /**
  * Visit a file from given offset to offset plus len. Will look up corresponding
@@ -124,14 +134,29 @@ _SPFS_STATIC int _fd_claim(spfs_t *fs, spfs_fd_t **fd);
 _SPFS_STATIC int _fd_resolve(spfs_t *fs, spfs_file_t fh, spfs_fd_t **fd);
 _SPFS_STATIC void _fd_release(spfs_t *fs, spfs_fd_t *fd);
 _SPFS_STATIC int spfs_file_create(spfs_t *fs, spfs_fd_t *fd, const char *name);
-_SPFS_STATIC int spfs_file_create_fix(spfs_t *fs, spfs_fd_t *fd, const char *name, uint32_t fixed_size);
-/*_SPFS_STATIC int spfs_file_create_rot(spfs_t *fs, spfs_fd_t *fd, const char *name, uint32_t rot_size);*/
+_SPFS_STATIC int spfs_file_create_at(spfs_t *fs, spfs_fd_t *fd, const char *name,
+                                     id_t id, pix_t free_dpix);
+_SPFS_STATIC int spfs_file_create_fix(spfs_t *fs, spfs_fd_t *fd, const char *name, uint32_t fixed_size,
+                                      uint8_t prealloc);
+_SPFS_STATIC int spfs_file_create_rot(spfs_t *fs, spfs_fd_t *fd, const char *name, uint32_t rot_size);
 _SPFS_STATIC int spfs_file_read(spfs_t *fs, spfs_fd_t *fd, uint32_t offs, uint32_t len, uint8_t *dst);
+_SPFS_STATIC int spfs_file_readv(spfs_t *fs, spfs_fd_t *fd, uint32_t offs,
+                                 const struct spfs_iov *iov, uint32_t len);
+#if SPFS_CFG_HAL_MAP
+_SPFS_STATIC int spfs_file_read_zc(spfs_t *fs, spfs_fd_t *fd, uint32_t offs, uint32_t len,
+                                   spfs_zc_seg_t *segs, uint32_t seg_cnt);
+#endif
 _SPFS_STATIC int spfs_file_write(spfs_t *fs, spfs_fd_t *fd, uint32_t offs, uint32_t len,
                                  const uint8_t *src);
+/* writes len bytes gathered from iov, or 0xff bytes if iov is NULL */
+_SPFS_STATIC int spfs_file_writev(spfs_t *fs, spfs_fd_t *fd, uint32_t offs,
+                                  const struct spfs_iov *iov, uint32_t len);
 _SPFS_STATIC int spfs_file_fremove(spfs_t *fs, spfs_fd_t *fd);
 _SPFS_STATIC int spfs_file_remove(spfs_t *fs, const char *path);
 _SPFS_STATIC int spfs_file_ftruncate(spfs_t *fs, spfs_fd_t *fd, uint32_t size);
 _SPFS_STATIC int spfs_file_truncate(spfs_t *fs, const char *path, uint32_t target_size);
+#if SPFS_CFG_DIR_SLOTS
+_SPFS_STATIC int spfs_file_dir_load(spfs_t *fs);
+#endif
 
 #endif /* _SPFS_FILE_H_ */
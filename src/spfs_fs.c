@@ -141,6 +141,14 @@ static int _mount_scan_blocks(spfs_t *fs) {
     // read and extract block header
     res = _bhdr_rd(fs, lbix, &b, raw);
     ERR(res);
+#if SPFS_CFG_BLOCK_STATS
+    if (fs->run.blk_stat) {
+      // page counts are populated in fs scan
+      fs->run.blk_stat[lbix].pfree = 0;
+      fs->run.blk_stat[lbix].pdele = 0;
+      fs->run.blk_stat[lbix].era_cnt = b.era_cnt;
+    }
+#endif
 //    dbg("lbix:"_SPIPRIbl" magic:"_SPIPRIad" dbix:"_SPIPRIbl" era:"_SPIPRIi
 //             " lblk_sz:"_SPIPRIi" lpage_sz:"_SPIPRIi" gc:"_SPIPRIfl" chk:"_SPIPRIad"\n",
 //        lbix, b.magic, b.dbix, b.era_cnt, b.lblk_sz, b.lpage_sz, b.gc_flag, b.pchk);
@@ -168,6 +176,11 @@ static int _mount_scan_blocks(spfs_t *fs) {
       dbg("gc lbix:"_SPIPRIbl"\n", lbix);
       if (b.pchk != 0xffff) ERR(-SPFS_ERR_NOT_A_FS);
       fs->run.lbix_gc_free = lbix;
+#if SPFS_CFG_BLOCK_STATS
+      if (fs->run.blk_stat) {
+        fs->run.blk_stat[lbix].pfree = SPFS_DPAGES_P_BLK(fs);
+      }
+#endif
       if (b.gc_flag == SPFS_BLK_GC_INACTIVE) {
         // pass
       } else {
@@ -214,13 +227,50 @@ static int _mount_scan_fs_v(spfs_t *fs, uint32_t lu_entry, spfs_vis_info_t *info
   id_t id = spfs_signext(lu_entry >> SPFS_LU_FLAG_BITS, SPFS_BITS_ID(fs));
   if (id == SPFS_IDDELE) {
     fs->run.pdele++;
+#if SPFS_CFG_BLOCK_STATS
+    if (fs->run.blk_stat) fs->run.blk_stat[info->lbix].pdele++;
+#endif
   } else if (id == SPFS_IDFREE) {
     fs->run.pfree++;
+#if SPFS_CFG_BLOCK_STATS
+    if (fs->run.blk_stat) fs->run.blk_stat[info->lbix].pfree++;
+#endif
+#if SPFS_CFG_PFREE_BITMAP
+    _pfree_bm_mark(fs, info->dpix, 1);
+#endif
   } else if (id == SPFS_IDJOUR) {
     fs->run.pused++;
     fs->run.journal.dpix = info->dpix;
   } else {
     fs->run.pused++;
+#if SPFS_CFG_ID_BITMAP
+    if ((lu_entry & ((1<<SPFS_LU_FLAG_BITS)-1)) == SPFS_LU_FL_INDEX) {
+      _id_mark(fs, lu_entry >> SPFS_LU_FLAG_BITS, 0);
+    }
+#endif
+#if SPFS_CFG_NAME_HASH || SPFS_CFG_NAME_BLOOM
+    if ((lu_entry & ((1<<SPFS_LU_FLAG_BITS)-1)) == SPFS_LU_FL_INDEX && (0
+#if SPFS_CFG_NAME_HASH
+        || fs->run.namehash
+#endif
+#if SPFS_CFG_NAME_BLOOM
+        || fs->run.bloom
+#endif
+        )) {
+      spfs_pixhdr_t pixhdr;
+      int res = _page_ixhdr_read(fs, info->dpix, &pixhdr, 0);
+      ERR(res);
+      if (pixhdr.phdr.span == 0 && pixhdr.fi.type != SPFS_PIXHDR_TY_DIR) {
+        uint32_t hash = _namehash_calc((char *)pixhdr.name);
+#if SPFS_CFG_NAME_HASH
+        _namehash_put(fs, hash, lu_entry >> SPFS_LU_FLAG_BITS, info->dpix);
+#endif
+#if SPFS_CFG_NAME_BLOOM
+        _bloom_add(fs, hash);
+#endif
+      }
+    }
+#endif
   }
   return SPFS_VIS_CONT;
 }
@@ -230,6 +280,40 @@ static int _mount_scan_fs(spfs_t *fs) {
   fs->run.pused = 0;
   fs->run.journal.dpix = -1;
   int res;
+#if SPFS_CFG_LU_MIRROR
+  res = _lu_mirror_load(fs);
+  ERR(res);
+#endif
+#if SPFS_CFG_PFREE_BITMAP
+  if (fs->run.pfree_bm) {
+    spfs_memset(fs->run.pfree_bm, 0, spfs_ceil((pix_t)SPFS_DPAGES_MAX(fs), 32) * sizeof(uint32_t));
+  }
+#endif
+#if SPFS_CFG_ID_BITMAP
+  if (fs->run.id_bm) {
+    spfs_memset(fs->run.id_bm, 0xff, spfs_ceil(SPFS_MAX_ID(fs), 32) * sizeof(uint32_t));
+    if (SPFS_MAX_ID(fs) % 32) {
+      // ids beyond max are never free
+      fs->run.id_bm[SPFS_MAX_ID(fs) / 32] = (1U << (SPFS_MAX_ID(fs) % 32)) - 1;
+    }
+    fs->run.id_bm_cursor = 0;
+  }
+#endif
+#if SPFS_CFG_ID_RECYCLE_RING
+  fs->run.id_ring_ix = 0;
+  fs->run.id_ring_cnt = 0;
+#endif
+#if SPFS_CFG_NAME_HASH
+  if (fs->run.namehash) {
+    spfs_memset(fs->run.namehash, 0, fs->run.namehash_cnt * sizeof(spfs_namehash_ent_t));
+  }
+  fs->run.namehash_partial = 0;
+#endif
+#if SPFS_CFG_NAME_BLOOM
+  if (fs->run.bloom) {
+    spfs_memset(fs->run.bloom, 0, fs->run.bloom_bits / 8);
+  }
+#endif
   res = spfs_page_visit(fs, 0, 0, NULL, _mount_scan_fs_v, 0);
   if (res == -SPFS_ERR_VIS_END) {
     res = SPFS_OK;
@@ -293,17 +377,115 @@ static int _mount_alloc(spfs_t *fs, uint32_t descriptors, uint32_t cache_pages)
   // request cache buffer
   if (cache_pages) {
     req_sz = spfs_align(sizeof(spfs_cache), SPFS_ALIGN) +
-        (spfs_align(sizeof(spfs_cache_page), SPFS_ALIGN) + SPFS_CFG_LPAGE_SZ(fs)) * cache_pages;
+        SPFS_CACHE_PAGE_MEM_SZ(fs) * cache_pages;
     dbg("mem:"_SPIPRIi" sz:"_SPIPRIi"\n", SPFS_MEM_CACHE, req_sz);
     mem = fs->cfg.malloc(fs, SPFS_MEM_CACHE, req_sz, &acq_sz);
-    if (acq_sz < spfs_align(sizeof(spfs_cache), SPFS_ALIGN) +
-        (spfs_align(sizeof(spfs_cache_page), SPFS_ALIGN) + SPFS_CFG_LPAGE_SZ(fs))) {
+    if (mem == NULL || acq_sz < spfs_align(sizeof(spfs_cache), SPFS_ALIGN) +
+        SPFS_CACHE_PAGE_MEM_SZ(fs)) {
       dbg("requested "_SPIPRIi" cache pages, but didn't get memory for any", cache_pages);
     } else {
       spfs_cache_init(fs, mem, acq_sz);
     }
   }
 
+#if SPFS_CFG_LU_MIRROR
+  // request lu mirror buffer
+  req_sz = SPFS_LU_BLK_SZ(fs) * SPFS_LBLK_CNT(fs);
+  dbg("mem:"_SPIPRIi" sz:"_SPIPRIi"\n", SPFS_MEM_LU_MIRROR, req_sz);
+  mem = fs->cfg.malloc(fs, SPFS_MEM_LU_MIRROR, req_sz, &acq_sz);
+  fs->run.lu_mirror = (uint8_t *)mem;
+  fs->run.lu_mirror_cnt = mem == NULL ? 0 : spfs_min(acq_sz, req_sz) / SPFS_LU_BLK_SZ(fs);
+  if (fs->run.lu_mirror_cnt == 0) {
+    fs->run.lu_mirror = NULL;
+  }
+#endif
+
+#if SPFS_CFG_BLOCK_STATS
+  // request block statistics buffer
+  req_sz = sizeof(spfs_blk_stat_t) * SPFS_LBLK_CNT(fs);
+  dbg("mem:"_SPIPRIi" sz:"_SPIPRIi"\n", SPFS_MEM_BLOCK_STATS, req_sz);
+  mem = fs->cfg.malloc(fs, SPFS_MEM_BLOCK_STATS, req_sz, &acq_sz);
+  if ((intptr_t)mem & (SPFS_ALIGN - 1))
+    ERR(-SPFS_ERR_CFG_MEM_NOT_ALIGNED); // alignment
+  // all or nothing
+  fs->run.blk_stat = (mem == NULL || acq_sz < req_sz) ? NULL : (spfs_blk_stat_t *)mem;
+#endif
+
+#if SPFS_CFG_PFREE_BITMAP
+  // request free page bitmap buffer
+  req_sz = spfs_ceil((pix_t)SPFS_DPAGES_MAX(fs), 32) * sizeof(uint32_t);
+  dbg("mem:"_SPIPRIi" sz:"_SPIPRIi"\n", SPFS_MEM_PFREE_BITMAP, req_sz);
+  mem = fs->cfg.malloc(fs, SPFS_MEM_PFREE_BITMAP, req_sz, &acq_sz);
+  if ((intptr_t)mem & (SPFS_ALIGN - 1))
+    ERR(-SPFS_ERR_CFG_MEM_NOT_ALIGNED); // alignment
+  // all or nothing
+  fs->run.pfree_bm = (mem == NULL || acq_sz < req_sz) ? NULL : (uint32_t *)mem;
+#endif
+
+#if SPFS_CFG_ID_BITMAP
+  // request free id bitmap buffer
+  req_sz = spfs_ceil(SPFS_MAX_ID(fs), 32) * sizeof(uint32_t);
+  dbg("mem:"_SPIPRIi" sz:"_SPIPRIi"\n", SPFS_MEM_ID_BITMAP, req_sz);
+  mem = fs->cfg.malloc(fs, SPFS_MEM_ID_BITMAP, req_sz, &acq_sz);
+  if ((intptr_t)mem & (SPFS_ALIGN - 1))
+    ERR(-SPFS_ERR_CFG_MEM_NOT_ALIGNED); // alignment
+  // all or nothing
+  fs->run.id_bm = (mem == NULL || acq_sz < req_sz) ? NULL : (uint32_t *)mem;
+#endif
+
+#if SPFS_CFG_IX_CACHE
+  // request index page location cache buffer
+  req_sz = sizeof(spfs_ixcache_ent_t) * SPFS_CFG_IX_CACHE;
+  dbg("mem:"_SPIPRIi" sz:"_SPIPRIi"\n", SPFS_MEM_IX_CACHE, req_sz);
+  mem = fs->cfg.malloc(fs, SPFS_MEM_IX_CACHE, req_sz, &acq_sz);
+  if ((intptr_t)mem & (SPFS_ALIGN - 1))
+    ERR(-SPFS_ERR_CFG_MEM_NOT_ALIGNED); // alignment
+  fs->run.ixcache = (spfs_ixcache_ent_t *)mem;
+  fs->run.ixcache_cnt = mem == NULL ? 0 : spfs_min(acq_sz, req_sz) / sizeof(spfs_ixcache_ent_t);
+  if (fs->run.ixcache_cnt == 0) {
+    fs->run.ixcache = NULL;
+  } else {
+    spfs_memset(fs->run.ixcache, 0, fs->run.ixcache_cnt * sizeof(spfs_ixcache_ent_t));
+  }
+#endif
+
+#if SPFS_CFG_NAME_HASH
+  // request file name hash index buffer
+  req_sz = sizeof(spfs_namehash_ent_t) * SPFS_CFG_NAME_HASH;
+  dbg("mem:"_SPIPRIi" sz:"_SPIPRIi"\n", SPFS_MEM_NAME_HASH, req_sz);
+  mem = fs->cfg.malloc(fs, SPFS_MEM_NAME_HASH, req_sz, &acq_sz);
+  if ((intptr_t)mem & (SPFS_ALIGN - 1))
+    ERR(-SPFS_ERR_CFG_MEM_NOT_ALIGNED); // alignment
+  fs->run.namehash = (spfs_namehash_ent_t *)mem;
+  fs->run.namehash_cnt = mem == NULL ? 0 : spfs_min(acq_sz, req_sz) / sizeof(spfs_namehash_ent_t);
+  if (fs->run.namehash_cnt == 0) fs->run.namehash = NULL;
+#endif
+
+#if SPFS_CFG_NAME_BLOOM
+  // request file name bloom filter buffer
+  req_sz = SPFS_CFG_NAME_BLOOM;
+  dbg("mem:"_SPIPRIi" sz:"_SPIPRIi"\n", SPFS_MEM_NAME_BLOOM, req_sz);
+  mem = fs->cfg.malloc(fs, SPFS_MEM_NAME_BLOOM, req_sz, &acq_sz);
+  fs->run.bloom = (uint8_t *)mem;
+  fs->run.bloom_bits = mem == NULL ? 0 : spfs_min(acq_sz, req_sz) * 8;
+  if (fs->run.bloom_bits == 0) fs->run.bloom = NULL;
+#endif
+
+#if SPFS_CFG_HAL_READ_AHEAD
+  // request read ahead buffer
+  req_sz = SPFS_CFG_HAL_READ_AHEAD * SPFS_CFG_LPAGE_SZ(fs);
+  dbg("mem:"_SPIPRIi" sz:"_SPIPRIi"\n", SPFS_MEM_READ_AHEAD, req_sz);
+  mem = fs->cfg.malloc(fs, SPFS_MEM_READ_AHEAD, req_sz, &acq_sz);
+  fs->run.ra.buf = (uint8_t *)mem;
+  fs->run.ra.max = mem == NULL ? 0 : spfs_min(acq_sz, req_sz) / SPFS_CFG_LPAGE_SZ(fs);
+  fs->run.ra.cnt = 0;
+  // a single page is not worth reading ahead
+  if (fs->run.ra.max < 2) {
+    fs->run.ra.buf = NULL;
+    fs->run.ra.max = 0;
+  }
+#endif
+
   return SPFS_OK;
 }
 
@@ -341,6 +523,11 @@ _SPFS_STATIC int spfs_mount(spfs_t *fs, uint32_t mount_flags, uint32_t descripto
   ERR(res < 0 ? res : SPFS_OK);
   fs->run.journal.resv_free = (uint8_t)res;
 
+#if SPFS_CFG_DIR_SLOTS
+  res = spfs_file_dir_load(fs);
+  ERR(res);
+#endif
+
   fs->mount_state = SPFS_MOUNTED;
   dbg("mounted successfully\n");
   ERRET(res);
@@ -348,8 +535,39 @@ _SPFS_STATIC int spfs_mount(spfs_t *fs, uint32_t mount_flags, uint32_t descripto
 
 
 _SPFS_STATIC int spfs_umount(spfs_t *fs) {
-  int res = SPFS_OK;
+  // persist cached writes
+  int res = spfs_cache_flush(fs);
   // TODO
+  fs->run.cache = NULL;
+  fs->run.cache_cnt = 0;
+#if SPFS_CFG_LU_MIRROR
+  fs->run.lu_mirror = NULL;
+  fs->run.lu_mirror_cnt = 0;
+#endif
+#if SPFS_CFG_BLOCK_STATS
+  fs->run.blk_stat = NULL;
+#endif
+#if SPFS_CFG_PFREE_BITMAP
+  fs->run.pfree_bm = NULL;
+#endif
+#if SPFS_CFG_ID_BITMAP
+  fs->run.id_bm = NULL;
+#endif
+#if SPFS_CFG_IX_CACHE
+  fs->run.ixcache = NULL;
+  fs->run.ixcache_cnt = 0;
+#endif
+#if SPFS_CFG_NAME_HASH
+  fs->run.namehash = NULL;
+  fs->run.namehash_cnt = 0;
+#endif
+#if SPFS_CFG_NAME_BLOOM
+  fs->run.bloom = NULL;
+  fs->run.bloom_bits = 0;
+#endif
+#if SPFS_CFG_DIR_SLOTS
+  fs->run.dir_id = 0;
+#endif
   fs->mount_state = 0;
   ERRET(res);
 }
@@ -518,6 +736,7 @@ _SPFS_STATIC int spfs_probe(spfs_cfg_t *cfg, uint32_t start_addr, uint32_t end_a
   int res;
   uint8_t mem[SPFS_CFG_COPY_BUF_SZ];
   spfs_t dummy_fs;
+  spfs_memset(&dummy_fs, 0, sizeof(spfs_t));
   spfs_memcpy(&dummy_fs.cfg, cfg, sizeof(spfs_cfg_t));
   dummy_fs.user = user;
 
@@ -52,6 +52,10 @@ static int _gc_evacuate_v(spfs_t *fs, uint32_t lu_entry, spfs_vis_info_t *info,
   // only copy real ids
   if (id == SPFS_IDDELE) {
     arg->pdele++;
+#if SPFS_CFG_PFREE_BITMAP
+    // will be free in dst block
+    _pfree_bm_mark(fs, info->dpix, 1);
+#endif
     return SPFS_VIS_CONT;
   }
   else if (id == SPFS_IDFREE) {
@@ -97,7 +101,7 @@ _SPFS_STATIC int spfs_gc_evacuate(spfs_t *fs, bix_t src_dbix) {
   ERR(res);
 
   pix_t src_dpix_start = src_bhdr.dbix * SPFS_DPAGES_P_BLK(fs);
-  pix_t src_dpix_end = src_dpix_start + SPFS_DPAGES_P_BLK(fs)-1;
+  pix_t src_dpix_end = (src_dpix_start + SPFS_DPAGES_P_BLK(fs)) % (pix_t)SPFS_DPAGES_MAX(fs);
 
   // 2. copy all data pages from src blk to dst blk
   _gc_evacuate_varg_t varg = {.dst_lbix = dst_lbix,
@@ -109,10 +113,16 @@ _SPFS_STATIC int spfs_gc_evacuate(spfs_t *fs, bix_t src_dbix) {
 
   fs->run.pdele -= varg.pdele;
   fs->run.pfree += varg.pdele;
+#if SPFS_CFG_BLOCK_STATS
+  if (fs->run.blk_stat) {
+    fs->run.blk_stat[dst_lbix].pfree = varg.pfree + varg.pdele;
+    fs->run.blk_stat[dst_lbix].pdele = 0;
+  }
+#endif
 
   // 3. write dst block header
   res = _bhdr_write(fs, dst_lbix, src_dbix, dst_bhdr.era_cnt, 0, _SPFS_HAL_WR_FL_OVERWRITE);
-  ERRET(res);
+  ERR(res);
 
   dbg("fs post free:"_SPIPRIi" used:"_SPIPRIi" dele:"_SPIPRIi"\n", fs->run.pfree, fs->run.pused, fs->run.pdele);
 
@@ -124,7 +134,7 @@ _SPFS_STATIC int spfs_gc_evacuate(spfs_t *fs, bix_t src_dbix) {
   dbg("free "_SPIPRIi" bytes, new gc page lpix:"_SPIPRIbl"\n", varg.pdele * SPFS_DPAGE_SZ(fs), src_lbix);
   fs->run.lbix_gc_free = src_lbix;
   barr_set(&fs->run.blk_lu, src_dbix, dst_lbix);
-
+  ERRET(res);
 }
 
 typedef struct {
@@ -213,11 +223,29 @@ static int _gc_pick(spfs_t *fs, bix_t *dbix) {
   _gc_pick_varg_t varg = { .visited_dbix = (bix_t)-1, .cand_score = -0x7fffffff,
                            .cand_dbix = (bix_t)-1, .cand_pdele = 0};
   dbg("norm:"_SPIPRIi"\n",SPFS_DPAGES_P_BLK(fs));
-  int res = spfs_page_visit(fs, 0, 0, &varg, _gc_pick_v, 0);
-  if (res == -SPFS_ERR_VIS_END) res = SPFS_OK;
-  ERR(res);
-  // process the last data block as the visit function is not called for the wrapped page
-  _gc_pick_calc_score(fs, &varg, varg.visiting_dbix);
+  int res = SPFS_OK;
+#if SPFS_CFG_BLOCK_STATS
+  if (fs->run.blk_stat) {
+    // score from block statistics, no need to scan medium
+    bix_t d;
+    for (d = 0; d < (bix_t)(SPFS_LBLK_CNT(fs) - 1); d++) {
+      spfs_blk_stat_t *stat = &fs->run.blk_stat[_dbix2lbix(fs, d)];
+      varg.visited_dbix = d;
+      varg.pfree = stat->pfree;
+      varg.pdele = stat->pdele;
+      varg.pused = SPFS_DPAGES_P_BLK(fs) - stat->pfree - stat->pdele;
+      varg.era_cnt = stat->era_cnt;
+      _gc_pick_calc_score(fs, &varg, d);
+    }
+  } else
+#endif
+  {
+    res = spfs_page_visit(fs, 0, 0, &varg, _gc_pick_v, 0);
+    if (res == -SPFS_ERR_VIS_END) res = SPFS_OK;
+    ERR(res);
+    // process the last data block as the visit function is not called for the wrapped page
+    _gc_pick_calc_score(fs, &varg, varg.visiting_dbix);
+  }
   dbg("dbix:"_SPIPRIbl" is gc candidate block, score:"_SPIPRIi"\n", varg.cand_dbix, varg.cand_score);
   if (dbix) *dbix = varg.cand_dbix;
   ERRET(res);
@@ -10,6 +10,7 @@
 #include "spfs_compile_cfg.h"
 #include "spfs.h"
 #include "spfs_lowlevel.h"
+#include "spfs_cache.h"
 
 #undef _SPFS_DBG_PRE
 #undef _SPFS_DBG_POST
@@ -113,6 +114,108 @@ _SPFS_STATIC uint16_t _era_cnt_diff(uint16_t big, uint16_t small) {
 // medium / hal access
 ///////////////////////////////////////////////////////////////////////////////
 
+#if SPFS_CFG_HAL_READ_AHEAD
+// drops the read ahead pages if given range overlaps them
+static void _medium_ra_invalidate(spfs_t *fs, uint32_t addr, uint32_t len) {
+  if (fs->run.ra.cnt == 0) return;
+  uint32_t ra_addr = SPFS_LPIX2ADDR(fs, fs->run.ra.lpix);
+  if (addr < ra_addr + fs->run.ra.cnt * SPFS_CFG_LPAGE_SZ(fs) && ra_addr < addr + len) {
+    fs->run.ra.cnt = 0;
+  }
+}
+
+// returns nonzero if given logical page is read ahead
+_SPFS_STATIC uint8_t _medium_ra_hit(spfs_t *fs, pix_t lpix) {
+  return fs->run.ra.cnt && lpix >= fs->run.ra.lpix && lpix < fs->run.ra.lpix + fs->run.ra.cnt;
+}
+#endif
+
+#if SPFS_CFG_HAL_WRITEV
+// returns nonzero if given range overlaps any queued write
+static uint8_t _medium_wrq_hit(spfs_t *fs, uint32_t addr, uint32_t len) {
+  uint16_t i;
+  for (i = 0; i < fs->run.wrq.cnt; i++) {
+    const spfs_iovec_t *v = &fs->run.wrq.iov[i];
+    if (addr < v->addr + v->size && v->addr < addr + len) return 1;
+  }
+  return 0;
+}
+
+// submits all queued writes to medium, in one call if there is a writev
+_SPFS_STATIC int _medium_wrq_flush(spfs_t *fs) {
+  int res = SPFS_OK;
+  uint16_t cnt = fs->run.wrq.cnt;
+  if (cnt == 0) return SPFS_OK;
+  fs->run.wrq.cnt = 0;
+  fs->run.wrq.pool_used = 0;
+  uint16_t i;
+  if (fs->cfg.writev) {
+    res = fs->cfg.writev(fs, fs->run.wrq.iov, cnt);
+  } else {
+    for (i = 0; res == SPFS_OK && i < cnt; i++) {
+      const spfs_iovec_t *v = &fs->run.wrq.iov[i];
+      res = fs->cfg.write(fs, v->addr, v->src, v->size _SPFS_TEST_ARG(v->flags));
+    }
+  }
+  if (res) {
+    // read cache was updated when queueing, medium is now unknown
+    for (i = 0; i < cnt; i++) {
+      spfs_cache_rdpage_invalidate(fs, fs->run.wrq.iov[i].addr, fs->run.wrq.iov[i].size);
+    }
+  }
+  ERRET(res);
+}
+
+// queues a write to medium when gathering, else writes it directly. If copy
+// is set the data is copied, else src must be left untouched until the queue
+// is flushed.
+_SPFS_STATIC int _medium_write_q(spfs_t *fs, uint32_t addr, const uint8_t *src, uint32_t len,
+                                 uint32_t wr_flags, uint8_t copy) {
+  int res;
+  if (!fs->run.wrq.gather || (copy && len > sizeof(fs->run.wrq.pool))) {
+    res = _medium_write(fs, addr, src, len, wr_flags);
+    ERRET(res);
+  }
+  if (fs->run.wrq.cnt >= SPFS_CFG_HAL_WRITEV
+      || (copy && fs->run.wrq.pool_used + len > sizeof(fs->run.wrq.pool))
+      || _medium_wrq_hit(fs, addr, len)) {
+    res = _medium_wrq_flush(fs);
+    ERR(res);
+  }
+  if (copy) {
+    spfs_memcpy(&fs->run.wrq.pool[fs->run.wrq.pool_used], src, len);
+    src = &fs->run.wrq.pool[fs->run.wrq.pool_used];
+    fs->run.wrq.pool_used += len;
+  }
+  spfs_cache_rdpage_update(fs, addr, src, len);
+#if SPFS_CFG_HAL_READ_AHEAD
+  _medium_ra_invalidate(fs, addr, len);
+#endif
+  spfs_iovec_t *v = &fs->run.wrq.iov[fs->run.wrq.cnt++];
+  v->addr = addr;
+  v->src = src;
+  v->size = len;
+#if SPFS_TEST
+  v->flags = wr_flags;
+#endif
+  return SPFS_OK;
+}
+
+// starts gathering medium writes, returns previous gathering state
+_SPFS_STATIC uint8_t _medium_wrq_begin(spfs_t *fs) {
+  uint8_t gather = fs->run.wrq.gather;
+  fs->run.wrq.gather = 1;
+  return gather;
+}
+
+// submits gathered writes and restores given gathering state
+_SPFS_STATIC int _medium_wrq_end(spfs_t *fs, uint8_t gather) {
+  int res = _medium_wrq_flush(fs);
+  fs->run.wrq.gather = gather;
+  ERRET(res);
+}
+#endif
+
 // erase a block on medium
 _SPFS_STATIC int _medium_erase(spfs_t *fs, uint32_t addr, uint32_t len, uint32_t er_flags) {
 #if SPFS_DBG_LL_MEDIUM_ER
@@ -122,6 +225,16 @@ _SPFS_STATIC int _medium_erase(spfs_t *fs, uint32_t addr, uint32_t len, uint32_t
   }
 #endif
   int res = SPFS_OK;
+#if SPFS_CFG_HAL_WRITEV
+  if (fs->run.wrq.cnt && _medium_wrq_hit(fs, addr, len)) {
+    res = _medium_wrq_flush(fs);
+    ERR(res);
+  }
+#endif
+  spfs_cache_rdpage_invalidate(fs, addr, len);
+#if SPFS_CFG_HAL_READ_AHEAD
+  _medium_ra_invalidate(fs, addr, len);
+#endif
   uint32_t blksz = SPFS_CFG_PBLK_SZ(fs);
   while (res == SPFS_OK && len > 0) {
     res = fs->cfg.erase(fs, addr, blksz _SPFS_TEST_ARG(er_flags));
@@ -147,11 +260,51 @@ _SPFS_STATIC int _medium_write(spfs_t *fs, uint32_t addr, const uint8_t *src, ui
             wr_flags & SPFS_C_UP ? "UP" : "WR",
         len);
   }
+#endif
+#if SPFS_CFG_HAL_WRITEV
+  if (fs->run.wrq.cnt && _medium_wrq_hit(fs, addr, len)) {
+    int res = _medium_wrq_flush(fs);
+    ERR(res);
+  }
+#endif
+#if SPFS_CFG_HAL_READ_AHEAD
+  _medium_ra_invalidate(fs, addr, len);
 #endif
   int res = fs->cfg.write(fs, addr, src, len _SPFS_TEST_ARG(wr_flags));
+  if (res == SPFS_OK) {
+    spfs_cache_rdpage_update(fs, addr, src, len);
+  } else {
+    spfs_cache_rdpage_invalidate(fs, addr, len);
+  }
   ERRET(res);
 }
 
+// claims a read cache page and fills it with given logical page from medium,
+// *page is NULL if there are no cache pages to be had
+static int _medium_cache_fill(spfs_t *fs, pix_t lpix, uint32_t rd_flags, spfs_cache_page **page) {
+  spfs_cache_page *p;
+  int res = SPFS_OK;
+  *page = NULL;
+  uint32_t paddr = SPFS_LPIX2ADDR(fs, lpix);
+#if SPFS_CFG_HAL_WRITEV
+  if (fs->run.wrq.cnt && _medium_wrq_hit(fs, paddr, SPFS_CFG_LPAGE_SZ(fs))) {
+    res = _medium_wrq_flush(fs);
+    ERR(res);
+  }
+#endif
+  res = spfs_cache_page_claim(fs,
+      SPFS_CACHE_FL_TYPE_RD | ((rd_flags & SPFS_T_LU) ? SPFS_CACHE_FL_RD_LU : 0), lpix, &p);
+  ERR(res);
+  if (p == NULL) return SPFS_OK;
+  res = fs->cfg.read(fs, paddr, p->buf, SPFS_CFG_LPAGE_SZ(fs) _SPFS_TEST_ARG(rd_flags));
+  if (res) {
+    spfs_cache_page_drop(fs, p);
+    ERR(res);
+  }
+  *page = p;
+  return SPFS_OK;
+}
+
 // reads data from medium
 _SPFS_STATIC int _medium_read(spfs_t *fs, uint32_t addr, uint8_t *dst, uint32_t len, uint32_t rd_flags) {
 #if SPFS_DBG_LL_MEDIUM_RD
@@ -167,10 +320,62 @@ _SPFS_STATIC int _medium_read(spfs_t *fs, uint32_t addr, uint8_t *dst, uint32_t
         len);
   }
 #endif
-  int res = fs->cfg.read(fs, addr, dst, len _SPFS_TEST_ARG(rd_flags));
+#if SPFS_CFG_HAL_WRITEV
+  if (fs->run.wrq.cnt && _medium_wrq_hit(fs, addr, len)) {
+    int res = _medium_wrq_flush(fs);
+    ERR(res);
+  }
+#endif
+  int res;
+  pix_t lpix;
+#if SPFS_CFG_HAL_READ_AHEAD
+  if (fs->run.ra.cnt && len && _medium_ra_hit(fs, SPFS_ADDR2LPIX(fs, addr))) {
+    // served from pages read ahead
+    spfs_memcpy(dst, &fs->run.ra.buf[addr - SPFS_LPIX2ADDR(fs, fs->run.ra.lpix)], len);
+    return SPFS_OK;
+  }
+#endif
+  if (fs->run.cache && len
+      && (lpix = SPFS_ADDR2LPIX(fs, addr)) == SPFS_ADDR2LPIX(fs, addr + len - 1)) {
+    // serve from read cache, lu and meta pages are admitted on miss
+    spfs_cache_page *p = spfs_cache_rdpage_lookup(fs, lpix);
+    if (p == NULL && (rd_flags & (SPFS_T_LU | SPFS_T_META))) {
+      res = _medium_cache_fill(fs, lpix, rd_flags, &p);
+      ERR(res);
+    }
+    if (p) {
+      spfs_memcpy(dst, &p->buf[addr - SPFS_LPIX2ADDR(fs, lpix)], len);
+      return SPFS_OK;
+    }
+  }
+  res = fs->cfg.read(fs, addr, dst, len _SPFS_TEST_ARG(rd_flags));
   ERRET(res);
 }
 
+#if SPFS_CFG_HAL_READ_AHEAD
+// reads given number of consecutive logical pages starting with given page, all
+// within one block, in one call into the read ahead buffer
+_SPFS_STATIC int _medium_read_ahead(spfs_t *fs, pix_t lpix, uint32_t cnt, uint32_t rd_flags) {
+  uint32_t addr = SPFS_LPIX2ADDR(fs, lpix);
+  uint32_t len = cnt * SPFS_CFG_LPAGE_SZ(fs);
+  int res = SPFS_OK;
+  spfs_assert(cnt <= fs->run.ra.max);
+  dbg("RA@"_SPIPRIad" lpix:"_SPIPRIpg" cnt:"_SPIPRIi"\n", addr, lpix, cnt);
+#if SPFS_CFG_HAL_WRITEV
+  if (fs->run.wrq.cnt && _medium_wrq_hit(fs, addr, len)) {
+    res = _medium_wrq_flush(fs);
+    ERR(res);
+  }
+#endif
+  fs->run.ra.cnt = 0;
+  res = fs->cfg.read_pages(fs, addr, fs->run.ra.buf, len _SPFS_TEST_ARG(rd_flags));
+  ERR(res);
+  fs->run.ra.lpix = lpix;
+  fs->run.ra.cnt = cnt;
+  ERRET(res);
+}
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////
 // block operations
 ///////////////////////////////////////////////////////////////////////////////
@@ -231,6 +436,18 @@ _SPFS_STATIC int _block_erase(spfs_t *fs, bix_t lbix, bix_t dbix, uint16_t era)
   uint32_t paddr = SPFS_CFG_PADDR_OFFS(fs) + lbix * SPFS_CFG_LBLK_SZ(fs);
   int res = _medium_erase(fs, paddr, SPFS_CFG_LBLK_SZ(fs), 0);
   ERR(res);
+#if SPFS_CFG_LU_MIRROR
+  if (fs->run.lu_mirror && lbix < fs->run.lu_mirror_cnt) {
+    spfs_memset(&fs->run.lu_mirror[lbix * SPFS_LU_BLK_SZ(fs)], 0xff, SPFS_LU_BLK_SZ(fs));
+  }
+#endif
+#if SPFS_CFG_BLOCK_STATS
+  if (fs->run.blk_stat) {
+    fs->run.blk_stat[lbix].pfree = SPFS_DPAGES_P_BLK(fs);
+    fs->run.blk_stat[lbix].pdele = 0;
+    fs->run.blk_stat[lbix].era_cnt = era;
+  }
+#endif
   res = _bhdr_write(fs, lbix, dbix, era, 0, 0);
   ERRET(res);
 }
@@ -240,6 +457,33 @@ _SPFS_STATIC int _block_erase(spfs_t *fs, bix_t lbix, bix_t dbix, uint16_t era)
 // LU operations
 ///////////////////////////////////////////////////////////////////////////////
 
+#if SPFS_CFG_LU_MIRROR
+// returns ram mirror of given lu page in given log block, excluding block
+// header, or NULL if not mirrored
+static uint8_t *_lu_mirror(spfs_t *fs, bix_t lbix, pix_t lupix) {
+  if (fs->run.lu_mirror == NULL || lbix >= fs->run.lu_mirror_cnt) return NULL;
+  return &fs->run.lu_mirror[lbix * SPFS_LU_BLK_SZ(fs) +
+                            (lupix == 0 ? 0 : lupix * SPFS_CFG_LPAGE_SZ(fs) - SPFS_BLK_HDR_SZ)];
+}
+
+// reads all lu pages of mirrored blocks from medium into ram mirror
+_SPFS_STATIC int _lu_mirror_load(spfs_t *fs) {
+  int res = SPFS_OK;
+  bix_t lbix;
+  pix_t lupix;
+  for (lbix = 0; res == SPFS_OK && lbix < fs->run.lu_mirror_cnt; lbix++) {
+    for (lupix = 0; res == SPFS_OK && lupix < (pix_t)SPFS_LUPAGES_P_BLK(fs); lupix++) {
+      uint32_t bhdr_sz = (lupix == 0 ? SPFS_BLK_HDR_SZ : 0);
+      res = _medium_read(fs, SPFS_LBLKLPIX2ADDR(fs, lbix, lupix) + bhdr_sz,
+                         _lu_mirror(fs, lbix, lupix), SPFS_CFG_LPAGE_SZ(fs) - bhdr_sz,
+                         SPFS_T_LU);
+    }
+  }
+  dbg("mirrored "_SPIPRIi" blocks\n", fs->run.lu_mirror_cnt);
+  ERRET(res);
+}
+#endif
+
 // writes an entry to ta LU page for corresponding logical page index
 _SPFS_STATIC int _lu_write_lpix(spfs_t *fs, pix_t lpix, uint32_t value, uint32_t wr_flags) {
   dbg("%s lpix:"_SPIPRIpg" val:"_SPIPRIid" (id:"_SPIPRIid" fl:"_SPIPRIfl")\n",
@@ -267,8 +511,22 @@ _SPFS_STATIC int _lu_write_lpix(spfs_t *fs, pix_t lpix, uint32_t value, uint32_t
   }
   uint32_t lu_entry_len = spfs_ceil(bstr8_getp(&bs), 8);
   // and write
-  return _medium_write(fs, lu_entry_addr, mem, lu_entry_len, wr_flags | SPFS_T_LU |
-                        (_SPFS_HAL_WR_FL_OVERWRITE | _SPFS_HAL_WR_FL_IGNORE_BITS));
+  int res = _medium_write(fs, lu_entry_addr, mem, lu_entry_len, wr_flags | SPFS_T_LU |
+                          (_SPFS_HAL_WR_FL_OVERWRITE | _SPFS_HAL_WR_FL_IGNORE_BITS));
+  ERR(res);
+#if SPFS_CFG_LU_MIRROR
+  // update ram mirror the same way the medium is updated, only clearing bits
+  bix_t lbix = SPFS_LPIX2LBLK(fs, lpix);
+  if (fs->run.lu_mirror && lbix < fs->run.lu_mirror_cnt) {
+    uint8_t *m = &fs->run.lu_mirror[lbix * SPFS_LU_BLK_SZ(fs) +
+                                    lu_entry_addr - SPFS_LBLK2ADDR(fs, lbix) - SPFS_BLK_HDR_SZ];
+    uint32_t i;
+    for (i = 0; i < lu_entry_len; i++) {
+      m[i] &= mem[i];
+    }
+  }
+#endif
+  return res;
 }
 
 // writes an entry to ta LU page for corresponding data page index
@@ -283,6 +541,15 @@ _SPFS_STATIC int _lu_page_allocate(spfs_t *fs, pix_t dpix, id_t id, uint8_t lu_f
   ERR(res);
   fs->run.pused++;
   fs->run.pfree--;
+#if SPFS_CFG_PFREE_BITMAP
+  _pfree_bm_mark(fs, dpix, 0);
+#endif
+#if SPFS_CFG_BLOCK_STATS
+  if (fs->run.blk_stat) {
+    fs->run.blk_stat[_dbix2lbix(fs, SPFS_DPIX2DBLK(fs, dpix))].pfree--;
+  }
+#endif
+  if (lu_flags == SPFS_LU_FL_INDEX) _id_mark(fs, id, 0);
   ERRET(res);
 }
 
@@ -313,6 +580,11 @@ _SPFS_STATIC int _lu_page_delete(spfs_t *fs, pix_t dpix) {
   }
 #endif
   fs->run.pdele++;
+#if SPFS_CFG_BLOCK_STATS
+  if (fs->run.blk_stat) {
+    fs->run.blk_stat[_dbix2lbix(fs, SPFS_DPIX2DBLK(fs, dpix))].pdele++;
+  }
+#endif
   ERRET(res);
 }
 
@@ -346,7 +618,8 @@ static void _pixhdr_rdmem(spfs_t *fs, uint8_t *mem, spfs_pixhdr_t *pixhdr) {
   (void)fs;
   bstr8 bs;
   bstr8_init(&bs, mem);
-  pixhdr->fi.size = bstr8_rd(&bs, 32);
+  pixhdr->fi.size = _pixhdr_rdmem_sz(fs, mem);
+  bstr8_setp(&bs, 32);
   pixhdr->fi.x_size = bstr8_rd(&bs, 32);
   spfs_strncpy((char *)pixhdr->name, (char *)&mem[(32+32)/8], SPFS_CFG_FILE_NAME_SZ);
   bstr8_setp(&bs, 32 + 32 + 8 * SPFS_CFG_FILE_NAME_SZ);
@@ -369,6 +642,12 @@ static void _pixhdr_wrmem(spfs_t *fs, uint8_t *mem, spfs_pixhdr_t *pixhdr) {
   bstr8_setp(&bs, 32 + 32 + 8 * SPFS_CFG_FILE_NAME_SZ);
   bstr8_wr(&bs, SPFS_PIXHDR_TYPE_BITS, pixhdr->fi.type);
   bstr8_wr(&bs, SPFS_PIXHDR_FLAG_BITS, pixhdr->fi.f_flags);
+#if SPFS_CFG_IXHDR_SZ_LOG
+  spfs_memset(&mem[SPFS_PIXHDR_SZ_LOG_OFFS], 0xff, SPFS_PIXHDR_SZ_REC_SZ*SPFS_CFG_IXHDR_SZ_LOG);
+#endif
+#if SPFS_CFG_IX_ROOT
+  spfs_memset(&mem[SPFS_PIXHDR_IX_ROOT_OFFS], 0xff, 4*SPFS_CFG_IX_ROOT);
+#endif
 #if SPFS_CFG_FILE_META_SZ
   spfs_memcpy(&mem[SPFS_PIXHDR_SZ(fs) - SPFS_CFG_FILE_META_SZ],
               pixhdr->meta, SPFS_CFG_FILE_META_SZ);
@@ -380,17 +659,55 @@ uint32_t _pixhdr_rdmem_sz(spfs_t *fs, uint8_t *mem) {
   (void)fs;
   bstr8 bs;
   bstr8_init(&bs, mem);
-  return bstr8_rd(&bs, 32);
+  uint32_t sz = bstr8_rd(&bs, 32);
+#if SPFS_CFG_IXHDR_SZ_LOG
+  // last valid size record, if any, overrides. Torn records are skipped.
+  uint32_t i;
+  bstr8_setp(&bs, 8*SPFS_PIXHDR_SZ_LOG_OFFS);
+  for (i = 0; i < SPFS_CFG_IXHDR_SZ_LOG; i++) {
+    uint32_t rec_sz = bstr8_rd(&bs, 32);
+    uint32_t rec_chk = bstr8_rd(&bs, 32);
+    if (rec_sz == SPFS_FILESZ_UNDEF && rec_chk == 0xffffffff) break;
+    if (rec_chk == ~rec_sz) sz = rec_sz;
+  }
+#endif
+  return sz;
 }
 
-// writes file size in given packed page index header memory
+// writes file size in given packed page index header memory, clearing any
+// size records
 void _pixhdr_wrmem_sz(spfs_t *fs, uint8_t *mem, uint32_t sz) {
   (void)fs;
   bstr8 bs;
   bstr8_init(&bs, mem);
   bstr8_wr(&bs, 32, sz);
+#if SPFS_CFG_IXHDR_SZ_LOG
+  spfs_memset(&mem[SPFS_PIXHDR_SZ_LOG_OFFS], 0xff, SPFS_PIXHDR_SZ_REC_SZ*SPFS_CFG_IXHDR_SZ_LOG);
+#endif
 }
 
+#if SPFS_CFG_IXHDR_SZ_LOG
+// appends file size to the size records in given packed page index header
+// memory, only clearing bits. The record is written after any torn record.
+// Returns index of the record written, or -1 if all records are used.
+int _pixhdr_logmem_sz(spfs_t *fs, uint8_t *mem, uint32_t sz) {
+  (void)fs;
+  bstr8 bs;
+  bstr8_init(&bs, mem);
+  int i, free_rec = -1;
+  for (i = SPFS_CFG_IXHDR_SZ_LOG - 1; i >= 0; i--) {
+    bstr8_setp(&bs, 8*(SPFS_PIXHDR_SZ_LOG_OFFS + SPFS_PIXHDR_SZ_REC_SZ*i));
+    if (bstr8_rd(&bs, 32) != SPFS_FILESZ_UNDEF || bstr8_rd(&bs, 32) != 0xffffffff) break;
+    free_rec = i;
+  }
+  if (free_rec < 0) return -1;
+  bstr8_setp(&bs, 8*(SPFS_PIXHDR_SZ_LOG_OFFS + SPFS_PIXHDR_SZ_REC_SZ*free_rec));
+  bstr8_wr(&bs, 32, sz);
+  bstr8_wr(&bs, 32, ~sz);
+  return free_rec;
+}
+#endif
+
 // reads page header from medium for given data page index into given struct
 _SPFS_STATIC int _page_hdr_read(spfs_t *fs, pix_t dpix, spfs_phdr_t *phdr, uint32_t rd_flags) {
   int res;
@@ -473,61 +790,248 @@ _SPFS_STATIC int _page_copy(spfs_t *fs, pix_t dst_lpix, pix_t src_lpix, uint8_t
 ///////////////////////////////////////////////////////////////////////////////
 
 
-// Traverses all lu in given range.
-// Uses work1 buffer for reading the lu pages.
-// If visit function returns SPFS_VIS_STOP, this function will return SPFS_OK.
+// unpacks cnt lu entries starting at entry index ent_ix from given lu page
+// memory into given array, using a 64 bit accumulator instead of
+// extracting each entry bit by bit
+_SPFS_STATIC void _lu_decode(spfs_t *fs, const uint8_t *lu, uint32_t ent_ix, uint32_t cnt,
+                             uint32_t *ents) {
+  const uint32_t bits = SPFS_LU_BITS(fs);
+  const uint64_t mask = ((uint64_t)1 << bits) - 1;
+  uint32_t bitpos = ent_ix * bits;
+  const uint8_t *m = &lu[bitpos / 8];
+  uint64_t acc = *m++ >> (bitpos % 8);
+  uint32_t acc_bits = 8 - (bitpos % 8);
+  uint32_t i;
+  for (i = 0; i < cnt; i++) {
+    while (acc_bits < bits) {
+      acc |= (uint64_t)(*m++) << acc_bits;
+      acc_bits += 8;
+    }
+    ents[i] = (uint32_t)(acc & mask);
+    acc >>= bits;
+    acc_bits -= bits;
+  }
+}
+
+// returns a bitmask of which entries in given decoded lu entry array that
+// matches the filter in given visitor descriptor, bit n corresponding to
+// entry n
+_SPFS_STATIC uint32_t _lu_match(spfs_t *fs, const spfs_vis_desc_t *desc, const uint32_t *ents,
+                                uint32_t cnt) {
+  uint16_t flags = desc->flags;
+  if (flags == 0) {
+    return cnt >= 32 ? 0xffffffff : ((1U << cnt) - 1);
+  }
+  if ((flags & SPFS_VIS_FL_ID) && (flags & (SPFS_VIS_FL_IX | SPFS_VIS_FL_DATA)) == 0) {
+    flags |= SPFS_VIS_FL_IX | SPFS_VIS_FL_DATA;
+  }
+  const uint32_t id_free = spfs_mask(SPFS_IDFREE, SPFS_BITS_ID(fs));
+  const uint32_t id_jour = spfs_mask(SPFS_IDJOUR, SPFS_BITS_ID(fs));
+  const uint32_t id_match = (flags & SPFS_VIS_FL_ID) ? desc->id : 0;
+  const uint32_t id_any = (flags & SPFS_VIS_FL_ID) ? 0 : 1;
+  const uint32_t f_free = (flags & SPFS_VIS_FL_FREE) ? 1 : 0;
+  const uint32_t f_dele = (flags & SPFS_VIS_FL_DELE) ? 1 : 0;
+  const uint32_t f_jour = (flags & SPFS_VIS_FL_JOUR) ? 1 : 0;
+  const uint32_t f_ix = (flags & SPFS_VIS_FL_IX) ? 1 : 0;
+  const uint32_t f_data = (flags & SPFS_VIS_FL_DATA) ? 1 : 0;
+  uint32_t match = 0;
+  uint32_t i;
+  for (i = 0; i < cnt; i++) {
+    uint32_t id = ents[i] >> SPFS_LU_FLAG_BITS;
+    uint32_t is_data = ents[i] & 1;
+    uint32_t is_free = id == id_free;
+    uint32_t is_jour = id == id_jour;
+    uint32_t is_dele = id == SPFS_IDDELE;
+    uint32_t is_real = (is_free | is_jour | is_dele) ^ 1;
+    uint32_t hit =
+        (is_free & f_free) |
+        (is_jour & f_jour) |
+        (is_dele & f_dele) |
+        (is_real & (id_any | (id == id_match)) &
+            ((is_data & f_data) | ((is_data ^ 1) & f_ix)));
+    match |= hit << i;
+  }
+  return match;
+}
+
+// Traverses all lu entries in given range once, passing the ones matching the
+// filter of each given visitor descriptor to that descriptor's visitor func.
+// The lu entries are decoded in chunks of SPFS_CFG_LU_DECODE_ENTS, and each
+// chunk is filtered and visited per descriptor in array order.
+// Uses work1 buffer for reading the lu pages, unless they are mirrored in ram.
+// If a visitor func returns SPFS_VIS_STOP, the descriptor's stopped flag is
+// set and it is not visited further. SPFS_VIS_SKIP_BLOCK only affects the
+// descriptor whose visitor returned it, and a block is only skipped entirely
+// if all remaining descriptors skip it.
+// If all descriptors are stopped, or one having stop_all set, this function
+// will return SPFS_OK.
 // If visitor reaches end page, this function will return -SPFS_ERR_VIS_END.
-_SPFS_STATIC int spfs_page_visit(spfs_t *fs, pix_t start_dpix, pix_t end_dpix, void *varg, spfs_visitor_t v,
-               uint16_t visit_flags) {
-  (void)visit_flags;
+_SPFS_STATIC int spfs_page_visit_multi(spfs_t *fs, pix_t start_dpix, pix_t end_dpix,
+                                       spfs_vis_desc_t **descs, uint8_t cnt) {
   int res = SPFS_OK;
   spfs_assert(start_dpix < (pix_t)SPFS_DPAGES_MAX(fs));
   spfs_assert(end_dpix < (pix_t)SPFS_DPAGES_MAX(fs));
+  uint32_t ents[SPFS_CFG_LU_DECODE_ENTS];
+  uint32_t rem = end_dpix > start_dpix
+      ? end_dpix - start_dpix
+      : (pix_t)SPFS_DPAGES_MAX(fs) - start_dpix + end_dpix;
+  pix_t dpix = start_dpix;
+  const uint8_t *lu = fs->run.work1;
+  uint8_t active = cnt;
+  uint8_t d;
   spfs_vis_info_t info;
   info.dpix = start_dpix;
   info.dbix = -1;
   info.lbix = -1;
   info.lupix = -1;
-  do {
+  for (d = 0; d < cnt; d++) {
+    descs[d]->stopped = 0;
+    descs[d]->skip = 0;
+  }
+  while (rem && active) {
+    const uint32_t blk_rem = SPFS_DPAGES_P_BLK(fs) - SPFS_DPIX2DBLKPIX(fs, dpix);
     // new block?
-    if (SPFS_DPIX2DBLK(fs, info.dpix) != info.dbix) {
-      info.dbix = SPFS_DPIX2DBLK(fs, info.dpix);
+    if (SPFS_DPIX2DBLK(fs, dpix) != info.dbix) {
+      info.dbix = SPFS_DPIX2DBLK(fs, dpix);
       info.lbix = _dbix2lbix(fs, info.dbix);
       info.lupix = -1;
+      for (d = 0; d < cnt; d++) {
+        spfs_vis_desc_t *desc = descs[d];
+        if (desc->stopped || desc->vblk == NULL) continue;
+        info.dpix = dpix;
+        res = desc->vblk(fs, &info, desc->varg);
+        if (res == SPFS_VIS_SKIP_BLOCK) {
+          desc->skip = blk_rem;
+        } else if (res == SPFS_VIS_STOP) {
+          desc->stopped = 1;
+          active = desc->stop_all ? 0 : active - 1;
+        } else if (res != SPFS_VIS_CONT) {
+          ERR(res);
+        }
+        res = SPFS_OK;
+        if (active == 0) break;
+      }
+      if (active == 0) break;
     }
-    // new lu page?
-    if (SPFS_DPIX2BLKLUPIX(fs, info.dpix) != info.lupix) {
-      info.lupix = SPFS_DPIX2BLKLUPIX(fs, info.dpix);
-      uint32_t addr = SPFS_LBLKLPIX2ADDR(fs, info.lbix, info.lupix);
-      uint32_t bhdr_sz = (info.lupix == 0 ? SPFS_BLK_HDR_SZ : 0);
-      res = _medium_read(fs, addr + bhdr_sz, fs->run.work1, SPFS_CFG_LPAGE_SZ(fs) - bhdr_sz,
-                         SPFS_T_LU);
-      ERR(res);
-      barr8_init(&fs->run.lu, fs->run.work1, SPFS_LU_BITS(fs));
+
+    // number of pages to advance, i.e. least number of pages any remaining
+    // descriptor wants to skip
+    uint32_t skip = (uint32_t)-1;
+    for (d = 0; d < cnt; d++) {
+      if (!descs[d]->stopped) skip = spfs_min(skip, descs[d]->skip);
     }
-    // readout the lu entry and callback
-    uint32_t ent_lu = barr8_get(&fs->run.lu, SPFS_DPIX2LUENT(fs, info.dpix));
-    if (v) res = v(fs, ent_lu, &info, varg);
-    if (res == SPFS_VIS_CONT) res = SPFS_OK;
-    if (res == SPFS_VIS_CONT_LU_RELOAD) {
-      info.dbix = -1; // indicate that we need to load the LU again
-      res = SPFS_OK;
+
+    if (skip == 0) {
+      // new lu page?
+      if (SPFS_DPIX2BLKLUPIX(fs, dpix) != info.lupix) {
+        info.lupix = SPFS_DPIX2BLKLUPIX(fs, dpix);
+#if SPFS_CFG_LU_MIRROR
+        lu = _lu_mirror(fs, info.lbix, info.lupix);
+        if (lu == NULL)
+#endif
+        {
+          uint32_t addr = SPFS_LBLKLPIX2ADDR(fs, info.lbix, info.lupix);
+          uint32_t bhdr_sz = (info.lupix == 0 ? SPFS_BLK_HDR_SZ : 0);
+          res = _medium_read(fs, addr + bhdr_sz, fs->run.work1, SPFS_CFG_LPAGE_SZ(fs) - bhdr_sz,
+                             SPFS_T_LU);
+          ERR(res);
+          lu = fs->run.work1;
+        }
+      }
+
+      // decode a chunk of entries, bounded by lu page, block and range end
+      uint32_t ent_ix = SPFS_DPIX2LUENT(fs, dpix);
+      uint32_t lu_rem = spfs_min(SPFS_LU_ENT_CNT(fs, info.lupix) - ent_ix, blk_rem);
+      uint32_t ecnt = spfs_min(lu_rem, rem);
+      ecnt = spfs_min(ecnt, SPFS_CFG_LU_DECODE_ENTS);
+      _lu_decode(fs, lu, ent_ix, ecnt, ents);
+      skip = ecnt;
+
+      for (d = 0; d < cnt; d++) {
+        spfs_vis_desc_t *desc = descs[d];
+        if (desc->stopped || desc->v == NULL || desc->skip >= ecnt) continue;
+        uint32_t match = _lu_match(fs, desc, ents, ecnt);
+        // mask out entries this descriptor skips
+        match &= ~((1U << desc->skip) - 1);
+
+        // callback for matching entries only
+        while (match) {
+          uint32_t i = spfs_ctz(match);
+          match &= match - 1;
+          info.dpix = dpix + i;
+          res = desc->v(fs, ents[i], &info, desc->varg);
+          if (res == SPFS_VIS_CONT) continue;
+          if (res == SPFS_VIS_CONT_LU_RELOAD) {
+            // rest of chunk is already decoded, load the LU again for next
+            info.lupix = -1;
+            continue;
+          }
+          if (res == SPFS_VIS_SKIP_BLOCK) {
+            desc->skip = blk_rem;
+            break;
+          }
+          if (res == SPFS_VIS_STOP) {
+            desc->stopped = 1;
+            active = desc->stop_all ? 0 : active - 1;
+            break;
+          }
+          ERR(res);
+        }
+        res = SPFS_OK;
+        if (active == 0) break;
+      }
     }
-    if (res == SPFS_VIS_STOP) break;
-    ERR(res);
 
     // go on
-    info.dpix++;
-    if (info.dpix >= (pix_t)SPFS_DPAGES_MAX(fs)) {
-      info.dpix = 0; // reached end of all data pages, wrap
+    skip = spfs_min(skip, rem);
+    for (d = 0; d < cnt; d++) {
+      descs[d]->skip = descs[d]->skip > skip ? descs[d]->skip - skip : 0;
+    }
+    rem -= skip;
+    dpix += skip;
+    if (dpix >= (pix_t)SPFS_DPAGES_MAX(fs)) {
+      dpix = 0; // reached end of all data pages, wrap
     }
-  } while (res == SPFS_OK && info.dpix != end_dpix);
-  if (res == SPFS_OK && info.dpix == end_dpix) res = -SPFS_ERR_VIS_END;
-  if (res == SPFS_VIS_STOP) res = SPFS_OK;
-  if (res == -SPFS_ERR_VIS_END) {
-    return res;
   }
-  ERRET(res);
+  if (active == 0) return SPFS_OK;
+  return -SPFS_ERR_VIS_END;
+}
+
+// Traverses all lu entries in given range passing the ones matching the
+// filter of given visitor descriptor to the visitor func.
+// Uses work1 buffer for reading the lu pages, unless they are mirrored in ram.
+// If visit function returns SPFS_VIS_STOP, this function will return SPFS_OK.
+// If visitor reaches end page, this function will return -SPFS_ERR_VIS_END.
+_SPFS_STATIC int spfs_page_visit_desc(spfs_t *fs, pix_t start_dpix, pix_t end_dpix,
+                                      spfs_vis_desc_t *desc) {
+  return spfs_page_visit_multi(fs, start_dpix, end_dpix, &desc, 1);
+}
+
+// block visitor skipping blocks without used pages according to block
+// statistics, for searches only interested in used pages
+_SPFS_STATIC int spfs_vis_blk_skip_unused(spfs_t *fs, spfs_vis_info_t *info, void *varg) {
+  (void)varg;
+#if SPFS_CFG_BLOCK_STATS
+  if (fs->run.blk_stat) {
+    spfs_blk_stat_t *stat = &fs->run.blk_stat[info->lbix];
+    if (stat->pfree + stat->pdele == SPFS_DPAGES_P_BLK(fs)) return SPFS_VIS_SKIP_BLOCK;
+  }
+#else
+  (void)fs;
+  (void)info;
+#endif
+  return SPFS_VIS_CONT;
+}
+
+// Traverses all lu in given range, passing entries matching given
+// SPFS_VIS_FL_* filter flags to the visitor func.
+// Uses work1 buffer for reading the lu pages.
+// If visit function returns SPFS_VIS_STOP, this function will return SPFS_OK.
+// If visitor reaches end page, this function will return -SPFS_ERR_VIS_END.
+_SPFS_STATIC int spfs_page_visit(spfs_t *fs, pix_t start_dpix, pix_t end_dpix, void *varg, spfs_visitor_t v,
+               uint16_t visit_flags) {
+  spfs_vis_desc_t desc = {.v = v, .varg = varg, .flags = visit_flags, .id = 0, .vblk = NULL};
+  return spfs_page_visit_desc(fs, start_dpix, end_dpix, &desc);
 }
 
 typedef struct {
@@ -535,7 +1039,6 @@ typedef struct {
   id_t bucket_range;
   id_t buckets_cnt;
   barr buckets;
-  const char *unique_name;
 } _find_free_id_varg_t;
 static int _id_find_free_v(spfs_t *fs, uint32_t lu_entry, spfs_vis_info_t *info, void *varg) {
   _find_free_id_varg_t *arg = (_find_free_id_varg_t *)varg;
@@ -547,12 +1050,7 @@ static int _id_find_free_v(spfs_t *fs, uint32_t lu_entry, spfs_vis_info_t *info,
   id = lu_entry >> SPFS_LU_FLAG_BITS;
   if (id-1 >= arg->id_offs) {
     spfs_pixhdr_t pixhdr;
-    int res;
-    if (arg->unique_name) {
-      res = _page_ixhdr_read(fs, info->dpix, &pixhdr, 0);
-    } else {
-      res = _page_hdr_read(fs, info->dpix, &pixhdr.phdr, 0);
-    }
+    int res = _page_hdr_read(fs, info->dpix, &pixhdr.phdr, 0);
     ERR(res);
     // check id redundancy
     if (pixhdr.phdr.id != id) {
@@ -568,12 +1066,6 @@ static int _id_find_free_v(spfs_t *fs, uint32_t lu_entry, spfs_vis_info_t *info,
       return SPFS_VIS_CONT;
     }
 
-    if (arg->unique_name) {
-      if (spfs_strncmp(arg->unique_name, (char *)pixhdr.name, SPFS_CFG_FILE_NAME_SZ) == 0) {
-        ERR(-SPFS_ERR_NAME_CONFLICT);
-      }
-    }
-
     // add to bucket
     id_t bucket_ix = (id - 1 - arg->id_offs) / arg->bucket_range;
     if (bucket_ix <= arg->buckets_cnt) {
@@ -584,6 +1076,152 @@ static int _id_find_free_v(spfs_t *fs, uint32_t lu_entry, spfs_vis_info_t *info,
   return SPFS_VIS_CONT;
 }
 
+typedef struct {
+  pix_t free_dpix;
+  // free pages before this are only remembered as candidate when wrapping
+  pix_t from_dpix;
+} _page_find_free_varg_t;
+static int _page_find_free_v(spfs_t *fs, uint32_t lu_entry, spfs_vis_info_t *info, void *varg) {
+  id_t id = spfs_signext(lu_entry >> SPFS_LU_FLAG_BITS, SPFS_BITS_ID(fs));
+  if (id == SPFS_IDFREE) {
+    uint32_t rix;
+    for (rix = 0; rix < _SPFS_PFREE_RESV; rix++) {
+      if (fs->run.resv.arr[rix] == info->dpix) return SPFS_VIS_CONT;
+    }
+    _page_find_free_varg_t *arg = (_page_find_free_varg_t *)varg;
+    if (info->dpix >= arg->from_dpix) {
+      arg->free_dpix = info->dpix;
+      return SPFS_VIS_STOP;
+    }
+    if (arg->free_dpix == (pix_t)-1) arg->free_dpix = info->dpix;
+  }
+  return SPFS_VIS_CONT;
+}
+#if SPFS_CFG_PFREE_BITMAP
+// marks given data page as free or not free in free page bitmap
+_SPFS_STATIC void _pfree_bm_mark(spfs_t *fs, pix_t dpix, uint8_t free) {
+  if (fs->run.pfree_bm == NULL) return;
+  if (free) {
+    fs->run.pfree_bm[dpix / 32] |= (1U << (dpix % 32));
+  } else {
+    fs->run.pfree_bm[dpix / 32] &= ~(1U << (dpix % 32));
+  }
+}
+
+// returns word of free page bitmap with reserved pages masked out
+_SPFS_STATIC uint32_t _pfree_bm_word(spfs_t *fs, uint32_t wix) {
+  uint32_t w = fs->run.pfree_bm[wix];
+  uint32_t rix;
+  for (rix = 0; rix < _SPFS_PFREE_RESV; rix++) {
+    pix_t r = fs->run.resv.arr[rix];
+    if (r != (pix_t)-1 && r / 32 == wix) w &= ~(1U << (r % 32));
+  }
+  return w;
+}
+
+// finds first free and unreserved page from cursor in free page bitmap,
+// wrapping at end
+static int _pfree_bm_find(spfs_t *fs, pix_t *dpix) {
+  const pix_t cursor = fs->run.dpix_free_page_cursor;
+  const uint32_t words = spfs_ceil((pix_t)SPFS_DPAGES_MAX(fs), 32);
+  const uint32_t cursor_wix = cursor / 32;
+  uint32_t i;
+  // cursor word is examined twice, first from cursor to word end and
+  // finally from word start to cursor
+  for (i = 0; i <= words; i++) {
+    uint32_t wix = (cursor_wix + i) % words;
+    uint32_t w = _pfree_bm_word(fs, wix);
+    if (i == 0) w &= ~((1U << (cursor % 32)) - 1);
+    if (w) {
+      *dpix = wix * 32 + spfs_ctz(w);
+      return SPFS_OK;
+    }
+  }
+  return -SPFS_ERR_VIS_END;
+}
+#endif
+
+#if SPFS_CFG_BLOCK_STATS
+// block visitor skipping blocks without free pages according to block statistics
+static int _page_find_free_vblk(spfs_t *fs, spfs_vis_info_t *info, void *varg) {
+  (void)varg;
+  return fs->run.blk_stat[info->lbix].pfree == 0 ? SPFS_VIS_SKIP_BLOCK : SPFS_VIS_CONT;
+}
+#endif
+
+// Updates ram bookkeeping of free ids. Ids marked free when there is no free
+// id bitmap are remembered in the id recycle ring.
+_SPFS_STATIC void _id_mark(spfs_t *fs, id_t id, uint8_t free) {
+  if (id == SPFS_IDDELE || id > (id_t)SPFS_MAX_ID(fs)) return;
+#if SPFS_CFG_ID_BITMAP
+  if (fs->run.id_bm) {
+    if (free) {
+      fs->run.id_bm[(id - 1) / 32] |= (1U << ((id - 1) % 32));
+    } else {
+      fs->run.id_bm[(id - 1) / 32] &= ~(1U << ((id - 1) % 32));
+    }
+    return;
+  }
+#endif
+#if SPFS_CFG_ID_RECYCLE_RING
+  const uint8_t n = SPFS_CFG_ID_RECYCLE_RING;
+  if (free) {
+    // overwrites oldest entry if full
+    fs->run.id_ring[fs->run.id_ring_ix] = id;
+    fs->run.id_ring_ix = (fs->run.id_ring_ix + 1) % n;
+    if (fs->run.id_ring_cnt < n) fs->run.id_ring_cnt++;
+  } else {
+    // forget id if in ring, moving newest entry into its place
+    uint8_t i;
+    for (i = 0; i < fs->run.id_ring_cnt; i++) {
+      uint8_t ix = (fs->run.id_ring_ix + n - 1 - i) % n;
+      if (fs->run.id_ring[ix] == id) {
+        fs->run.id_ring_ix = (fs->run.id_ring_ix + n - 1) % n;
+        fs->run.id_ring[ix] = fs->run.id_ring[fs->run.id_ring_ix];
+        fs->run.id_ring_cnt--;
+        break;
+      }
+    }
+  }
+#else
+  (void)free;
+#endif
+}
+
+// Finds a free id from ram bookkeeping, without traversing the lu pages.
+// Returns nonzero if found. The id stays free until allocated by
+// _lu_page_allocate.
+static int _id_find_free_ram(spfs_t *fs, id_t *id) {
+#if SPFS_CFG_ID_BITMAP
+  if (fs->run.id_bm) {
+    const uint32_t words = spfs_ceil(SPFS_MAX_ID(fs), 32);
+    uint32_t i;
+    for (i = 0; i < words; i++) {
+      uint32_t wix = (fs->run.id_bm_cursor + i) % words;
+      uint32_t w = fs->run.id_bm[wix];
+      if (w) {
+        fs->run.id_bm_cursor = wix;
+        *id = wix * 32 + spfs_ctz(w) + 1;
+        return 1;
+      }
+    }
+    return 0;
+  }
+#endif
+#if SPFS_CFG_ID_RECYCLE_RING
+  if (fs->run.id_ring_cnt) {
+    const uint8_t n = SPFS_CFG_ID_RECYCLE_RING;
+    *id = fs->run.id_ring[(fs->run.id_ring_ix + n - 1) % n];
+    return 1;
+  }
+#endif
+  (void)fs;
+  (void)id;
+  return 0;
+}
+
+#define _SPFS_ID_FIND_XDESCS   (2)
+
 // Finds free id.
 // 1. id_range = all possible ids
 // 2. divide work page into X-bit counters, or buckets. X is selected so all
@@ -591,7 +1229,14 @@ static int _id_find_free_v(spfs_t *fs, uint32_t lu_entry, spfs_vis_info_t *info,
 // 3. scan all media for all ids and count up corresponding counter
 // 4. if a counter is zero, we have a free id: return id
 // 5. else set id_range to ids covered by counter with lowest count, goto 2
-_SPFS_STATIC int _id_find_free(spfs_t *fs, id_t *id, const char *unique_name) {
+// The scan is skipped if the ram bookkeeping knows a free id.
+// If dpix is given, a free page is searched for in the same traversal as the
+// first id round, unless there is a free page bitmap.
+// Given extra visitor descriptors are also passed the lu entries of the first
+// round. If any of them are stopped after it, the search is abandoned and
+// SPFS_VIS_STOP is returned.
+static int _id_find_free_multi(spfs_t *fs, id_t *id, pix_t *dpix,
+                               spfs_vis_desc_t **xdescs, uint8_t xcnt) {
   // Find free id amongst unsorted id range I, having memory M.
   // Divide M into n x-bit bucket counters. Each bucket covers id range
   // i*I/n to (i+1)*I/n-1, where i = {0..n-1}.
@@ -619,9 +1264,45 @@ _SPFS_STATIC int _id_find_free(spfs_t *fs, id_t *id, const char *unique_name) {
   uint32_t *mem = (uint32_t *)fs->run.work2;
   const id_t max_id = SPFS_MAX_ID(fs);
   id_t id_cnt = max_id;
-  _find_free_id_varg_t arg = {.id_offs = 0, .unique_name = unique_name};
+  _find_free_id_varg_t arg = {.id_offs = 0};
+  spfs_vis_desc_t desc = {.v = _id_find_free_v, .varg = &arg, .flags = SPFS_VIS_FL_IX,
+                          .vblk = spfs_vis_blk_skip_unused};
+  _page_find_free_varg_t parg = {.free_dpix = (pix_t)-1, .from_dpix = fs->run.dpix_free_page_cursor};
+  spfs_vis_desc_t pdesc = {.v = _page_find_free_v, .varg = &parg, .flags = SPFS_VIS_FL_FREE,
+                           .vblk = NULL};
+  spfs_vis_desc_t *descs[_SPFS_ID_FIND_XDESCS + 2];
+  uint8_t dcnt = 0;
+  if (xcnt > _SPFS_ID_FIND_XDESCS) ERR(-SPFS_ERR_ARG);
+  while (dcnt < xcnt) {
+    // an extra descriptor stopping abandons the search, end traversal with it
+    xdescs[dcnt]->stop_all = 1;
+    descs[dcnt] = xdescs[dcnt];
+    dcnt++;
+  }
+  int id_found = _id_find_free_ram(fs, id);
+  if (!id_found) descs[dcnt++] = &desc;
+  if (dpix) {
+#if SPFS_CFG_BLOCK_STATS
+    if (fs->run.blk_stat) pdesc.vblk = _page_find_free_vblk;
+#endif
+#if SPFS_CFG_PFREE_BITMAP
+    if (fs->run.pfree_bm == NULL)
+#endif
+    {
+      descs[dcnt++] = &pdesc;
+    }
+  }
+
+  if (id_found && dcnt) {
+    // id already known, only traverse for extra descriptors and free page
+    res = spfs_page_visit_multi(fs, 0, 0, descs, dcnt);
+    if (res == -SPFS_ERR_VIS_END) res = SPFS_OK;
+    ERR(res);
+    while (xcnt) {
+      if (xdescs[--xcnt]->stopped) return SPFS_VIS_STOP;
+    }
+  }
 
-  int id_found = 0;
   while (res == SPFS_OK && !id_found) {
     uint32_t bits,bucket;
     for (bits = 0; bits < 32 && T[bits] < id_cnt/bucket_mem; bits++);
@@ -633,10 +1314,16 @@ _SPFS_STATIC int _id_find_free(spfs_t *fs, id_t *id, const char *unique_name) {
     dbg("bits:"_SPIPRIi" range:"_SPIPRIi"-"_SPIPRIi" buckets:"_SPIPRIi"\n",
         bits, arg.id_offs, arg.id_offs + arg.bucket_range, arg.buckets_cnt);
 
-    // place all ids in corresponding bucket
-    res = spfs_page_visit(fs, 0, 0, &arg, _id_find_free_v, 0);
+    // place all ids in corresponding bucket, first round also feeding the
+    // extra descriptors and the free page search
+    res = spfs_page_visit_multi(fs, 0, 0, descs, dcnt);
     if (res == -SPFS_ERR_VIS_END) res = SPFS_OK;
     ERR(res);
+    while (xcnt) {
+      if (xdescs[--xcnt]->stopped) return SPFS_VIS_STOP;
+    }
+    descs[0] = &desc;
+    dcnt = 1;
 
     // find bucket which is empty or with least ids
     id_t min_cnt = arg.bucket_range;
@@ -674,36 +1361,54 @@ _SPFS_STATIC int _id_find_free(spfs_t *fs, id_t *id, const char *unique_name) {
       arg.id_offs += cand_i * arg.bucket_range;
       id_cnt = arg.bucket_range;
     }
-    // no need scanning for the unique name more than once
-    arg.unique_name = NULL;
   } // while id not found
   if (!id_found) ERR(-SPFS_ERR_OUT_OF_IDS);
   dbg("found id:" _SPIPRIid "\n", *id);
-  ERRET(SPFS_OK);
-}
+  if (dpix == NULL) ERRET(SPFS_OK);
 
-typedef struct {
-  pix_t free_dpix;
-} _page_find_free_varg_t;
-static int _page_find_free_v(spfs_t *fs, uint32_t lu_entry, spfs_vis_info_t *info, void *varg) {
-  id_t id = spfs_signext(lu_entry >> SPFS_LU_FLAG_BITS, SPFS_BITS_ID(fs));
-  if (id == SPFS_IDFREE) {
-    uint32_t rix;
-    for (rix = 0; rix < _SPFS_PFREE_RESV; rix++) {
-      if (fs->run.resv.arr[rix] == info->dpix) return SPFS_VIS_CONT;
-    }
-    _page_find_free_varg_t *arg = (_page_find_free_varg_t *)varg;
-    arg->free_dpix = info->dpix;
-    return SPFS_VIS_STOP;
+  if (pdesc.stopped || parg.free_dpix != (pix_t)-1) {
+    // found in first round, possibly wrapped
+    fs->run.dpix_free_page_cursor = parg.free_dpix;
+    *dpix = parg.free_dpix;
+    dbg("found dpix:" _SPIPRIpg "\n", *dpix);
+  } else {
+    res = _page_find_free(fs, dpix);
   }
-  return SPFS_VIS_CONT;
+  ERRET(res);
+}
+
+_SPFS_STATIC int _id_find_free(spfs_t *fs, id_t *id) {
+  return _id_find_free_multi(fs, id, NULL, NULL, 0);
 }
+
+// Finds a free id and a free page, passing the lu entries also to given extra
+// visitor descriptors. Only one traversal is made unless the id range must be
+// narrowed. If any extra descriptor stops, SPFS_VIS_STOP is returned and
+// neither id nor page is found.
+_SPFS_STATIC int _id_page_find_free(spfs_t *fs, id_t *id, pix_t *dpix,
+                                    spfs_vis_desc_t **xdescs, uint8_t xcnt) {
+  spfs_assert(dpix);
+  return _id_find_free_multi(fs, id, dpix, xdescs, xcnt);
+}
+
 // finds a free page
 _SPFS_STATIC int _page_find_free(spfs_t *fs, pix_t *dpix) {
   int res = SPFS_OK;
-  _page_find_free_varg_t arg;
-  res = spfs_page_visit(fs, fs->run.dpix_free_page_cursor, fs->run.dpix_free_page_cursor, &arg,
-                   _page_find_free_v, 0);
+  _page_find_free_varg_t arg = {.free_dpix = (pix_t)-1, .from_dpix = 0};
+  spfs_vis_desc_t desc = {.v = _page_find_free_v, .varg = &arg, .flags = SPFS_VIS_FL_FREE,
+                          .vblk = NULL};
+#if SPFS_CFG_BLOCK_STATS
+  if (fs->run.blk_stat) desc.vblk = _page_find_free_vblk;
+#endif
+#if SPFS_CFG_PFREE_BITMAP
+  if (fs->run.pfree_bm) {
+    res = _pfree_bm_find(fs, &arg.free_dpix);
+  } else
+#endif
+  {
+    res = spfs_page_visit_desc(fs, fs->run.dpix_free_page_cursor, fs->run.dpix_free_page_cursor,
+                               &desc);
+  }
   if (res == -SPFS_ERR_VIS_END) res = -SPFS_ERR_OUT_OF_PAGES;
   ERR(res);
   dbg("found, cursor@"_SPIPRIpg" dpix:" _SPIPRIpg "\n", fs->run.dpix_free_page_cursor, arg.free_dpix);
@@ -755,18 +1460,174 @@ static int _page_find_v(spfs_t *fs, uint32_t lu_entry, spfs_vis_info_t *info, vo
   }
   return SPFS_VIS_CONT;
 }
+#if SPFS_CFG_IX_CACHE
+static spfs_ixcache_ent_t *_ixcache_slot(spfs_t *fs, id_t id, spix_t span) {
+  uint32_t h = ((uint32_t)id * 0x9e3779b1) ^ ((uint32_t)span * 0x85ebca6b);
+  h ^= h >> 16;
+  return &fs->run.ixcache[h % fs->run.ixcache_cnt];
+}
+
+// remembers data page of index page with given id and span, replacing
+// whatever was in its slot
+_SPFS_STATIC void _ixcache_put(spfs_t *fs, id_t id, spix_t span, pix_t dpix) {
+  if (fs->run.ixcache == NULL) return;
+  spfs_ixcache_ent_t *e = _ixcache_slot(fs, id, span);
+  e->id = id;
+  e->span = span;
+  e->dpix = dpix;
+}
+
+// forgets data page of index page with given id and span
+_SPFS_STATIC void _ixcache_drop(spfs_t *fs, id_t id, spix_t span) {
+  if (fs->run.ixcache == NULL) return;
+  spfs_ixcache_ent_t *e = _ixcache_slot(fs, id, span);
+  if (e->id == id && e->span == span) e->id = 0;
+}
+
+// forgets data pages of all index pages with given id
+_SPFS_STATIC void _ixcache_drop_id(spfs_t *fs, id_t id) {
+  if (fs->run.ixcache == NULL) return;
+  uint16_t i;
+  for (i = 0; i < fs->run.ixcache_cnt; i++) {
+    if (fs->run.ixcache[i].id == id) fs->run.ixcache[i].id = 0;
+  }
+}
+#endif
+
+#if SPFS_CFG_NAME_HASH || SPFS_CFG_DIR_SLOTS || SPFS_CFG_NAME_BLOOM
+// fnv-1a hash of file name
+_SPFS_STATIC uint32_t _namehash_calc(const char *name) {
+  uint32_t h = 0x811c9dc5;
+  uint32_t i;
+  for (i = 0; i < SPFS_CFG_FILE_NAME_SZ && name[i]; i++) {
+    h = (h ^ (uint8_t)name[i]) * 0x01000193;
+  }
+  return h;
+}
+#endif
+
+#if SPFS_CFG_NAME_BLOOM
+#define _SPFS_BLOOM_K   (3)
+// bit positions of name hash, derived by double hashing
+static uint32_t _bloom_bit(spfs_t *fs, uint32_t hash, uint32_t k) {
+  uint32_t h2 = ((hash >> 16) | (hash << 16)) * 0x85ebca6b | 1;
+  return (hash + k * h2) % fs->run.bloom_bits;
+}
+
+// adds name hash to the bloom filter
+_SPFS_STATIC void _bloom_add(spfs_t *fs, uint32_t hash) {
+  if (fs->run.bloom == NULL) return;
+  uint32_t k;
+  for (k = 0; k < _SPFS_BLOOM_K; k++) {
+    uint32_t bit = _bloom_bit(fs, hash, k);
+    fs->run.bloom[bit / 8] |= 1 << (bit % 8);
+  }
+}
+
+// returns nonzero if name hash may be in the bloom filter
+_SPFS_STATIC int _bloom_test(spfs_t *fs, uint32_t hash) {
+  if (fs->run.bloom == NULL) return 1;
+  uint32_t k;
+  for (k = 0; k < _SPFS_BLOOM_K; k++) {
+    uint32_t bit = _bloom_bit(fs, hash, k);
+    if ((fs->run.bloom[bit / 8] & (1 << (bit % 8))) == 0) return 0;
+  }
+  return 1;
+}
+#endif
+
+#if SPFS_CFG_NAME_HASH
+// remembers index header of file with given name hash and id, marks the
+// name hash partial if full
+_SPFS_STATIC void _namehash_put(spfs_t *fs, uint32_t hash, id_t id, pix_t dpix) {
+  if (fs->run.namehash == NULL) return;
+  uint16_t i;
+  uint16_t ix = hash % fs->run.namehash_cnt;
+  for (i = 0; i < fs->run.namehash_cnt; i++) {
+    spfs_namehash_ent_t *e = &fs->run.namehash[ix];
+    if (e->id == 0 || e->id == id) {
+      e->hash = hash;
+      e->id = id;
+      e->dpix = dpix;
+      return;
+    }
+    if (++ix == fs->run.namehash_cnt) ix = 0;
+  }
+  dbg("name hash full, id:"_SPIPRIid" not indexed\n", id);
+  fs->run.namehash_partial = 1;
+}
+
+// updates index header location of file with given id
+_SPFS_STATIC void _namehash_move(spfs_t *fs, id_t id, pix_t dpix) {
+  if (fs->run.namehash == NULL) return;
+  uint16_t i;
+  for (i = 0; i < fs->run.namehash_cnt; i++) {
+    if (fs->run.namehash[i].id == id) {
+      fs->run.namehash[i].dpix = dpix;
+      return;
+    }
+  }
+}
+
+// forgets file with given id, shifting back following entries in the probe
+// sequence so no tombstones are needed
+_SPFS_STATIC void _namehash_drop(spfs_t *fs, id_t id) {
+  if (fs->run.namehash == NULL) return;
+  const uint16_t cnt = fs->run.namehash_cnt;
+  spfs_namehash_ent_t *t = fs->run.namehash;
+  uint16_t i, j, n;
+  for (i = 0; i < cnt && t[i].id != id; i++);
+  if (i == cnt) return;
+  j = i;
+  for (n = 1; n < cnt; n++) {
+    if (++j == cnt) j = 0;
+    if (t[j].id == 0) break;
+    uint16_t home = t[j].hash % cnt;
+    // move entry to the hole unless its home lies cyclically in (i, j]
+    if (i <= j ? (home <= i || home > j) : (home <= i && home > j)) {
+      t[i] = t[j];
+      i = j;
+    }
+  }
+  t[i].id = 0;
+}
+#endif
+
 // finds a page with given id and span index, ixhdr or not, returns the data page index in dpix
 _SPFS_STATIC int spfs_page_find(spfs_t *fs, id_t id, spix_t span, uint8_t find_flags, pix_t *dpix) {
   int res = SPFS_OK;
+#if SPFS_CFG_IX_CACHE
+  if ((find_flags & SPFS_PAGE_FIND_FL_IX) && fs->run.ixcache) {
+    spfs_ixcache_ent_t *e = _ixcache_slot(fs, id, span);
+    if (e->id == id && e->span == span) {
+      // verify the page still is the index page
+      spfs_phdr_t phdr;
+      res = _page_hdr_read(fs, e->dpix, &phdr, 0);
+      ERR(res);
+      if (phdr.id == id && phdr.span == span && (phdr.p_flags & SPFS_PHDR_FL_IDX) == 0) {
+        dbg("id:" _SPIPRIid " span:" _SPIPRIsp " cached@"_SPIPRIpg"\n", id, span, e->dpix);
+        if (dpix) *dpix = e->dpix;
+        return SPFS_OK;
+      }
+      dbg("id:" _SPIPRIid " span:" _SPIPRIsp " stale@"_SPIPRIpg"\n", id, span, e->dpix);
+      e->id = 0;
+    }
+  }
+#endif
   _page_find_varg_t arg = {.id = id, .span = span, .find_flags = find_flags};
-  res = spfs_page_visit(fs, fs->run.dpix_find_cursor, fs->run.dpix_find_cursor, &arg,
-                   _page_find_v, 0);
+  spfs_vis_desc_t desc = {.v = _page_find_v, .varg = &arg, .id = id,
+      .flags = SPFS_VIS_FL_ID | ((find_flags & SPFS_PAGE_FIND_FL_IX) ? SPFS_VIS_FL_IX : 0),
+      .vblk = spfs_vis_blk_skip_unused};
+  res = spfs_page_visit_desc(fs, fs->run.dpix_find_cursor, fs->run.dpix_find_cursor, &desc);
   dbg("id:" _SPIPRIid " span:" _SPIPRIsp " flags:" _SPIPRIfl " cursor@"_SPIPRIpg" found@"_SPIPRIpg"\n",
       id, span, find_flags, fs->run.dpix_find_cursor, arg.dpix);
   if (res == -SPFS_ERR_VIS_END) res = -SPFS_ERR_PAGE_NOT_FOUND;
   ERR(res);
   if (dpix) *dpix = arg.dpix;
   fs->run.dpix_find_cursor = arg.dpix;
+#if SPFS_CFG_IX_CACHE
+  if (find_flags & SPFS_PAGE_FIND_FL_IX) _ixcache_put(fs, id, span, arg.dpix);
+#endif
   return SPFS_OK;
 }
 
@@ -812,6 +1673,19 @@ _SPFS_STATIC int _resv_free(spfs_t *fs, uint8_t rix) {
 
 // bitmanio implementation
 
+#if !defined(__GNUC__)
+// returns number of trailing zeroes, x must not be zero
+_SPFS_STATIC uint32_t _ctz32(uint32_t x) {
+  uint32_t n = 0;
+  if ((x & 0x0000ffff) == 0) { n += 16; x >>= 16; }
+  if ((x & 0x000000ff) == 0) { n += 8; x >>= 8; }
+  if ((x & 0x0000000f) == 0) { n += 4; x >>= 4; }
+  if ((x & 0x00000003) == 0) { n += 2; x >>= 2; }
+  if ((x & 0x00000001) == 0) { n += 1; }
+  return n;
+}
+#endif
+
 #define BITMANIO_STORAGE_BITS 32
 #include "bitmanio.h"
 #define BITMANIO_STORAGE_BITS BYTE
@@ -55,18 +55,18 @@
 #define SPFS_PIXHDR_TY_FILE       (0)
 // fixed size file
 #define SPFS_PIXHDR_TY_FIXFILE    (1)
-// todo fixed size rotating file
-//#define SPFS_PIXHDR_TY_ROTFILE    (2)
-// todo directory entry
-//#define SPFS_PIXHDR_TY_DIR        (3)
+// fixed size rotating file
+#define SPFS_PIXHDR_TY_ROTFILE    (2)
+// name directory file
+#define SPFS_PIXHDR_TY_DIR        (3)
 // todo link entry
 //#define SPFS_PIXHDR_TY_LINK       (4)
 
 #define SPFS_PIXHDR_FLAG_BITS     (2)
-// todo fixed size rotating file is full, length is now offset
-//#define SPFS_PIXHDR_FL_ROT_FULL   (1<<0)
 // todo file contains sensitive data
 //#define SPFS_PIXHDR_FL_SENS       (1<<1)
+// name directory file holds all files, cleared when built
+#define SPFS_PIXHDR_FL_DIR_DONE   (1<<0)
 
 // needed extra ids: FREE DELE JOUR
 #define SPFS_LU_EXTRA_IDS         (3)
@@ -95,6 +95,11 @@
 
 #define SPFS_FILESZ_UNDEF         (0xffffffff)
 
+// index root record of an index page not yet recorded
+#define SPFS_IX_ROOT_UNDEF        (0xffffffff)
+// index root record of an index page moved or removed after being recorded
+#define SPFS_IX_ROOT_STALE        (0)
+
 #define SPFS_CONFIGURED           (0xc0)
 #define SPFS_MOUNTED              (0x4d)
 #define SPFS_MOUNTED_DIRTY        (0x4e)
@@ -199,6 +204,10 @@
   ( 8 * (SPFS_CFG_LPAGE_SZ(_fs) - ((_lu_pix == 0 ? SPFS_BLK_HDR_SZ : 0))) / SPFS_LU_BITS(_fs) )
 #endif
 
+// number of bytes of lu pages per logical block, excluding block header
+#define SPFS_LU_BLK_SZ(_fs) \
+  ( SPFS_LUPAGES_P_BLK(_fs) * SPFS_CFG_LPAGE_SZ(_fs) - SPFS_BLK_HDR_SZ )
+
 // number of lu pages per logical block
 #if SPFS_CFG_DYNAMIC
 #define SPFS_LUPAGES_P_BLK(_fs) \
@@ -332,14 +341,27 @@
 #define SPFS_PHDR_SZ(_fs) \
   spfs_ceil(2 * SPFS_BITS_ID(_fs) + SPFS_PHDR_FLAG_BITS, 8)
 
+// size of a file size record in page index header, the size followed by its
+// complement so a torn record is told from a written one
+#define SPFS_PIXHDR_SZ_REC_SZ     (8)
+
+// offset of the file size records in page index header
+#define SPFS_PIXHDR_SZ_LOG_OFFS \
+  spfs_ceil(32 + \
+            32 + \
+            8*SPFS_CFG_FILE_NAME_SZ + \
+            SPFS_PIXHDR_TYPE_BITS + \
+            SPFS_PIXHDR_FLAG_BITS \
+            , 8)
+
+// offset of the index root records in page index header
+#define SPFS_PIXHDR_IX_ROOT_OFFS \
+  ( SPFS_PIXHDR_SZ_LOG_OFFS + SPFS_PIXHDR_SZ_REC_SZ*SPFS_CFG_IXHDR_SZ_LOG )
+
 // maximum page index header size
 #define SPFS_PIXHDR_MAX_SZ \
-  ( spfs_ceil(32 + \
-              32 + \
-              8*SPFS_CFG_FILE_NAME_SZ + \
-              SPFS_PIXHDR_TYPE_BITS + \
-              SPFS_PIXHDR_FLAG_BITS \
-              , 8) \
+  ( SPFS_PIXHDR_IX_ROOT_OFFS \
+    + 4*SPFS_CFG_IX_ROOT \
     + SPFS_CFG_FILE_META_SZ )
 
 // actual page index header size
@@ -384,6 +406,19 @@
       (((dspix) - SPFS_IX_ENT_CNT(fs, 0)) / SPFS_IX_ENT_CNT(fs, 1)) \
   )
 
+// returns file size as seen from the file api given file info, rotating files
+// holding no more than x_size bytes
+#define SPFS_FI_SIZE(fi) \
+  ( (fi)->type == SPFS_PIXHDR_TY_ROTFILE && (fi)->size != SPFS_FILESZ_UNDEF \
+    && (fi)->size > (fi)->x_size ? (fi)->x_size : (fi)->size \
+  )
+
+// returns ring offset of oldest byte held by given rotating file info
+#define SPFS_FI_ROT_HEAD(fi) \
+  ( (fi)->size != SPFS_FILESZ_UNDEF && (fi)->size > (fi)->x_size ? \
+      (fi)->size - (fi)->x_size : 0 \
+  )
+
 //
 // common operations and arithmetic
 //
@@ -415,6 +450,15 @@
 #define spfs_mask(x,bits) \
   ( (uint32_t)((x) & ((1<<(bits))-1)) )
 
+// count trailing zeros, x must not be zero
+#ifndef spfs_ctz
+#if defined(__GNUC__)
+#define spfs_ctz(x)                     ((uint32_t)__builtin_ctz(x))
+#else
+#define spfs_ctz(x)                     _ctz32(x)
+#endif
+#endif
+
 #ifndef spfs_memset
 #define spfs_memset(_m, _x, _n)         memset((_m),(_x),(_n))
 #endif
@@ -466,9 +510,11 @@ typedef struct {
 typedef struct {
   id_t id;
   /**
-   * Size of file. In rotating files, size of file
-   * when (flags & SPFS_PIXHDR_FL_ROT_FULL) != 0, else
-   * wrapping offset.
+   * Size of file. Rotating files are stored in a ring of x_size
+   * bytes, and size is the number of bytes written while the
+   * ring is filling. Once full, size is x_size plus the ring
+   * offset of the oldest byte, which is also where the next
+   * byte is written.
    */
   uint32_t size;
   /** max file size for fixed and rotating files */
@@ -509,6 +555,8 @@ typedef struct {
 #define SPFS_ERR_VIS_END            (_SPFS_ERR_INT+4)
 // internal return code, assert
 #define SPFS_ERR_ASSERT             (_SPFS_ERR_INT+5)
+// internal visitor return code, skip rest of current block and keep searching
+#define SPFS_VIS_SKIP_BLOCK         (_SPFS_ERR_INT+6)
 
 /** Visitor context information, passed to visitor func */
 typedef struct {
@@ -530,12 +578,72 @@ typedef struct {
  * If user returns SPFS_VS_CONT_LU_RELOAD, it means that the visitor will reload
  * the LU into workbuffer 1 before proceeding (i.e. the visitor function used
  * workbuffer 1 for other stuff)
+ * If user returns SPFS_VIS_SKIP_BLOCK, the visitor will proceed with the first
+ * entry of next block.
  * If anything else is returned, the visitor will stop and return same error code.
  */
 typedef int (*spfs_visitor_t)(spfs_t *fs, uint32_t lu_entry, spfs_vis_info_t *info, void *varg);
 
+/**
+ * Called from spfs_visit each time a new block is entered, before any LU page
+ * of the block is read. info->dpix is the first data page to be visited in
+ * the block.
+ * If user returns SPFS_VIS_CONT, the block is visited.
+ * If user returns SPFS_VIS_SKIP_BLOCK, the block is skipped.
+ * If user returns SPFS_VIS_STOP, the visitor will stop traversing the LUs.
+ * If anything else is returned, the visitor will stop and return same error code.
+ */
+typedef int (*spfs_block_visitor_t)(spfs_t *fs, spfs_vis_info_t *info, void *varg);
+
+// visitor filter flags, selecting which lu entries are passed to the visitor
+// func. Zero means all entries are visited.
+
+// visit free lu entries
+#define SPFS_VIS_FL_FREE            (1<<0)
+// visit deleted lu entries
+#define SPFS_VIS_FL_DELE            (1<<1)
+// visit journal lu entries
+#define SPFS_VIS_FL_JOUR            (1<<2)
+// visit lu entries of real ids flagged as index
+#define SPFS_VIS_FL_IX              (1<<3)
+// visit lu entries of real ids flagged as data
+#define SPFS_VIS_FL_DATA            (1<<4)
+// only visit lu entries having the id given in the visitor descriptor,
+// if neither SPFS_VIS_FL_IX nor SPFS_VIS_FL_DATA is set both are visited
+#define SPFS_VIS_FL_ID              (1<<5)
+
+/** Visitor descriptor, filtered traversal */
+typedef struct {
+  /** visitor func, may be NULL */
+  spfs_visitor_t v;
+  /** visitor func argument */
+  void *varg;
+  /** visitor filter flags, SPFS_VIS_FL_* */
+  uint16_t flags;
+  /** id to match if SPFS_VIS_FL_ID is set */
+  id_t id;
+  /** block visitor func called before each block, may be NULL */
+  spfs_block_visitor_t vblk;
+  /** set by traversal if visitor func or block visitor func returned
+      SPFS_VIS_STOP */
+  uint8_t stopped;
+  /** if set, the whole traversal ends when this descriptor is stopped */
+  uint8_t stop_all;
+  /** traversal internal, number of pages left to skip for this descriptor */
+  uint32_t skip;
+} spfs_vis_desc_t;
+
 _SPFS_STATIC int spfs_page_visit(spfs_t *fs, pix_t start_dpix, pix_t end_dpix, void *varg, spfs_visitor_t v,
                uint16_t flags);
+_SPFS_STATIC int spfs_page_visit_desc(spfs_t *fs, pix_t start_dpix, pix_t end_dpix,
+                                      spfs_vis_desc_t *desc);
+_SPFS_STATIC int spfs_page_visit_multi(spfs_t *fs, pix_t start_dpix, pix_t end_dpix,
+                                       spfs_vis_desc_t **descs, uint8_t cnt);
+_SPFS_STATIC int spfs_vis_blk_skip_unused(spfs_t *fs, spfs_vis_info_t *info, void *varg);
+_SPFS_STATIC void _lu_decode(spfs_t *fs, const uint8_t *lu, uint32_t ent_ix, uint32_t cnt,
+                             uint32_t *ents);
+_SPFS_STATIC uint32_t _lu_match(spfs_t *fs, const spfs_vis_desc_t *desc, const uint32_t *ents,
+                                uint32_t cnt);
 
 /**
  * packnum and unpacknum format
@@ -547,6 +655,9 @@ _SPFS_STATIC int spfs_page_visit(spfs_t *fs, pix_t start_dpix, pix_t end_dpix, v
  */
 _SPFS_STATIC uint8_t spfs_packnum(uint32_t x);
 _SPFS_STATIC uint32_t spfs_unpacknum(uint8_t x);
+#if !defined(__GNUC__)
+_SPFS_STATIC uint32_t _ctz32(uint32_t x);
+#endif
 
 _SPFS_STATIC uint16_t _chksum(const uint8_t *data, uint32_t len, uint16_t init_checksum);
 _SPFS_STATIC uint16_t spfs_bhdr_chksum(uint8_t *blk_hdr, uint8_t ignore_gc_state);
@@ -565,6 +676,17 @@ _SPFS_STATIC uint16_t _era_cnt_diff(uint16_t big, uint16_t small);
 _SPFS_STATIC int _medium_erase(spfs_t *fs, uint32_t addr, uint32_t len, uint32_t er_flags);
 _SPFS_STATIC int _medium_write(spfs_t *fs, uint32_t addr, const uint8_t *src, uint32_t len, uint32_t wr_flags);
 _SPFS_STATIC int _medium_read(spfs_t *fs, uint32_t addr, uint8_t *dst, uint32_t len, uint32_t rd_flags);
+#if SPFS_CFG_HAL_WRITEV
+_SPFS_STATIC int _medium_wrq_flush(spfs_t *fs);
+_SPFS_STATIC int _medium_write_q(spfs_t *fs, uint32_t addr, const uint8_t *src, uint32_t len,
+                                 uint32_t wr_flags, uint8_t copy);
+_SPFS_STATIC uint8_t _medium_wrq_begin(spfs_t *fs);
+_SPFS_STATIC int _medium_wrq_end(spfs_t *fs, uint8_t gather);
+#endif
+#if SPFS_CFG_HAL_READ_AHEAD
+_SPFS_STATIC uint8_t _medium_ra_hit(spfs_t *fs, pix_t lpix);
+_SPFS_STATIC int _medium_read_ahead(spfs_t *fs, pix_t lpix, uint32_t cnt, uint32_t rd_flags);
+#endif
 
 _SPFS_STATIC int _bhdr_write(spfs_t *fs, bix_t lbix, bix_t dbix, uint16_t era,
                              uint8_t gc_active, uint32_t wr_flags);
@@ -572,6 +694,9 @@ _SPFS_STATIC int _bhdr_rd(spfs_t *fs, bix_t lbix, spfs_bhdr_t *b, uint8_t raw[SP
 _SPFS_STATIC int _block_erase(spfs_t *fs, bix_t lbix, bix_t dbix, uint16_t era);
 
 _SPFS_STATIC int _lu_write_lpix(spfs_t *fs, pix_t lpix, uint32_t value, uint32_t wr_flags);
+#if SPFS_CFG_LU_MIRROR
+_SPFS_STATIC int _lu_mirror_load(spfs_t *fs);
+#endif
 _SPFS_STATIC int _lu_page_allocate(spfs_t *fs, pix_t dpix, id_t id, uint8_t lu_flags);
 _SPFS_STATIC int _lu_page_delete(spfs_t *fs, pix_t dpix);
 
@@ -579,12 +704,39 @@ _SPFS_STATIC void _phdr_rdmem(spfs_t *fs, uint8_t *mem, spfs_phdr_t *phdr);
 _SPFS_STATIC void _phdr_wrmem(spfs_t *fs, uint8_t *mem, spfs_phdr_t *phdr);
 _SPFS_STATIC uint32_t _pixhdr_rdmem_sz(spfs_t *fs, uint8_t *mem);
 _SPFS_STATIC void _pixhdr_wrmem_sz(spfs_t *fs, uint8_t *mem, uint32_t sz);
+#if SPFS_CFG_IXHDR_SZ_LOG
+_SPFS_STATIC int _pixhdr_logmem_sz(spfs_t *fs, uint8_t *mem, uint32_t sz);
+#endif
 _SPFS_STATIC int _page_hdr_read(spfs_t *fs, pix_t dpix, spfs_phdr_t *phdr, uint32_t rd_flags);
 _SPFS_STATIC int _page_ixhdr_read(spfs_t *fs, pix_t dpix, spfs_pixhdr_t *pixhdr, uint32_t rd_flags);
 _SPFS_STATIC int _page_copy(spfs_t *fs, pix_t dst_lpix, pix_t src_lpix, uint8_t only_data);
-_SPFS_STATIC int _id_find_free(spfs_t *fs, id_t *id, const char *unique_name);
+_SPFS_STATIC void _id_mark(spfs_t *fs, id_t id, uint8_t free);
+_SPFS_STATIC int _id_find_free(spfs_t *fs, id_t *id);
 _SPFS_STATIC int _page_find_free(spfs_t *fs, pix_t *dpix);
+_SPFS_STATIC int _id_page_find_free(spfs_t *fs, id_t *id, pix_t *dpix,
+                                    spfs_vis_desc_t **xdescs, uint8_t xcnt);
+#if SPFS_CFG_PFREE_BITMAP
+_SPFS_STATIC void _pfree_bm_mark(spfs_t *fs, pix_t dpix, uint8_t free);
+_SPFS_STATIC uint32_t _pfree_bm_word(spfs_t *fs, uint32_t wix);
+#endif
 _SPFS_STATIC int _page_allocate_free(spfs_t *fs, pix_t *dpix, id_t id, uint8_t lu_flag);
+#if SPFS_CFG_IX_CACHE
+_SPFS_STATIC void _ixcache_put(spfs_t *fs, id_t id, spix_t span, pix_t dpix);
+_SPFS_STATIC void _ixcache_drop(spfs_t *fs, id_t id, spix_t span);
+_SPFS_STATIC void _ixcache_drop_id(spfs_t *fs, id_t id);
+#endif
+#if SPFS_CFG_NAME_HASH || SPFS_CFG_DIR_SLOTS || SPFS_CFG_NAME_BLOOM
+_SPFS_STATIC uint32_t _namehash_calc(const char *name);
+#endif
+#if SPFS_CFG_NAME_BLOOM
+_SPFS_STATIC void _bloom_add(spfs_t *fs, uint32_t hash);
+_SPFS_STATIC int _bloom_test(spfs_t *fs, uint32_t hash);
+#endif
+#if SPFS_CFG_NAME_HASH
+_SPFS_STATIC void _namehash_put(spfs_t *fs, uint32_t hash, id_t id, pix_t dpix);
+_SPFS_STATIC void _namehash_move(spfs_t *fs, id_t id, pix_t dpix);
+_SPFS_STATIC void _namehash_drop(spfs_t *fs, id_t id);
+#endif
 _SPFS_STATIC int _resv_alloc(spfs_t *fs);
 _SPFS_STATIC int _resv_free(spfs_t *fs, uint8_t rix);
 
@@ -35,6 +35,58 @@
 #define SPFS_CFG_COPY_BUF_SZ            (256)
 #define SPFS_CFG_SENSITIVE_DATA         (1)
 
+// optional features, all on by default. Build with -DSPFS_T_CFG_FEATURES=0
+// to turn them all off and -DSPFS_CFG_<feature>=<n> to turn single ones
+// back on, see target test-cfgs in the makefile
+#ifndef SPFS_T_CFG_FEATURES
+#define SPFS_T_CFG_FEATURES             1
+#endif
+#ifndef SPFS_CFG_LU_MIRROR
+#define SPFS_CFG_LU_MIRROR              (SPFS_T_CFG_FEATURES ? 1 : 0)
+#endif
+#ifndef SPFS_CFG_BLOCK_STATS
+#define SPFS_CFG_BLOCK_STATS            (SPFS_T_CFG_FEATURES ? 1 : 0)
+#endif
+#ifndef SPFS_CFG_PFREE_BITMAP
+#define SPFS_CFG_PFREE_BITMAP           (SPFS_T_CFG_FEATURES ? 1 : 0)
+#endif
+#ifndef SPFS_CFG_ID_BITMAP
+#define SPFS_CFG_ID_BITMAP              (SPFS_T_CFG_FEATURES ? 1 : 0)
+#endif
+#ifndef SPFS_CFG_IX_CACHE
+#define SPFS_CFG_IX_CACHE               (SPFS_T_CFG_FEATURES ? 32 : 0)
+#endif
+#ifndef SPFS_CFG_FD_IX_CHAIN
+#define SPFS_CFG_FD_IX_CHAIN            (SPFS_T_CFG_FEATURES ? 8 : 0)
+#endif
+#ifndef SPFS_CFG_NAME_HASH
+#define SPFS_CFG_NAME_HASH              (SPFS_T_CFG_FEATURES ? 64 : 0)
+#endif
+#ifndef SPFS_CFG_DIR_SLOTS
+#define SPFS_CFG_DIR_SLOTS              (SPFS_T_CFG_FEATURES ? 64 : 0)
+#endif
+#ifndef SPFS_CFG_NAME_BLOOM
+#define SPFS_CFG_NAME_BLOOM             (SPFS_T_CFG_FEATURES ? 32 : 0)
+#endif
+#ifndef SPFS_CFG_HAL_WRITEV
+#define SPFS_CFG_HAL_WRITEV             (SPFS_T_CFG_FEATURES ? 8 : 0)
+#endif
+#ifndef SPFS_CFG_HAL_MAP
+#define SPFS_CFG_HAL_MAP                (SPFS_T_CFG_FEATURES ? 1 : 0)
+#endif
+#ifndef SPFS_CFG_HAL_READ_AHEAD
+#define SPFS_CFG_HAL_READ_AHEAD         (SPFS_T_CFG_FEATURES ? 8 : 0)
+#endif
+#ifndef SPFS_CFG_CACHE_2Q
+#define SPFS_CFG_CACHE_2Q               (SPFS_T_CFG_FEATURES ? 1 : 0)
+#endif
+#ifndef SPFS_CFG_IXHDR_SZ_LOG
+#define SPFS_CFG_IXHDR_SZ_LOG           (SPFS_T_CFG_FEATURES ? 8 : 0)
+#endif
+#ifndef SPFS_CFG_IX_ROOT
+#define SPFS_CFG_IX_ROOT                (SPFS_T_CFG_FEATURES ? 16 : 0)
+#endif
+
 #define SPFS_ERRSTR                     1
 #define SPFS_DUMP                       1
 #define SPFS_EXPORT                     1
@@ -34,6 +34,10 @@
 
 int spif_hdl;
 
+// line of the first failed check, failing the test regardless of what follows
+static int fail_line;
+#define TEST_FAIL() do { fail_line = __LINE__; goto end; } while (0)
+
 #if SPFS_TEST == 0
 #error this file can only be compiled with SPFS_TEST = 1
 #endif
@@ -141,6 +145,13 @@ static int _diff_page_ddata(spfs_t *fs, pix_t dpix1, pix_t dpix2) {
   return _diff_page_ldata(fs, _dpix2lpix(fs, dpix1), _dpix2lpix(fs, dpix2));
 }
 
+static int _data_dpix_v(spfs_t *fs, pix_t dpix, spfs_file_vis_info_t *info, void *varg) {
+  (void)fs;
+  (void)info;
+  *(pix_t *)varg = dpix;
+  return SPFS_OK;
+}
+
 static int fs_hal_erase(spfs_t *fs, uint32_t addr, uint32_t size, uint32_t flags) {
   (void)fs;
   (void)flags;
@@ -169,9 +180,32 @@ static int fs_hal_write(spfs_t *fs, uint32_t addr, const uint8_t *buf, uint32_t
   return res;
 }
 
+#if SPFS_CFG_HAL_WRITEV
+static int fs_hal_writev(spfs_t *fs, const spfs_iovec_t *iov, uint32_t cnt) {
+  int res = 0;
+  uint32_t i;
+  for (i = 0; res == 0 && i < cnt; i++) {
+    res = fs_hal_write(fs, iov[i].addr, iov[i].src, iov[i].size, iov[i].flags);
+  }
+  return res;
+}
+#endif
+
+#if SPFS_CFG_HAL_MAP
+static const uint8_t *fs_hal_map(spfs_t *fs, uint32_t addr, uint32_t size) {
+  (void)fs;
+  (void)size;
+  uint8_t *em_buf;
+  if (spif_em_dbg_get_buffer(spif_hdl, &em_buf)) return NULL;
+  return &em_buf[addr];
+}
+#endif
+
+static uint32_t hal_read_cnt;
 static int fs_hal_read(spfs_t *fs, uint32_t addr, uint8_t *buf, uint32_t size, uint32_t flags) {
   (void)fs;
   (void)flags;
+  hal_read_cnt++;
   //printf("<<< read %08x sz %08x\n", addr, size);
   uint32_t spif_em_flags = 0;
   int res = spif_em_read(spif_hdl, addr, buf, size, spif_em_flags);
@@ -182,10 +216,27 @@ static int fs_hal_read(spfs_t *fs, uint32_t addr, uint8_t *buf, uint32_t size, u
 
 }
 
+#if SPFS_CFG_HAL_READ_AHEAD
+static uint32_t hal_read_pages_cnt;
+static int fs_hal_read_pages(spfs_t *fs, uint32_t addr, uint8_t *buf, uint32_t size, uint32_t flags) {
+  if (addr % SPFS_CFG_LPAGE_SZ(fs) || size % SPFS_CFG_LPAGE_SZ(fs)
+      || SPFS_ADDR2LPIX(fs, addr) / SPFS_LPAGES_P_BLK(fs)
+         != SPFS_ADDR2LPIX(fs, addr + size - 1) / SPFS_LPAGES_P_BLK(fs)) {
+    printf("RD PAGES ERR: @ addr %08x sz %08x\n", addr, size);
+    return -1;
+  }
+  hal_read_pages_cnt++;
+  hal_read_cnt--;
+  return fs_hal_read(fs, addr, buf, size, flags);
+}
+#endif
+
 static void *_spfs_mallocs[_SPFS_MEM_TYPES];
 
 static void * fs_alloc(spfs_t *fs, spfs_mem_type_t type, uint32_t req_size, uint32_t *acq_size) {
   (void)fs;
+  // memory of a previous mount
+  free(_spfs_mallocs[type]);
   void *m = malloc(req_size);
   _spfs_mallocs[type] = m;
   *acq_size = req_size;
@@ -199,6 +250,110 @@ static void fs_free(void) {
   }
 }
 
+#if SPFS_CFG_PFREE_BITMAP
+static int _check_pfree_bm_v(spfs_t *fs, uint32_t lu_entry, spfs_vis_info_t *info, void *varg) {
+  id_t id = spfs_signext(lu_entry >> SPFS_LU_FLAG_BITS, SPFS_BITS_ID(fs));
+  uint32_t bm_free = (fs->run.pfree_bm[info->dpix / 32] >> (info->dpix % 32)) & 1;
+  if (bm_free != (id == SPFS_IDFREE)) {
+    printf("free page bitmap mismatch @ dpix %d, lu id %d, bitmap free %d\n", info->dpix, id, bm_free);
+    (*(uint32_t *)varg)++;
+  }
+  return SPFS_VIS_CONT;
+}
+
+// checks that the free page bitmap matches a scan of the lu pages, returns
+// number of mismatching pages or -1
+static int _check_pfree_bm(spfs_t *fs) {
+  uint32_t mismatches = 0;
+  if (fs->run.pfree_bm == NULL) return -1;
+  int res = spfs_page_visit(fs, 0, 0, &mismatches, _check_pfree_bm_v, 0);
+  if (res != -SPFS_ERR_VIS_END) return -1;
+  return (int)mismatches;
+}
+#endif
+
+#if SPFS_CFG_IX_ROOT
+// checks that the index root records of given file only refer to its current
+// index pages, returns number of recorded index pages or -1
+static int _check_ix_root(spfs_t *fs, const char *name) {
+  pix_t dpix_ixhdr, dpix;
+  spfs_pixhdr_t pixhdr;
+  uint8_t roots[4*SPFS_CFG_IX_ROOT];
+  int res = spfs_file_find(fs, name, &dpix_ixhdr, &pixhdr);
+  if (res < 0) return res;
+  res = _medium_read(fs, SPFS_DPIXHDR2ADDR(fs, dpix_ixhdr) + SPFS_PIXHDR_IX_ROOT_OFFS,
+                     roots, sizeof(roots), 0);
+  if (res < 0) return res;
+  bstr8 bs;
+  bstr8_init(&bs, roots);
+  spix_t ixspix;
+  int recorded = 0;
+  for (ixspix = 1; ixspix <= SPFS_CFG_IX_ROOT; ixspix++) {
+    uint32_t rec = bstr8_rd(&bs, 32);
+    if (rec == SPFS_IX_ROOT_UNDEF || rec == SPFS_IX_ROOT_STALE) continue;
+    res = spfs_page_find(fs, pixhdr.fi.id, ixspix, SPFS_PAGE_FIND_FL_IX, &dpix);
+    if (res < 0 || dpix != rec) {
+      printf("index root spix %d records dpix %d\n", ixspix, rec);
+      return -1;
+    }
+    recorded++;
+  }
+  return recorded;
+}
+#endif
+
+#if SPFS_CFG_DIR_SLOTS
+// checks that all files are found by name, returns number of files or -1
+static int _check_dir_files(spfs_t *fs) {
+  spfs_DIR d;
+  struct spfs_dirent *de;
+  struct spfs_stat st;
+  int cnt = 0;
+  int res = SPFS_opendir(fs, &d, "/");
+  if (res < 0) return res;
+  while ((de = SPFS_readdir(fs, &d))) {
+    if (de->s.type == SPFS_PIXHDR_TY_DIR) continue;
+    res = SPFS_stat(fs, de->s.name, &st);
+    if (res < 0 || st.id != de->s.id) {
+      printf("name directory misses \"%s\"\n", de->s.name);
+      cnt = -1;
+      break;
+    }
+    cnt++;
+  }
+  SPFS_closedir(fs, &d);
+  return cnt;
+}
+
+// sets the done flag of the name directory back on the emulated medium, as
+// if its building was interrupted
+static void _dir_undone(spfs_t *fs) {
+  uint8_t mask[1 + spfs_ceil(SPFS_PIXHDR_FLAG_BITS, 8)];
+  uint8_t *em_buf;
+  uint32_t i;
+  spfs_memset(mask, 0xff, sizeof(mask));
+  bstr8 bs;
+  bstr8_init(&bs, mask);
+  uint32_t bitpos_flags = 32 + 32 + 8 * SPFS_CFG_FILE_NAME_SZ + SPFS_PIXHDR_TYPE_BITS;
+  bstr8_setp(&bs, bitpos_flags % 8);
+  bstr8_wr(&bs, SPFS_PIXHDR_FLAG_BITS, 0xff & ~SPFS_PIXHDR_FL_DIR_DONE);
+  spif_em_dbg_get_buffer(spif_hdl, &em_buf);
+  uint32_t addr = SPFS_DPIXHDR2ADDR(fs, fs->run.dir_dpix) + bitpos_flags / 8;
+  for (i = 0; i < sizeof(mask); i++) em_buf[addr + i] |= ~mask[i];
+}
+
+// leaves lookups by name to the name directory until next mount
+static void _dir_only(spfs_t *fs) {
+  (void)fs;
+#if SPFS_CFG_NAME_HASH
+  fs->run.namehash = NULL;
+#endif
+#if SPFS_CFG_NAME_BLOOM
+  fs->run.bloom = NULL;
+#endif
+}
+#endif
+
 static void store_raw_image(spfs_t *fs, const char *fname) {
   int fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, S_IRUSR | S_IWUSR);
   if (fd < 0) {
@@ -246,6 +401,15 @@ int main(int argc, char **argv) {
   fscfg.read = fs_hal_read;
   fscfg.write = fs_hal_write;
   fscfg.erase = fs_hal_erase;
+#if SPFS_CFG_HAL_WRITEV
+  fscfg.writev = fs_hal_writev;
+#endif
+#if SPFS_CFG_HAL_MAP
+  fscfg.map = fs_hal_map;
+#endif
+#if SPFS_CFG_HAL_READ_AHEAD
+  fscfg.read_pages = fs_hal_read_pages;
+#endif
 #if SPFS_CFG_DYNAMIC
   fscfg.pflash_sz = SPFS_T_CFG_PSZ;
   fscfg.lblk_sz = SPFS_T_CFG_LBLK_SZ;
@@ -279,42 +443,113 @@ int main(int argc, char **argv) {
   j.id = SPFS_JOUR_ID_FCREAT;
   j.fcreat.id = 0x0001;
   res = spfs_journal_add(fs, &j);
-  if (res) goto end;
+  if (res) TEST_FAIL();
   res = spfs_journal_complete(fs, j.id);
-  if (res) goto end;
+  if (res) TEST_FAIL();
   j.id = SPFS_JOUR_ID_FMOD;
   j.fmod.id = 0x0002;
   res = spfs_journal_add(fs, &j);
-  if (res) goto end;
+  if (res) TEST_FAIL();
   res = spfs_journal_complete(fs, j.id);
-  if (res) goto end;
+  if (res) TEST_FAIL();
   j.id = SPFS_JOUR_ID_FRENAME;
   j.frename.src_id = 0x0003;
   j.frename.dst_id = 0x0004;
   res = spfs_journal_add(fs, &j);
-  if (res) goto end;
+  if (res) TEST_FAIL();
   res = spfs_journal_complete(fs, j.id);
-  if (res) goto end;
+  if (res) TEST_FAIL();
   j.id = SPFS_JOUR_ID_FRM;
   j.frm.id = 0x0005;
   res = spfs_journal_add(fs, &j);
-  if (res) goto end;
+  if (res) TEST_FAIL();
   res = spfs_journal_complete(fs, j.id);
-  if (res) goto end;
+  if (res) TEST_FAIL();
   j.id = SPFS_JOUR_ID_FTRUNC;
   j.ftrunc.id = 0x0006;
   j.ftrunc.sz = 12345678;
   res = spfs_journal_add(fs, &j);
-  if (res) goto end;
+  if (res) TEST_FAIL();
 
   fs->run.journal.bitoffs = 0;
   res = spfs_journal_read(fs);
   res = spfs_journal_complete(fs, j.id);
-  if (res) goto end;
+  if (res) TEST_FAIL();
   res = spfs_journal_read(fs);
-  if (res) goto end;
+  if (res) TEST_FAIL();
 
 
+#if SPFS_CFG_DYNAMIC
+  {
+    // the chunked lu decoder and filter agree with extracting and checking
+    // each entry by itself, for all id widths, on runs of free, deleted,
+    // journal, index and data entries crossing chunk borders
+    spfs_t lufs = *fs;
+    uint8_t lumem[SPFS_T_CFG_LPAGE_SZ];
+    uint32_t ents[SPFS_CFG_LU_DECODE_ENTS];
+    uint8_t id_bits;
+    printf("lu decode, fs id bits:%d\n", SPFS_BITS_ID(fs));
+    for (id_bits = 4; res == SPFS_OK && id_bits <= 24; id_bits++) {
+      lufs.dyn.id_bits = id_bits;
+      const uint32_t bits = SPFS_LU_BITS(&lufs);
+      const uint32_t ent_cnt = 8 * sizeof(lumem) / bits;
+      barr8 lu;
+      barr8_init(&lu, lumem, bits);
+      memset(lumem, 0xff, sizeof(lumem));
+      uint32_t e;
+      for (e = 0; e < ent_cnt; e++) {
+        // runs of 1 to 45 entries of the same kind
+        uint32_t run = e / 23 + (e / 45) * 7;
+        uint32_t id = 1 + (e / 3) % ((1 << id_bits) - 3);
+        uint32_t ent;
+        switch (run % 5) {
+        case 0: ent = spfs_mask(SPFS_IDFREE, bits); break;
+        case 1: ent = SPFS_IDDELE; break;
+        case 2: ent = (spfs_mask(SPFS_IDJOUR, id_bits) << SPFS_LU_FLAG_BITS) | SPFS_LU_FL_DATA; break;
+        case 3: ent = (id << SPFS_LU_FLAG_BITS) | SPFS_LU_FL_INDEX; break;
+        default: ent = (id << SPFS_LU_FLAG_BITS) | SPFS_LU_FL_DATA; break;
+        }
+        barr8_set(&lu, e, ent);
+      }
+      uint32_t start;
+      for (start = 0; res == SPFS_OK && start < 3 * SPFS_CFG_LU_DECODE_ENTS; start += 7) {
+        for (e = start; res == SPFS_OK && e < ent_cnt; e += SPFS_CFG_LU_DECODE_ENTS) {
+          uint32_t cnt = spfs_min(ent_cnt - e, SPFS_CFG_LU_DECODE_ENTS);
+          _lu_decode(&lufs, lumem, e, cnt, ents);
+          uint16_t flags;
+          for (flags = 0; flags < (SPFS_VIS_FL_ID << 1); flags++) {
+            spfs_vis_desc_t desc = {.flags = flags, .id = 1 + (e / 3) % ((1 << id_bits) - 3)};
+            uint32_t match = _lu_match(&lufs, &desc, ents, cnt);
+            uint32_t i;
+            for (i = 0; i < cnt; i++) {
+              uint32_t ent = barr8_get(&lu, e + i);
+              id_t id = spfs_signext(ent >> SPFS_LU_FLAG_BITS, id_bits);
+              uint8_t is_data = (ent & ((1<<SPFS_LU_FLAG_BITS)-1)) == SPFS_LU_FL_DATA;
+              uint8_t hit;
+              if (flags == 0) hit = 1;
+              else if (id == SPFS_IDFREE) hit = (flags & SPFS_VIS_FL_FREE) != 0;
+              else if (id == SPFS_IDDELE) hit = (flags & SPFS_VIS_FL_DELE) != 0;
+              else if (id == SPFS_IDJOUR) hit = (flags & SPFS_VIS_FL_JOUR) != 0;
+              else {
+                uint16_t f_type = flags & (SPFS_VIS_FL_IX | SPFS_VIS_FL_DATA);
+                if ((flags & SPFS_VIS_FL_ID) && f_type == 0) f_type = SPFS_VIS_FL_IX | SPFS_VIS_FL_DATA;
+                hit = (f_type & (is_data ? SPFS_VIS_FL_DATA : SPFS_VIS_FL_IX)) &&
+                    (!(flags & SPFS_VIS_FL_ID) || (ent >> SPFS_LU_FLAG_BITS) == desc.id);
+              }
+              if (ents[i] != ent || ((match >> i) & 1) != hit) {
+                printf("lu decode mismatch, id bits:%d ent:%d flags:%02x decoded:%08x expected:%08x match:%d\n",
+                       id_bits, e + i, flags, ents[i], ent, (match >> i) & 1);
+                res = -1;
+                TEST_FAIL();
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+#endif
+
   spfs_cfg_t cfg2;
   cfg2.read = fs_hal_read;
   spfs_probe(&cfg2, 0, 1000000, NULL);
@@ -322,7 +557,7 @@ int main(int argc, char **argv) {
   spfs_fd_t *fd;
   _fd_claim(fs, &fd);
   res = spfs_file_create(fs, fd, "somefile");
-  if (res) goto end;
+  if (res) TEST_FAIL();
   uint8_t buf[10000];
   {
     uint32_t i;
@@ -331,14 +566,14 @@ int main(int argc, char **argv) {
   printf("\n\nwrite\n\n");
   res = spfs_file_write(fs, fd, 0, 400, buf);
   printf("%d\n", res);
-  if (res < 0) goto end;
+  if (res < 0) TEST_FAIL();
   _dump_file(fs, fd, 0, fd->fi.size);
 
   printf("\n\nwrite sensitive\n\n");
   fd->fd_oflags = SPFS_O_SENS  ;
   res = spfs_file_write(fs, fd, 200, 10000, buf);
   printf("%d\n", res);
-  if (res < 0) goto end;
+  if (res < 0) TEST_FAIL();
 
   _dump_file(fs, fd, 500,500);
   uint8_t buf2[500];
@@ -347,32 +582,1187 @@ int main(int argc, char **argv) {
   fd->fd_oflags = SPFS_O_REWR;
   res = spfs_file_write(fs, fd, 500, 500, buf2);
   printf("%d\n", res);
-  if (res < 0) goto end;
+  if (res < 0) TEST_FAIL();
   _dump_file(fs, fd, 490,520);
 
   printf("\n\ntrunc\n\n");
   res = spfs_file_ftruncate(fs, fd, 100);
   printf("%d\n", res);
-  if (res < 0) goto end;
+  if (res < 0) TEST_FAIL();
   _dump_file(fs, fd, 0, 124);
 
 //  res = spfs_file_remove(fs, fd);
 //  printf("%d\n", res);
-//  if (res < 0) goto end;
+//  if (res < 0) TEST_FAIL();
 
 
   spfs_file_t fh = SPFS_open(fs, "somefile", SPFS_O_RDONLY, 0);
-  if (fh < 0) {res = fh; goto end;}
+  if (fh < 0) {res = fh; TEST_FAIL();}
   uint8_t rdbuf[120];
   res = SPFS_read(fs, fh, rdbuf, 120);
   printf("%d\n", res);
-  if (res < 0) goto end;
+  if (res < 0) TEST_FAIL();
   res = SPFS_close(fs, fh);
   printf("%d\n", res);
-  if (res < 0) goto end;
+  if (res < 0) TEST_FAIL();
+
+  fh = SPFS_open(fs, "created", SPFS_O_CREAT | SPFS_O_EXCL | SPFS_O_RDWR, 0);
+  if (fh < 0) {res = fh; TEST_FAIL();}
+  res = SPFS_close(fs, fh);
+  if (res < 0) TEST_FAIL();
+  fh = SPFS_open(fs, "created", SPFS_O_CREAT | SPFS_O_EXCL | SPFS_O_RDWR, 0);
+  if (fh != -SPFS_ERR_NAME_CONFLICT) {res = fh; TEST_FAIL();}
+  fh = SPFS_open(fs, "created", SPFS_O_CREAT | SPFS_O_RDWR, 0);
+  if (fh < 0) {res = fh; TEST_FAIL();}
+  res = SPFS_close(fs, fh);
+  if (res < 0) TEST_FAIL();
+  res = spfs_file_remove(fs, "created");
+  if (res < 0) TEST_FAIL();
+  fh = SPFS_open(fs, "recreated", SPFS_O_CREAT | SPFS_O_RDWR, 0);
+  if (fh < 0) {res = fh; TEST_FAIL();}
+  res = SPFS_close(fs, fh);
+  if (res < 0) TEST_FAIL();
+
+  // span several index pages and seek around
+  fh = SPFS_open(fs, "seeker", SPFS_O_CREAT | SPFS_O_RDWR, 0);
+  if (fh < 0) {res = fh; TEST_FAIL();}
+  {
+    uint32_t i;
+    for (i = 0; i < 4; i++) {
+      res = SPFS_write(fs, fh, buf, sizeof(buf));
+      if (res < 0) TEST_FAIL();
+    }
+    const uint32_t seeks[] = {35000, 1234, 27000, 39900, 12};
+    for (i = 0; i < sizeof(seeks)/sizeof(seeks[0]); i++) {
+      res = SPFS_lseek(fs, fh, seeks[i], SPFS_SEEK_SET);
+      if (res < 0) TEST_FAIL();
+      res = SPFS_read(fs, fh, rdbuf, 100);
+      if (res < 0) TEST_FAIL();
+      if (memcmp(rdbuf, &buf[seeks[i] % sizeof(buf)], 100)) {
+        printf("seek read mismatch @ %d\n", seeks[i]);
+        res = -1;
+        TEST_FAIL();
+      }
+    }
+#if SPFS_CFG_HAL_MAP
+    res = SPFS_lseek(fs, fh, 5000, SPFS_SEEK_SET);
+    if (res < 0) TEST_FAIL();
+    uint32_t zc_offs = 5000;
+    while (zc_offs < 35000) {
+      spfs_zc_seg_t segs[16];
+      res = SPFS_read_zc(fs, fh, segs, 16, 35000 - zc_offs);
+      if (res <= 0) {res = -1; TEST_FAIL();}
+      int s;
+      for (s = 0; s < res; s++) {
+        for (i = 0; i < segs[s].len; i++) {
+          if (segs[s].data[i] != buf[(zc_offs + i) % sizeof(buf)]) {
+            printf("zero copy read mismatch @ %d\n", zc_offs + i);
+            res = -1;
+            TEST_FAIL();
+          }
+        }
+        zc_offs += segs[s].len;
+      }
+    }
+#endif
+  }
+  spfs_fd_t *seeker_fd;
+  res = _fd_resolve(fs, fh, &seeker_fd);
+  if (res < 0) TEST_FAIL();
+  id_t seeker_id = seeker_fd->fi.id;
+#if SPFS_CFG_IX_CACHE
+  // as if an aborted write left an index page beyond the file size
+  _ixcache_put(fs, seeker_id, 100, seeker_fd->dpix_ixhdr);
+#endif
+  res = SPFS_close(fs, fh);
+  if (res < 0) TEST_FAIL();
+  res = spfs_file_remove(fs, "seeker");
+  if (res < 0) TEST_FAIL();
+#if SPFS_CFG_IX_CACHE
+  // nothing of a removed file is left in the index cache for a reused id
+  {
+    uint16_t i;
+    for (i = 0; i < fs->run.ixcache_cnt; i++) {
+      if (fs->run.ixcache[i].id == seeker_id) {res = -1; TEST_FAIL();}
+    }
+  }
+#endif
+
+  fh = SPFS_open(fs, "frags", SPFS_O_CREAT | SPFS_O_RDWR, 0);
+  if (fh < 0) {res = fh; TEST_FAIL();}
+  {
+    struct spfs_iov wriov[3] = {
+        {.iov_base = &buf[0], .iov_len = 10},
+        {.iov_base = &buf[10], .iov_len = 5000},
+        {.iov_base = &buf[5010], .iov_len = 3}};
+    uint32_t i;
+    for (i = 0; i < 2; i++) {
+      res = SPFS_writev(fs, fh, wriov, 3);
+      if (res != 5013) {res = -1; TEST_FAIL();}
+    }
+    res = SPFS_lseek(fs, fh, 0, SPFS_SEEK_SET);
+    if (res < 0) TEST_FAIL();
+    uint8_t frbuf[5013*2];
+    memset(frbuf, 0, sizeof(frbuf));
+    struct spfs_iov rdiov[3] = {
+        {.iov_base = &frbuf[0], .iov_len = 7},
+        {.iov_base = &frbuf[7], .iov_len = 0},
+        {.iov_base = &frbuf[7], .iov_len = 5013*2-7}};
+    res = SPFS_readv(fs, fh, rdiov, 3);
+    if (res != 5013*2) {res = -1; TEST_FAIL();}
+    if (memcmp(frbuf, buf, 5013) || memcmp(&frbuf[5013], buf, 5013)) {
+      printf("scatter/gather mismatch\n");
+      res = -1;
+      TEST_FAIL();
+    }
+    res = SPFS_pread(fs, fh, frbuf, 100, 5013 + 20);
+    if (res != 100) {res = -1; TEST_FAIL();}
+    res = SPFS_pwrite(fs, fh, &buf[200], 100, 5013 + 20);
+    if (res != 100) {res = -1; TEST_FAIL();}
+    res = SPFS_pread(fs, fh, &frbuf[100], 100, 5013 + 20);
+    if (res != 100) {res = -1; TEST_FAIL();}
+    if (memcmp(frbuf, &buf[20], 100) || memcmp(&frbuf[100], &buf[200], 100)) {
+      printf("positional mismatch\n");
+      res = -1;
+      TEST_FAIL();
+    }
+    res = SPFS_lseek(fs, fh, 0, SPFS_SEEK_CUR);
+    if (res != 5013*2) {
+      printf("positional offset moved to %d\n", res);
+      res = -1;
+      TEST_FAIL();
+    }
+  }
+  res = SPFS_close(fs, fh);
+  if (res < 0) TEST_FAIL();
+  res = spfs_file_remove(fs, "frags");
+  if (res < 0) TEST_FAIL();
+
+  // one gathered write with iovecs ending just before and after data page
+  // and index page boundaries
+  fh = SPFS_open(fs, "gather", SPFS_O_CREAT | SPFS_O_RDWR, 0);
+  if (fh < 0) {res = fh; TEST_FAIL();}
+  {
+    const uint32_t dpage_sz = SPFS_DPAGE_SZ(fs);
+    const uint32_t ix_end = SPFS_IXSPIX2DBYTES(fs, 0);
+    const uint32_t ends[] = {7, dpage_sz - 3, dpage_sz + 3, 3 * dpage_sz, ix_end - 3,
+                             ix_end + 5, ix_end + 2 * dpage_sz + 1, ix_end + 2 * dpage_sz + 2};
+    struct spfs_iov wriov[16];
+    uint32_t i, cnt = 0, offs = 0;
+    for (i = 0; i < sizeof(ends) / sizeof(ends[0]); i++) {
+      while (offs < ends[i]) {
+        // spread sources over buf, longer spans in several iovecs
+        uint32_t len = spfs_min(ends[i] - offs, 4000);
+        if (cnt == sizeof(wriov) / sizeof(wriov[0])) {res = -1; TEST_FAIL();}
+        wriov[cnt].iov_base = &buf[(cnt * 331) % 5000];
+        wriov[cnt].iov_len = len;
+        cnt++;
+        offs += len;
+      }
+    }
+    uint8_t *exp = malloc(offs);
+    uint8_t *rec = malloc(offs);
+    for (i = 0, offs = 0; i < cnt; i++) {
+      memcpy(&exp[offs], wriov[i].iov_base, wriov[i].iov_len);
+      offs += wriov[i].iov_len;
+    }
+    res = SPFS_writev(fs, fh, wriov, cnt);
+    if (res == (int)offs) {
+      res = SPFS_pread(fs, fh, rec, offs, 0);
+      if (res == (int)offs && memcmp(rec, exp, offs) == 0) res = SPFS_OK;
+      else res = -1;
+    } else {
+      res = -1;
+    }
+    free(exp);
+    free(rec);
+    if (res < 0) {
+      printf("gathered write mismatch\n");
+      TEST_FAIL();
+    }
+  }
+  res = SPFS_close(fs, fh);
+  if (res < 0) TEST_FAIL();
+  res = spfs_file_remove(fs, "gather");
+  if (res < 0) TEST_FAIL();
+
+  fh = SPFS_open(fs, "records", SPFS_O_CREAT | SPFS_O_APPEND | SPFS_O_RDWR, 0);
+  if (fh < 0) {res = fh; TEST_FAIL();}
+  {
+    uint32_t i;
+    for (i = 0; i < 100; i++) {
+      res = SPFS_write(fs, fh, &buf[i * 30], 30);
+      if (res != 30) {res = -1; TEST_FAIL();}
+    }
+    uint8_t recbuf[100*30];
+    res = SPFS_pread(fs, fh, recbuf, sizeof(recbuf), 0);
+    if (res != sizeof(recbuf)) {res = -1; TEST_FAIL();}
+    if (memcmp(recbuf, buf, sizeof(recbuf))) {
+      printf("record mismatch\n");
+      res = -1;
+      TEST_FAIL();
+    }
+    // records appended after a flush do not rewrite the flushed ones
+    uint32_t pdele = fs->run.pdele;
+    for (i = 100; i < 103; i++) {
+      res = SPFS_write(fs, fh, &buf[i * 30], 30);
+      if (res != 30) {res = -1; TEST_FAIL();}
+      res = SPFS_pread(fs, fh, recbuf, 30, i * 30);
+      if (res != 30 || memcmp(recbuf, &buf[i * 30], 30)) {res = -1; TEST_FAIL();}
+    }
+#if SPFS_CFG_IXHDR_SZ_LOG
+    if (fs->run.pdele != pdele) {
+      printf("appended records deleted %d pages\n", fs->run.pdele - pdele);
+      res = -1;
+      TEST_FAIL();
+    }
+#else
+    (void)pdele;
+#endif
+  }
+  res = SPFS_close(fs, fh);
+  if (res < 0) TEST_FAIL();
+  res = spfs_file_remove(fs, "records");
+  if (res < 0) TEST_FAIL();
+
+  // rotating file, holds the last 1000 bytes of a stream where byte n is
+  // (n*7 + n/256)
+  fh = SPFS_creat_rot(fs, "rotating", 1000);
+  if (fh < 0) {res = fh; TEST_FAIL();}
+  {
+    uint32_t n = 0, i;
+    uint8_t recbuf[2500];
+    uint32_t pused = 0;
+    while (n < 100000) {
+      uint32_t len = n < 20000 ? 30 : 2500;
+      for (i = 0; i < len; i++, n++) recbuf[i] = n*7 + n/256;
+      res = SPFS_write(fs, fh, recbuf, len);
+      if (res != (int)len) {res = -1; TEST_FAIL();}
+      if (n == 3000) pused = fs->run.pused;
+      // the live region may span two index pages besides the index header
+      if (n > 3000 && fs->run.pused > pused + 2) {
+        printf("rotating file grows, %d used pages\n", fs->run.pused);
+        res = -1;
+        TEST_FAIL();
+      }
+    }
+    res = SPFS_lseek(fs, fh, 0, SPFS_SEEK_END);
+    if (res != 1000) {res = -1; TEST_FAIL();}
+    res = SPFS_pread(fs, fh, recbuf, sizeof(recbuf), 0);
+    if (res != 1000) {res = -1; TEST_FAIL();}
+    for (i = 0, n -= 1000; i < 1000; i++, n++) {
+      if (recbuf[i] != (uint8_t)(n*7 + n/256)) {
+        printf("rotating file mismatch @ %d\n", i);
+        res = -1;
+        TEST_FAIL();
+      }
+    }
+    // one write spanning whole index pages, all but its end rotated out
+    struct spfs_iov iov[6];
+    for (i = 0; i < 6; i++) {
+      iov[i].iov_base = buf;
+      iov[i].iov_len = sizeof(buf);
+    }
+    res = SPFS_writev(fs, fh, iov, 6);
+    if (res != 6 * (int)sizeof(buf)) {res = -1; TEST_FAIL();}
+    if (fs->run.pused > pused + 2) {res = -1; TEST_FAIL();}
+    res = SPFS_pread(fs, fh, recbuf, sizeof(recbuf), 0);
+    if (res != 1000 || memcmp(recbuf, &buf[sizeof(buf) - 1000], 1000)) {
+      printf("rotating file mismatch\n");
+      res = -1;
+      TEST_FAIL();
+    }
+  }
+  res = SPFS_ftruncate(fs, fh, 0);
+  if (res < 0) TEST_FAIL();
+  res = SPFS_write(fs, fh, buf, 100);
+  if (res != 100) {res = -1; TEST_FAIL();}
+  res = SPFS_close(fs, fh);
+  if (res < 0) TEST_FAIL();
+  {
+    struct spfs_stat st;
+    res = SPFS_stat(fs, "rotating", &st);
+    if (res < 0) TEST_FAIL();
+    if (st.size != 100 || st.type != SPFS_PIXHDR_TY_ROTFILE) {res = -1; TEST_FAIL();}
+  }
+  res = spfs_file_remove(fs, "rotating");
+  if (res < 0) TEST_FAIL();
+
+  // rotating file over several index pages, streamed several times the medium
+  // size, where byte n is (n + n/251)
+  fh = SPFS_creat_rot(fs, "rotlong", 30000);
+  if (fh < 0) {res = fh; TEST_FAIL();}
+  {
+    uint32_t n = 0, i;
+    uint8_t recbuf[1499];
+    uint32_t pused = 0;
+    while (n < 3 * SPFS_T_CFG_PSZ) {
+      uint32_t len = 1 + n % sizeof(recbuf);
+      for (i = 0; i < len; i++, n++) recbuf[i] = n + n/251;
+      res = SPFS_write(fs, fh, recbuf, len);
+      if (res != (int)len) {
+        printf("rotating file write %d @ %d\n", res, n - len);
+        res = -1;
+        TEST_FAIL();
+      }
+      // no more than the ring is used, deleted pages are collected
+      if (fs->run.pfree < 2 * SPFS_DPAGES_P_BLK(fs)) {
+        res = spfs_gc(fs);
+        if (res < 0) TEST_FAIL();
+      }
+      if (pused == 0 && n >= 30000) pused = fs->run.pused;
+      if (pused && fs->run.pused != pused) {
+        printf("rotating file grows, %d used pages\n", fs->run.pused);
+        res = -1;
+        TEST_FAIL();
+      }
+    }
+    res = SPFS_close(fs, fh);
+    if (res < 0) TEST_FAIL();
+    res = spfs_umount(fs);
+    if (res < 0) TEST_FAIL();
+    res = spfs_mount(fs, 0, 4, 16);
+    if (res < 0) TEST_FAIL();
+    fh = SPFS_open(fs, "rotlong", SPFS_O_RDONLY, 0);
+    if (fh < 0) {res = fh; TEST_FAIL();}
+    res = SPFS_lseek(fs, fh, 0, SPFS_SEEK_END);
+    if (res != 30000) {res = -1; TEST_FAIL();}
+    res = SPFS_lseek(fs, fh, 0, SPFS_SEEK_SET);
+    if (res != 0) {res = -1; TEST_FAIL();}
+    n -= 30000;
+    while (n < 3 * SPFS_T_CFG_PSZ) {
+      res = SPFS_read(fs, fh, recbuf, sizeof(recbuf));
+      if (res <= 0) {res = -1; TEST_FAIL();}
+      for (i = 0; i < (uint32_t)res; i++, n++) {
+        if (recbuf[i] != (uint8_t)(n + n/251)) {
+          printf("rotating file mismatch @ %d\n", n);
+          res = -1;
+          TEST_FAIL();
+        }
+      }
+    }
+  }
+  res = SPFS_close(fs, fh);
+  if (res < 0) TEST_FAIL();
+  res = spfs_file_remove(fs, "rotlong");
+  if (res < 0) TEST_FAIL();
+  {
+    // collect what the stream left deleted
+    uint32_t i;
+    for (i = 0; i < SPFS_T_CFG_PSZ / SPFS_T_CFG_LBLK_SZ; i++) {
+      res = spfs_gc(fs);
+      if (res < 0) TEST_FAIL();
+    }
+  }
+
+  // preallocated fixed file, filled with records without allocating pages
+  fh = SPFS_creat_fix(fs, "fixed", 3000, 1);
+  if (fh < 0) {res = fh; TEST_FAIL();}
+  {
+    uint32_t i;
+    uint8_t recbuf[3000];
+    res = SPFS_pread(fs, fh, recbuf, sizeof(recbuf), 0);
+    if (res != sizeof(recbuf)) {res = -1; TEST_FAIL();}
+    for (i = 0; i < sizeof(recbuf); i++) {
+      if (recbuf[i] != 0xff) {res = -1; TEST_FAIL();}
+    }
+    uint32_t pfree = fs->run.pfree;
+    for (i = 0; i < 100; i++) {
+      res = SPFS_pwrite(fs, fh, &buf[i * 30], 30, i * 30);
+      if (res != 30) {res = -1; TEST_FAIL();}
+    }
+    res = SPFS_pread(fs, fh, recbuf, sizeof(recbuf), 0);
+    if (res != sizeof(recbuf) || memcmp(recbuf, buf, sizeof(recbuf))) {
+      printf("fixed file mismatch\n");
+      res = -1;
+      TEST_FAIL();
+    }
+    if (fs->run.pfree != pfree) {
+      printf("fixed file allocated %d pages\n", pfree - fs->run.pfree);
+      res = -1;
+      TEST_FAIL();
+    }
+    // setting bits cannot be done in place
+    res = SPFS_pwrite(fs, fh, &buf[1000], 30, 0);
+    if (res != 30) {res = -1; TEST_FAIL();}
+    res = SPFS_pread(fs, fh, recbuf, 30, 0);
+    if (res != 30 || memcmp(recbuf, &buf[1000], 30)) {res = -1; TEST_FAIL();}
+    res = SPFS_pwrite(fs, fh, buf, 1, 3000);
+    if (res >= 0) {res = -1; TEST_FAIL();}
+  }
+  res = SPFS_close(fs, fh);
+  if (res < 0) TEST_FAIL();
+  res = spfs_file_remove(fs, "fixed");
+  if (res < 0) TEST_FAIL();
+
+  // writes past the first index page of a preallocated file, and of a file
+  // created later in the same descriptor slot
+  {
+    const char *names[2] = {"prefixed", "reslot"};
+    uint32_t n, i;
+    struct spfs_stat st;
+    for (n = 0; n < 2; n++) {
+      if (n == 0) {
+        fh = SPFS_creat_fix(fs, names[n], 60000, 1);
+        if (fh < 0) {res = fh; TEST_FAIL();}
+      } else {
+        fh = SPFS_open(fs, names[n], SPFS_O_CREAT | SPFS_O_RDWR, 0);
+        if (fh < 0) {res = fh; TEST_FAIL();}
+        for (i = 0; i < 6; i++) {
+          res = SPFS_write(fs, fh, buf, sizeof(buf));
+          if (res != sizeof(buf)) {res = -1; TEST_FAIL();}
+        }
+      }
+      res = SPFS_lseek(fs, fh, 50000, SPFS_SEEK_SET);
+      if (res < 0) TEST_FAIL();
+      for (i = 0; i < 2; i++) {
+        res = SPFS_write(fs, fh, &buf[2000 + i * 10], 10);
+        if (res != 10) {res = -1; TEST_FAIL();}
+      }
+      res = SPFS_stat(fs, names[n], &st);
+      if (res < 0) TEST_FAIL();
+      res = SPFS_close(fs, fh);
+      if (res < 0) TEST_FAIL();
+      fh = SPFS_open(fs, names[n], SPFS_O_RDONLY, 0);
+      if (fh < 0) {res = fh; TEST_FAIL();}
+      res = SPFS_pread(fs, fh, rdbuf, 20, 50000);
+      if (res != 20 || memcmp(rdbuf, &buf[2000], 20)) {res = -1; TEST_FAIL();}
+      res = SPFS_close(fs, fh);
+      if (res < 0) TEST_FAIL();
+    }
+    for (n = 0; n < 2; n++) {
+      res = spfs_file_remove(fs, names[n]);
+      if (res < 0) TEST_FAIL();
+    }
+  }
+
+#if SPFS_CFG_NAME_HASH
+  // files with colliding name hashes, two with the same hash and one only
+  // sharing the home slot, are told apart and survive removal of each other
+  if (fs->run.namehash && !fs->run.namehash_partial) {
+    char names[3][SPFS_CFG_FILE_NAME_SZ] = {"coll1539599", "coll1722382"};
+    uint32_t i, k, hash = _namehash_calc(names[0]);
+    struct spfs_stat st;
+    if (_namehash_calc(names[1]) != hash) {res = -1; TEST_FAIL();}
+    for (i = 0; ; i++) {
+      sprintf(names[2], "slot%d", (int)i);
+      uint32_t h = _namehash_calc(names[2]);
+      if (h != hash && h % fs->run.namehash_cnt == hash % fs->run.namehash_cnt) break;
+    }
+    for (i = 0; i < 3; i++) {
+      fh = SPFS_open(fs, names[i], SPFS_O_CREAT | SPFS_O_EXCL | SPFS_O_RDWR, 0);
+      if (fh < 0) {res = fh; TEST_FAIL();}
+      res = SPFS_write(fs, fh, &buf[i * 100], 100);
+      if (res != 100) {res = -1; TEST_FAIL();}
+      res = SPFS_close(fs, fh);
+      if (res < 0) TEST_FAIL();
+    }
+    for (i = 0, k = 0; i < fs->run.namehash_cnt; i++) {
+      if (fs->run.namehash[i].id && fs->run.namehash[i].hash == hash) k++;
+    }
+    if (k != 2) {res = -1; TEST_FAIL();}
+    for (i = 0; i < 3; i++) {
+      uint8_t nbuf[100];
+      fh = SPFS_open(fs, names[i], SPFS_O_RDONLY, 0);
+      if (fh < 0) {res = fh; TEST_FAIL();}
+      res = SPFS_read(fs, fh, nbuf, sizeof(nbuf));
+      if (res != sizeof(nbuf) || memcmp(nbuf, &buf[i * 100], sizeof(nbuf))) {res = -1; TEST_FAIL();}
+      res = SPFS_close(fs, fh);
+      if (res < 0) TEST_FAIL();
+    }
+    // removing the first shifts the others back in the probe sequence
+    for (i = 0; i < 3; i++) {
+      res = SPFS_remove(fs, names[i]);
+      if (res < 0) TEST_FAIL();
+      res = SPFS_stat(fs, names[i], &st);
+      if (res != -SPFS_ERR_FILE_NOT_FOUND) {res = -1; TEST_FAIL();}
+      for (k = i + 1; k < 3; k++) {
+        res = SPFS_stat(fs, names[k], &st);
+        if (res < 0) TEST_FAIL();
+        if (strcmp(st.name, names[k]) || st.size != 100) {res = -1; TEST_FAIL();}
+      }
+    }
+    for (i = 0; i < fs->run.namehash_cnt; i++) {
+      if (fs->run.namehash[i].id && fs->run.namehash[i].hash == hash) {res = -1; TEST_FAIL();}
+    }
+    res = SPFS_OK;
+  }
+#endif
+
+#if SPFS_CFG_NAME_BLOOM
+  // names surely not present are rejected by the bloom filter without medium
+  // reads, removed names linger in the filter until it is rebuilt at mount
+  if (fs->run.bloom) {
+    char name[SPFS_CFG_FILE_NAME_SZ];
+    uint32_t i;
+    struct spfs_stat st;
+    for (i = 0; ; i++) {
+      sprintf(name, "nobloom%d", (int)i);
+      if (!_bloom_test(fs, _namehash_calc(name))) break;
+    }
+    hal_read_cnt = 0;
+    res = SPFS_stat(fs, name, &st);
+    if (res != -SPFS_ERR_FILE_NOT_FOUND || hal_read_cnt) {res = -1; TEST_FAIL();}
+    fh = SPFS_open(fs, name, SPFS_O_CREAT | SPFS_O_EXCL | SPFS_O_RDWR, 0);
+    if (fh < 0) {res = fh; TEST_FAIL();}
+    res = SPFS_close(fs, fh);
+    if (res < 0) TEST_FAIL();
+    if (!_bloom_test(fs, _namehash_calc(name))) {res = -1; TEST_FAIL();}
+    res = SPFS_remove(fs, name);
+    if (res < 0) TEST_FAIL();
+    if (!_bloom_test(fs, _namehash_calc(name))) {res = -1; TEST_FAIL();}
+    res = SPFS_stat(fs, name, &st);
+    if (res != -SPFS_ERR_FILE_NOT_FOUND) {res = -1; TEST_FAIL();}
+    res = spfs_umount(fs);
+    if (res < 0) TEST_FAIL();
+    res = spfs_mount(fs, 0, 4, 16);
+    if (res < 0) TEST_FAIL();
+    if (fs->run.bloom == NULL || _bloom_test(fs, _namehash_calc(name))) {res = -1; TEST_FAIL();}
+    if (!_bloom_test(fs, _namehash_calc("nisse"))) {res = -1; TEST_FAIL();}
+    res = SPFS_stat(fs, "nisse", &st);
+    if (res < 0) TEST_FAIL();
+    res = SPFS_OK;
+  }
+#endif
+
+#if SPFS_CFG_DIR_SLOTS
+  // the name directory finds files, also after it was left stale by a build
+  // without name directory and after its building at mount was interrupted
+  if (fs->run.dir_id) {
+    struct spfs_stat st;
+    id_t dir_id;
+    _dir_only(fs);
+    fh = SPFS_open(fs, "indir", SPFS_O_CREAT | SPFS_O_EXCL | SPFS_O_RDWR, 0);
+    if (fh < 0) {res = fh; TEST_FAIL();}
+    res = SPFS_close(fs, fh);
+    if (res < 0) TEST_FAIL();
+    res = SPFS_stat(fs, "indir", &st);
+    if (res < 0) TEST_FAIL();
+    res = SPFS_stat(fs, "notindir", &st);
+    if (res != -SPFS_ERR_FILE_NOT_FOUND) {res = -1; TEST_FAIL();}
+    {
+      // names with the same hash are told apart
+      const char *coll[2] = {"coll1539599", "coll1722382"};
+      uint32_t i;
+      for (i = 0; i < 2; i++) {
+        fh = SPFS_open(fs, coll[i], SPFS_O_CREAT | SPFS_O_EXCL | SPFS_O_RDWR, 0);
+        if (fh < 0) {res = fh; TEST_FAIL();}
+        res = SPFS_close(fs, fh);
+        if (res < 0) TEST_FAIL();
+      }
+      for (i = 0; i < 2; i++) {
+        res = SPFS_stat(fs, coll[i], &st);
+        if (res < 0 || strcmp(st.name, coll[i])) {res = -1; TEST_FAIL();}
+      }
+      for (i = 0; i < 2; i++) {
+        res = SPFS_remove(fs, coll[i]);
+        if (res < 0) TEST_FAIL();
+      }
+    }
+    fh = SPFS_open(fs, "dirgone", SPFS_O_CREAT | SPFS_O_EXCL | SPFS_O_RDWR, 0);
+    if (fh < 0) {res = fh; TEST_FAIL();}
+    res = SPFS_close(fs, fh);
+    if (res < 0) TEST_FAIL();
+    res = SPFS_remove(fs, "indir");
+    if (res < 0) TEST_FAIL();
+    res = SPFS_stat(fs, "indir", &st);
+    if (res != -SPFS_ERR_FILE_NOT_FOUND) {res = -1; TEST_FAIL();}
+
+    // files created and removed as by a build without name directory
+    dir_id = fs->run.dir_id;
+    fs->run.dir_id = 0;
+    fh = SPFS_open(fs, "undir", SPFS_O_CREAT | SPFS_O_EXCL | SPFS_O_RDWR, 0);
+    if (fh < 0) {res = fh; TEST_FAIL();}
+    res = SPFS_close(fs, fh);
+    if (res < 0) TEST_FAIL();
+    res = SPFS_remove(fs, "dirgone");
+    if (res < 0) TEST_FAIL();
+    fs->run.dir_id = dir_id;
+    res = SPFS_stat(fs, "undir", &st);
+    if (res != -SPFS_ERR_FILE_NOT_FOUND) {res = -1; TEST_FAIL();}
+    // found stale and rebuilt at mount
+    res = spfs_umount(fs);
+    if (res < 0) TEST_FAIL();
+    res = spfs_mount(fs, 0, 4, 16);
+    if (res < 0) TEST_FAIL();
+    _dir_only(fs);
+    if (fs->run.dir_id == 0) {res = -1; TEST_FAIL();}
+    res = SPFS_stat(fs, "undir", &st);
+    if (res < 0) TEST_FAIL();
+    res = SPFS_stat(fs, "dirgone", &st);
+    if (res != -SPFS_ERR_FILE_NOT_FOUND) {res = -1; TEST_FAIL();}
+    fh = SPFS_open(fs, "undir", SPFS_O_CREAT | SPFS_O_EXCL | SPFS_O_RDWR, 0);
+    if (fh >= 0) {res = -1; TEST_FAIL();}
+    if (_check_dir_files(fs) <= 0) {res = -1; TEST_FAIL();}
+
+    // building interrupted before it was marked done
+    res = SPFS_remove(fs, "undir");
+    if (res < 0) TEST_FAIL();
+    res = spfs_umount(fs);
+    if (res < 0) TEST_FAIL();
+    pix_t dir_dpix = fs->run.dir_dpix;
+    _dir_undone(fs);
+    res = spfs_mount(fs, 0, 4, 16);
+    if (res < 0) TEST_FAIL();
+    _dir_only(fs);
+    if (fs->run.dir_id == 0 || fs->run.dir_dpix == dir_dpix) {res = -1; TEST_FAIL();}
+    res = SPFS_stat(fs, "undir", &st);
+    if (res != -SPFS_ERR_FILE_NOT_FOUND) {res = -1; TEST_FAIL();}
+    if (_check_dir_files(fs) <= 0) {res = -1; TEST_FAIL();}
+    // rebuilds name hash and bloom filter
+    res = spfs_umount(fs);
+    if (res < 0) TEST_FAIL();
+    res = spfs_mount(fs, 0, 4, 16);
+    if (res < 0) TEST_FAIL();
+  }
+#endif
+
+#if SPFS_CFG_IXHDR_SZ_LOG
+  // small appends log the file size in the index header instead of replacing it
+  fh = SPFS_open(fs, "sizelog", SPFS_O_CREAT | SPFS_O_APPEND | SPFS_O_RDWR | SPFS_O_DIRECT, 0);
+  if (fh < 0) {res = fh; TEST_FAIL();}
+  {
+    uint32_t i, pdele;
+    uint8_t recbuf[1 + 10*SPFS_CFG_IXHDR_SZ_LOG];
+    res = SPFS_write(fs, fh, buf, 1);
+    if (res != 1) {res = -1; TEST_FAIL();}
+    pdele = fs->run.pdele;
+    for (i = 0; i < SPFS_CFG_IXHDR_SZ_LOG; i++) {
+      res = SPFS_write(fs, fh, &buf[1 + i * 10], 10);
+      if (res != 10) {res = -1; TEST_FAIL();}
+    }
+    if (fs->run.pdele != pdele) {
+      printf("size log deleted %d pages\n", fs->run.pdele - pdele);
+      res = -1;
+      TEST_FAIL();
+    }
+    res = SPFS_close(fs, fh);
+    if (res < 0) TEST_FAIL();
+    struct spfs_stat st;
+    res = SPFS_stat(fs, "sizelog", &st);
+    if (res < 0) TEST_FAIL();
+    if (st.size != sizeof(recbuf)) {res = -1; TEST_FAIL();}
+    fh = SPFS_open(fs, "sizelog", SPFS_O_APPEND | SPFS_O_RDWR | SPFS_O_DIRECT, 0);
+    if (fh < 0) {res = fh; TEST_FAIL();}
+    res = SPFS_read(fs, fh, recbuf, sizeof(recbuf) + 10);
+    if (res != sizeof(recbuf) || memcmp(recbuf, buf, sizeof(recbuf))) {res = -1; TEST_FAIL();}
+    // log is full, next size update replaces the index header
+    res = SPFS_write(fs, fh, buf, 10);
+    if (res != 10) {res = -1; TEST_FAIL();}
+    if (fs->run.pdele != pdele + 1) {res = -1; TEST_FAIL();}
+    // beyond the index header, the index header is still only logged to
+    for (i = 0; i < 4; i++) {
+      res = SPFS_write(fs, fh, buf, sizeof(buf));
+      if (res != sizeof(buf)) {res = -1; TEST_FAIL();}
+    }
+    pdele = fs->run.pdele;
+    for (i = 0; i < SPFS_CFG_IXHDR_SZ_LOG; i++) {
+      res = SPFS_write(fs, fh, buf, 10);
+      if (res != 10) {res = -1; TEST_FAIL();}
+    }
+    if (fs->run.pdele - pdele > 1) {
+      printf("size log deleted %d pages\n", fs->run.pdele - pdele);
+      res = -1;
+      TEST_FAIL();
+    }
+    res = SPFS_stat(fs, "sizelog", &st);
+    if (res < 0) TEST_FAIL();
+    if (st.size != sizeof(recbuf) + 10 + 4*sizeof(buf) + 10*SPFS_CFG_IXHDR_SZ_LOG) {res = -1; TEST_FAIL();}
+  }
+  res = SPFS_close(fs, fh);
+  if (res < 0) TEST_FAIL();
+  res = spfs_file_remove(fs, "sizelog");
+  if (res < 0) TEST_FAIL();
+  {
+    // a size record torn by power loss is skipped, and never reused
+    uint8_t hdr[SPFS_PIXHDR_MAX_SZ];
+    uint32_t torn = SPFS_PIXHDR_SZ_LOG_OFFS + SPFS_PIXHDR_SZ_REC_SZ;
+    spfs_memset(hdr, 0xff, sizeof(hdr));
+    _pixhdr_wrmem_sz(fs, hdr, 100);
+    if (_pixhdr_logmem_sz(fs, hdr, 200) != 0) {res = -1; TEST_FAIL();}
+    // only the size of the second record made it, not its complement
+    hdr[torn + 0] &= 0x2c;
+    hdr[torn + 1] &= 0x01;
+    if (_pixhdr_rdmem_sz(fs, hdr) != 200) {res = -1; TEST_FAIL();}
+    // complement half written
+    hdr[torn + 4] &= 0xd3;
+    if (_pixhdr_rdmem_sz(fs, hdr) != 200) {res = -1; TEST_FAIL();}
+    if (_pixhdr_logmem_sz(fs, hdr, 300) != 2) {res = -1; TEST_FAIL();}
+    if (_pixhdr_rdmem_sz(fs, hdr) != 300) {res = -1; TEST_FAIL();}
+  }
+#endif
+
+#if SPFS_CFG_IX_ROOT
+  // index pages of a large file are found by the root in its index header
+  fh = SPFS_open(fs, "ixroot", SPFS_O_CREAT | SPFS_O_RDWR | SPFS_O_DIRECT, 0);
+  if (fh < 0) {res = fh; TEST_FAIL();}
+  {
+    uint32_t i;
+    uint8_t ixbuf[sizeof(buf)];
+    for (i = 0; i < 15; i++) {
+      res = SPFS_write(fs, fh, buf, sizeof(buf));
+      if (res != sizeof(buf)) {res = -1; TEST_FAIL();}
+    }
+    res = _check_ix_root(fs, "ixroot");
+    if (res < 3) {res = -1; TEST_FAIL();}
+    // moves an index page
+    res = SPFS_pwrite(fs, fh, &buf[5000], 1000, 100000);
+    if (res != 1000) {res = -1; TEST_FAIL();}
+    res = _check_ix_root(fs, "ixroot");
+    if (res < 0) TEST_FAIL();
+    // removes index pages
+    res = SPFS_ftruncate(fs, fh, 50000);
+    if (res < 0) TEST_FAIL();
+    res = _check_ix_root(fs, "ixroot");
+    if (res < 0) TEST_FAIL();
+    for (i = 5; i < 15; i++) {
+      res = SPFS_pwrite(fs, fh, buf, sizeof(buf), i * sizeof(buf));
+      if (res != sizeof(buf)) {res = -1; TEST_FAIL();}
+    }
+    res = _check_ix_root(fs, "ixroot");
+    if (res < 0) TEST_FAIL();
+    res = SPFS_close(fs, fh);
+    if (res < 0) TEST_FAIL();
+    fh = SPFS_open(fs, "ixroot", SPFS_O_RDONLY, 0);
+    if (fh < 0) {res = fh; TEST_FAIL();}
+    for (i = 0; i < 15; i++) {
+      res = SPFS_read(fs, fh, ixbuf, sizeof(ixbuf));
+      if (res != sizeof(ixbuf) || memcmp(ixbuf, buf, sizeof(buf))) {
+        printf("index root read mismatch @ %d\n", i * (int)sizeof(buf));
+        res = -1;
+        TEST_FAIL();
+      }
+    }
+    res = SPFS_close(fs, fh);
+    if (res < 0) TEST_FAIL();
+    // a root referring to another page is not trusted, and reads do not
+    // record roots
+    pix_t dpix_ixhdr, dpix_ix1;
+    uint8_t *em_buf;
+    res = spfs_file_find(fs, "ixroot", &dpix_ixhdr, &pixhdr);
+    if (res < 0) TEST_FAIL();
+    res = spfs_page_find(fs, pixhdr.fi.id, 1, SPFS_PAGE_FIND_FL_IX, &dpix_ix1);
+    if (res < 0) TEST_FAIL();
+    uint32_t roots_addr = SPFS_DPIXHDR2ADDR(fs, dpix_ixhdr) + SPFS_PIXHDR_IX_ROOT_OFFS;
+    res = spfs_umount(fs);
+    if (res < 0) TEST_FAIL();
+    spif_em_dbg_get_buffer(spif_hdl, &em_buf);
+    spfs_memset(&em_buf[roots_addr], 0xff, 4);
+    bstr8 bs;
+    bstr8_init(&bs, &em_buf[roots_addr + 4]);
+    bstr8_wr(&bs, 32, dpix_ix1);
+    res = spfs_mount(fs, 0, 4, 16);
+    if (res < 0) TEST_FAIL();
+    fh = SPFS_open(fs, "ixroot", SPFS_O_RDONLY, 0);
+    if (fh < 0) {res = fh; TEST_FAIL();}
+    for (i = 0; i < 15; i++) {
+      res = SPFS_read(fs, fh, ixbuf, sizeof(ixbuf));
+      if (res != sizeof(ixbuf) || memcmp(ixbuf, buf, sizeof(buf))) {
+        printf("index root reused read mismatch @ %d\n", i * (int)sizeof(buf));
+        res = -1;
+        TEST_FAIL();
+      }
+    }
+    bstr8_init(&bs, &em_buf[roots_addr]);
+    if (bstr8_rd(&bs, 32) != SPFS_IX_ROOT_UNDEF) {res = -1; TEST_FAIL();}
+  }
+  res = SPFS_close(fs, fh);
+  if (res < 0) TEST_FAIL();
+  res = spfs_file_remove(fs, "ixroot");
+  if (res < 0) TEST_FAIL();
+#endif
+
+#if SPFS_CFG_HAL_READ_AHEAD
+  // sequential reads in small chunks are served from pages read ahead
+  fh = SPFS_open(fs, "readahead", SPFS_O_CREAT | SPFS_O_RDWR | SPFS_O_APPEND | SPFS_O_DIRECT, 0);
+  if (fh < 0) {res = fh; TEST_FAIL();}
+  {
+    uint32_t i;
+    uint8_t rabuf[100];
+    for (i = 0; i < 2; i++) {
+      res = SPFS_write(fs, fh, buf, sizeof(buf));
+      if (res != sizeof(buf)) {res = -1; TEST_FAIL();}
+    }
+    res = SPFS_lseek(fs, fh, 0, SPFS_SEEK_SET);
+    if (res < 0) TEST_FAIL();
+    hal_read_cnt = 0;
+    hal_read_pages_cnt = 0;
+    for (i = 0; i < 2*sizeof(buf)/sizeof(rabuf); i++) {
+      res = SPFS_read(fs, fh, rabuf, sizeof(rabuf));
+      if (res != sizeof(rabuf)
+          || memcmp(rabuf, &buf[(i * sizeof(rabuf)) % sizeof(buf)], sizeof(rabuf))) {
+        printf("read ahead mismatch @ %d\n", i * (int)sizeof(rabuf));
+        res = -1;
+        TEST_FAIL();
+      }
+    }
+    if (hal_read_pages_cnt == 0 || hal_read_cnt + hal_read_pages_cnt > 2*sizeof(buf)/sizeof(rabuf)/2) {
+      printf("read ahead, %d reads, %d page reads\n", hal_read_cnt, hal_read_pages_cnt);
+      res = -1;
+      TEST_FAIL();
+    }
+    // data written in place of pages read ahead is read back
+    res = SPFS_write(fs, fh, &buf[500], 50);
+    if (res != 50) {res = -1; TEST_FAIL();}
+    res = SPFS_pread(fs, fh, rabuf, sizeof(rabuf), 2*sizeof(buf) - 50);
+    if (res != sizeof(rabuf) || memcmp(rabuf, &buf[sizeof(buf) - 50], 50)
+        || memcmp(&rabuf[50], &buf[500], 50)) {
+      res = -1;
+      TEST_FAIL();
+    }
+  }
+  res = SPFS_close(fs, fh);
+  if (res < 0) TEST_FAIL();
+  res = spfs_file_remove(fs, "readahead");
+  if (res < 0) TEST_FAIL();
+#endif
+
+  // medium writes update or drop the read cache pages covering them, also
+  // when a gathered write fails, and cached lu pages are read without HAL reads
+  if (fs->run.cache) {
+    uint8_t *em_buf;
+    spif_em_dbg_get_buffer(spif_hdl, &em_buf);
+    uint8_t rcbuf[SPFS_T_CFG_LPAGE_SZ];
+    const uint8_t pat[8] = {0x5a, 0x00, 0xa5, 0x0f, 0xf0, 0x3c, 0xc3, 0x81};
+    const uint8_t ones[8] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+    spfs_cache_page *p;
+    pix_t dpix;
+    fh = SPFS_open(fs, "rcfile", SPFS_O_CREAT | SPFS_O_RDWR, 0);
+    if (fh < 0) {res = fh; TEST_FAIL();}
+    res = SPFS_write(fs, fh, buf, 100);
+    if (res < 0) TEST_FAIL();
+    res = SPFS_close(fs, fh);
+    if (res < 0) TEST_FAIL();
+    res = spfs_file_find(fs, "rcfile", &dpix, &pixhdr);
+    if (res < 0) TEST_FAIL();
+    // the index header also is span 0, so get the data page from the index
+    res = spfs_file_visit(fs, &pixhdr.fi, dpix, 0, 1, 0, &dpix, _data_dpix_v, NULL, 0);
+    if (res < 0) TEST_FAIL();
+    // the data page is erased after the file data
+    const pix_t lpix = _dpix2lpix(fs, dpix);
+    const uint32_t addr = SPFS_LPIX2ADDR(fs, lpix);
+
+    res = _medium_read(fs, addr, rcbuf, 16, SPFS_T_META);
+    if (res < 0) TEST_FAIL();
+    if (spfs_cache_rdpage_lookup(fs, lpix) == NULL) {res = -1; TEST_FAIL();}
+    res = _medium_write(fs, addr + 150, pat, sizeof(pat), SPFS_T_DATA);
+    if (res < 0) TEST_FAIL();
+    p = spfs_cache_rdpage_lookup(fs, lpix);
+    if (p && memcmp(p->buf, &em_buf[addr], SPFS_CFG_LPAGE_SZ(fs))) {res = -1; TEST_FAIL();}
+    // writing over written data fails, the medium is then unknown
+    res = _medium_write(fs, addr + 150, ones, sizeof(ones), SPFS_T_DATA);
+    if (res == SPFS_OK) {res = -1; TEST_FAIL();}
+    if (spfs_cache_rdpage_lookup(fs, lpix)) {res = -1; TEST_FAIL();}
+
+#if SPFS_CFG_HAL_WRITEV
+    res = _medium_read(fs, addr, rcbuf, 16, SPFS_T_META);
+    if (res < 0) TEST_FAIL();
+    uint8_t gather = _medium_wrq_begin(fs);
+    res = _medium_write_q(fs, addr + 160, pat, sizeof(pat), SPFS_T_DATA, 1);
+    if (res < 0) TEST_FAIL();
+    res = _medium_write_q(fs, addr + 150, ones, sizeof(ones), SPFS_T_DATA, 1);
+    if (res < 0) TEST_FAIL();
+    p = spfs_cache_rdpage_lookup(fs, lpix);
+    if (p == NULL || memcmp(&p->buf[160], pat, sizeof(pat))) {res = -1; TEST_FAIL();}
+    res = _medium_wrq_end(fs, gather);
+    if (res == SPFS_OK) {res = -1; TEST_FAIL();}
+    if (spfs_cache_rdpage_lookup(fs, lpix)) {res = -1; TEST_FAIL();}
+#endif
+
+    const uint32_t lu_addr = SPFS_LBLKLPIX2ADDR(fs, lpix / SPFS_LPAGES_P_BLK(fs), 0) + SPFS_BLK_HDR_SZ;
+    const uint32_t lu_len = SPFS_CFG_LPAGE_SZ(fs) - SPFS_BLK_HDR_SZ;
+    res = _medium_read(fs, lu_addr, rcbuf, lu_len, SPFS_T_LU);
+    if (res < 0) TEST_FAIL();
+    hal_read_cnt = 0;
+#if SPFS_CFG_HAL_READ_AHEAD
+    hal_read_pages_cnt = 0;
+#endif
+    memset(rcbuf, 0, sizeof(rcbuf));
+    res = _medium_read(fs, lu_addr, rcbuf, lu_len, SPFS_T_LU);
+    if (res < 0) TEST_FAIL();
+    if (hal_read_cnt || memcmp(rcbuf, &em_buf[lu_addr], lu_len)) {res = -1; TEST_FAIL();}
+#if SPFS_CFG_HAL_READ_AHEAD
+    if (hal_read_pages_cnt) {res = -1; TEST_FAIL();}
+#endif
+    res = spfs_file_remove(fs, "rcfile");
+    if (res < 0) TEST_FAIL();
+  }
+
+  // cache page hash table, colliding keys probing past the end of the table,
+  // removal and eviction, on a private cache
+  {
+    spfs_t cfs = *fs;
+    const uint32_t cpages = 8;
+    const uint32_t csz = spfs_align(sizeof(spfs_cache), SPFS_ALIGN) + cpages * SPFS_CACHE_PAGE_MEM_SZ(fs);
+    void *cmem = malloc(csz);
+    spfs_cache_page *p;
+    uint32_t i, k;
+    spfs_cache_init(&cfs, cmem, csz);
+    spfs_cache *c = (spfs_cache *)cfs.run.cache;
+    if (c == NULL || cfs.run.cache_cnt != cpages) {free(cmem); res = -1; TEST_FAIL();}
+    // colliding keys of read pages differ by half the table size, find a key
+    // homed in one of the two last slots so the probing wraps
+    const uint32_t step = (c->hmask + 1) / 2;
+    for (k = 0; ; k++) {
+      spfs_cache_page_claim(&cfs, SPFS_CACHE_FL_TYPE_RD, k, &p);
+      uint8_t last = c->htab[c->hmask] == p || c->htab[c->hmask - 1] == p;
+      spfs_cache_page_drop(&cfs, p);
+      if (last) break;
+    }
+    for (i = 0; i < cpages; i++) {
+      spfs_cache_page_claim(&cfs, SPFS_CACHE_FL_TYPE_RD, k + i * step, &p);
+      if (p == NULL) {free(cmem); res = -1; TEST_FAIL();}
+    }
+    if (c->htab[0] == NULL) {free(cmem); res = -1; TEST_FAIL();}
+    for (i = 0; i < cpages; i++) {
+      p = spfs_cache_rdpage_lookup(&cfs, k + i * step);
+      if (p == NULL || p->lpix != k + i * step) {free(cmem); res = -1; TEST_FAIL();}
+    }
+    // same key as write page is another entry
+    if (spfs_cache_wrpage_lookup(&cfs, k)) {free(cmem); res = -1; TEST_FAIL();}
+    // remove from the middle of the probe sequence
+    spfs_cache_page_drop(&cfs, spfs_cache_rdpage_lookup(&cfs, k + 2 * step));
+    for (i = 0; i < cpages; i++) {
+      p = spfs_cache_rdpage_lookup(&cfs, k + i * step);
+      if ((p == NULL) != (i == 2) || (p && p->lpix != k + i * step)) {free(cmem); res = -1; TEST_FAIL();}
+    }
+    // evict, the cache keeps as many pages as it has of all claimed
+    for (i = cpages; i < 3 * cpages; i++) {
+      spfs_cache_page_claim(&cfs, SPFS_CACHE_FL_TYPE_RD, k + i * step, &p);
+      if (p == NULL) {free(cmem); res = -1; TEST_FAIL();}
+    }
+    uint32_t found = 0;
+    for (i = 0; i < 3 * cpages; i++) {
+      p = spfs_cache_rdpage_lookup(&cfs, k + i * step);
+      if (p && p->lpix != k + i * step) {free(cmem); res = -1; TEST_FAIL();}
+      if (p) found++;
+    }
+    if (found != cpages || spfs_cache_rdpage_lookup(&cfs, k + 3 * cpages * step - step) == NULL) {
+      free(cmem);
+      res = -1;
+      TEST_FAIL();
+    }
+    free(cmem);
+  }
+
+  // write cache pages are looked up by file id and hold their file offset,
+  // the first file is written through and then rewritten in its second page
+  if (fs->run.cache) {
+    spfs_file_t wfh[2];
+    id_t wid[2];
+    const uint32_t wlen[2] = {500, 30};
+    const uint32_t woffs[2] = {SPFS_DPAGE_SZ(fs) + 10, 10};
+    uint32_t i;
+    for (i = 0; i < 2; i++) {
+      char name[16];
+      sprintf(name, "wcfile%d", (int)i);
+      wfh[i] = SPFS_open(fs, name, SPFS_O_CREAT | SPFS_O_RDWR, 0);
+      if (wfh[i] < 0) {res = wfh[i]; TEST_FAIL();}
+      res = spfs_file_find(fs, name, NULL, &pixhdr);
+      if (res < 0) TEST_FAIL();
+      wid[i] = pixhdr.fi.id;
+      res = SPFS_write(fs, wfh[i], buf, wlen[i]);
+      if (res < 0) TEST_FAIL();
+      res = SPFS_pwrite(fs, wfh[i], &buf[1000], 20, woffs[i]);
+      if (res < 0) TEST_FAIL();
+    }
+    for (i = 0; i < 2; i++) {
+      spfs_cache_page *p = spfs_cache_wrpage_lookup(fs, wid[i]);
+      uint32_t offs = wlen[i] >= SPFS_DPAGE_SZ(fs) ? woffs[i] : 0;
+      uint32_t size = wlen[i] >= SPFS_DPAGE_SZ(fs) ? 20 : spfs_max(wlen[i], woffs[i] + 20);
+      if (p == NULL || p->id != wid[i] || p->offset != offs || p->size != size
+          || memcmp(&p->buf[woffs[i] - offs], &buf[1000], 20)) {
+        res = -1;
+        TEST_FAIL();
+      }
+    }
+    for (i = 0; i < 2; i++) {
+      char name[16];
+      sprintf(name, "wcfile%d", (int)i);
+      res = SPFS_close(fs, wfh[i]);
+      if (res < 0) TEST_FAIL();
+      if (spfs_cache_wrpage_lookup(fs, wid[i])) {res = -1; TEST_FAIL();}
+      fh = SPFS_open(fs, name, SPFS_O_RDONLY, 0);
+      if (fh < 0) {res = fh; TEST_FAIL();}
+      res = SPFS_pread(fs, fh, rdbuf, 20, woffs[i]);
+      if (res != 20 || memcmp(rdbuf, &buf[1000], 20)) {res = -1; TEST_FAIL();}
+      res = SPFS_close(fs, fh);
+      if (res < 0) TEST_FAIL();
+      res = spfs_file_remove(fs, name);
+      if (res < 0) TEST_FAIL();
+    }
+  }
+
+  // read cache hit rates, a hot set of files is looked up while the medium is
+  // scanned by reading the directory
+  if (fs->run.cache) {
+    spfs_cache *c = (spfs_cache *)fs->run.cache;
+    char name[16];
+    uint32_t i, r;
+    uint32_t hot_hits = 0, hot_lookups = 0;
+    for (i = 0; i < 24; i++) {
+      sprintf(name, "bench%02d", i);
+      fh = SPFS_open(fs, name, SPFS_O_CREAT | SPFS_O_RDWR, 0);
+      if (fh < 0) {res = fh; TEST_FAIL();}
+      res = SPFS_write(fs, fh, buf, 100);
+      if (res < 0) TEST_FAIL();
+      res = SPFS_close(fs, fh);
+      if (res < 0) TEST_FAIL();
+    }
+    c->hits = 0;
+    c->misses = 0;
+    for (r = 0; r < 20; r++) {
+      for (i = 0; i < 4; i++) {
+        uint32_t hits = c->hits;
+        uint32_t misses = c->misses;
+        sprintf(name, "bench%02d", i * 6);
+        fh = SPFS_open(fs, name, SPFS_O_RDONLY, 0);
+        if (fh < 0) {res = fh; TEST_FAIL();}
+        res = SPFS_read(fs, fh, rdbuf, 100);
+        if (res < 0) TEST_FAIL();
+        res = SPFS_close(fs, fh);
+        if (res < 0) TEST_FAIL();
+        hot_hits += c->hits - hits;
+        hot_lookups += c->hits - hits + c->misses - misses;
+      }
+      if ((r & 1) == 0) {
+        spfs_DIR d;
+        res = SPFS_opendir(fs, &d, "/");
+        if (res < 0) TEST_FAIL();
+        while (SPFS_readdir(fs, &d));
+        SPFS_closedir(fs, &d);
+      }
+    }
+    printf("cache hit rate, hot lookups:%d%%, all:%d%%\n",
+        hot_lookups ? hot_hits * 100 / hot_lookups : 0,
+        c->hits + c->misses ? c->hits * 100 / (c->hits + c->misses) : 0);
+    for (i = 0; i < 24; i++) {
+      sprintf(name, "bench%02d", i);
+      res = spfs_file_remove(fs, name);
+      if (res < 0) TEST_FAIL();
+    }
+  }
+
+
+  {
+    // gc erases the evacuated block and gives its deleted pages back
+    spfs_fd_t *gcfd;
+    res = _fd_claim(fs, &gcfd);
+    if (res) TEST_FAIL();
+    res = spfs_file_create(fs, gcfd, "gcfile");
+    if (res) TEST_FAIL();
+    uint32_t i;
+    for (i = 0; i < 4; i++) {
+      res = spfs_file_write(fs, gcfd, i * sizeof(buf), sizeof(buf), buf);
+      if (res < 0) TEST_FAIL();
+    }
+    res = spfs_file_fremove(fs, gcfd);
+    if (res) TEST_FAIL();
+    _fd_release(fs, gcfd);
+    uint32_t pfree = fs->run.pfree;
+    res = spfs_gc(fs);
+    if (res) TEST_FAIL();
+    printf("gc free pages %d -> %d\n", pfree, fs->run.pfree);
+    if (fs->run.pfree <= pfree) {res = -1; TEST_FAIL();}
+    pfree = fs->run.pfree;
+    spfs_umount(fs);
+    res = spfs_mount(fs, 0, 4, 16);
+    if (res) TEST_FAIL();
+    if (fs->run.pfree != pfree) {
+      printf("gc free pages %d, after remount %d\n", pfree, fs->run.pfree);
+      res = -1;
+      TEST_FAIL();
+    }
+  }
+
+  {
+    // evacuate all blocks, among them blocks with their last data page in use
+    spfs_fd_t *gcfd;
+    res = _fd_claim(fs, &gcfd);
+    if (res) TEST_FAIL();
+    res = spfs_file_create(fs, gcfd, "gclast");
+    if (res) TEST_FAIL();
+    const uint32_t chunks = 2 * SPFS_DPAGES_P_BLK(fs) * SPFS_DPAGE_SZ(fs) / sizeof(buf) + 1;
+    uint32_t i;
+    for (i = 0; i < chunks; i++) {
+      res = spfs_file_write(fs, gcfd, i * sizeof(buf), sizeof(buf), buf);
+      if (res < 0) TEST_FAIL();
+    }
+    _fd_release(fs, gcfd);
+    bix_t dbix;
+    for (dbix = 0; dbix < SPFS_DPAGES_MAX(fs) / SPFS_DPAGES_P_BLK(fs); dbix++) {
+      res = spfs_gc_evacuate(fs, dbix);
+      if (res) TEST_FAIL();
+    }
+    spfs_umount(fs);
+    res = spfs_mount(fs, 0, 4, 16);
+    if (res) TEST_FAIL();
+    fh = SPFS_open(fs, "gclast", SPFS_O_RDONLY, 0);
+    if (fh < 0) {res = fh; TEST_FAIL();}
+    for (i = 0; i < chunks; i++) {
+      uint8_t gcbuf[sizeof(buf)];
+      res = SPFS_read(fs, fh, gcbuf, sizeof(gcbuf));
+      if (res != (int)sizeof(gcbuf) || memcmp(gcbuf, buf, sizeof(gcbuf))) {
+        printf("evacuated data mismatch @ %d\n", i * (uint32_t)sizeof(buf));
+        res = -1;
+        TEST_FAIL();
+      }
+    }
+    res = SPFS_close(fs, fh);
+    if (res < 0) TEST_FAIL();
+    res = spfs_file_remove(fs, "gclast");
+    if (res < 0) TEST_FAIL();
+  }
+
+
+#if SPFS_CFG_PFREE_BITMAP
+  {
+    // the free page bitmap follows allocation, deletion, gc and remount, and
+    // reserved pages are masked out of it when searching
+    if (_check_pfree_bm(fs)) {res = -1; TEST_FAIL();}
+    fh = SPFS_open(fs, "bmfile", SPFS_O_CREAT | SPFS_O_RDWR, 0);
+    if (fh < 0) {res = fh; TEST_FAIL();}
+    uint32_t i;
+    for (i = 0; i < 3; i++) {
+      res = SPFS_write(fs, fh, buf, sizeof(buf));
+      if (res < 0) TEST_FAIL();
+    }
+    if (_check_pfree_bm(fs)) {res = -1; TEST_FAIL();}
+    res = SPFS_lseek(fs, fh, 5000, SPFS_SEEK_SET);
+    if (res < 0) TEST_FAIL();
+    res = SPFS_write(fs, fh, buf, sizeof(buf));
+    if (res < 0) TEST_FAIL();
+    res = SPFS_close(fs, fh);
+    if (res < 0) TEST_FAIL();
+    if (_check_pfree_bm(fs)) {res = -1; TEST_FAIL();}
+    res = SPFS_remove(fs, "bmfile");
+    if (res < 0) TEST_FAIL();
+    if (_check_pfree_bm(fs)) {res = -1; TEST_FAIL();}
+    res = spfs_gc(fs);
+    if (res < 0) TEST_FAIL();
+    if (_check_pfree_bm(fs)) {res = -1; TEST_FAIL();}
+    res = spfs_umount(fs);
+    if (res < 0) TEST_FAIL();
+    res = spfs_mount(fs, 0, 4, 16);
+    if (res < 0) TEST_FAIL();
+    if (_check_pfree_bm(fs)) {res = -1; TEST_FAIL();}
+
+    int rix = _resv_alloc(fs);
+    if (rix < 0) {res = rix; TEST_FAIL();}
+    pix_t rdpix = fs->run.resv.arr[rix];
+    uint32_t rbit = 1U << (rdpix % 32);
+    uint32_t w = fs->run.pfree_bm[rdpix / 32];
+    if ((w & rbit) == 0 || _pfree_bm_word(fs, rdpix / 32) != (w & ~rbit)) {res = -1; TEST_FAIL();}
+    res = _resv_free(fs, rix);
+    if (res != (int)rdpix) {res = -1; TEST_FAIL();}
+    if (_pfree_bm_word(fs, rdpix / 32) != w) {res = -1; TEST_FAIL();}
+    res = SPFS_OK;
+  }
+#endif
 
 
   end:
+  if (fail_line) printf("FAIL @ line %d, res %d %s\n", fail_line, res, spfs_strerror(res));
   res = spfs_gc(fs);
   if (res) printf("gc err %d\n", res);
 //  spfs_dump(fs, SPFS_DUMP_NO_DELE | SPFS_DUMP_NO_FREE | SPFS_DUMP_PAGE_DATA);
@@ -468,5 +1858,5 @@ int main(int argc, char **argv) {
   }
 
 
-  return 0;
+  return fail_line || res ? 1 : 0;
 }
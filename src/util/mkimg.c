@@ -187,6 +187,9 @@ int main(int argc, char **argv) {
   fscfg.read = fs_hal_read;
   fscfg.write = fs_hal_write;
   fscfg.erase = fs_hal_erase;
+#if SPFS_CFG_HAL_MAP
+  fscfg.map = NULL;
+#endif
   fscfg.pflash_sz = fs_sz;
   fscfg.lblk_sz = blk_sz;
   fscfg.lpage_sz = page_sz;
@@ -197,7 +200,8 @@ int main(int argc, char **argv) {
   if (res) ERREND("config fail:%d %s\n", res, spfs_strerror(res));
   res = spfs_format(fs);
   if (res) ERREND("format fail:%d %s\n", res, spfs_strerror(res));
-  res = spfs_mount(fs, 0, 4, 16);
+  // no cache, medium is altered behind spfs' back below
+  res = spfs_mount(fs, 0, 4, 0);
   if (res) ERREND("mount fail:%d %s\n", res, spfs_strerror(res));
 
   if (ipath) {
@@ -239,9 +239,7 @@ static int fuse_spfs_read(const char *path, char *buf, size_t size, off_t offset
   }
 #endif
   int res;
-  res = SPFS_lseek(st->fs, fi->fh, offset, SPFS_SEEK_SET);
-  if (res < 0) return err_spfs2posix(res);
-  res = SPFS_read(st->fs, fi->fh, (uint8_t *)buf, size);
+  res = SPFS_pread(st->fs, fi->fh, (uint8_t *)buf, size, offset);
   if (res < 0) return err_spfs2posix(res);
   return res;
 }
@@ -251,9 +249,7 @@ static int fuse_spfs_write(const char *name, const char *buf, size_t size, off_t
   fdbg("%s %s fh:%d offs:%d size:%d\n", __func__, name, fi->fh, offset, size);
   if (st->ro) return -EROFS;
   int res;
-  res = SPFS_lseek(st->fs, fi->fh, offset, SPFS_SEEK_SET);
-  if (res < 0) return err_spfs2posix(res);
-  res = SPFS_write(st->fs, fi->fh, (const uint8_t *)buf, size);
+  res = SPFS_pwrite(st->fs, fi->fh, (const uint8_t *)buf, size, offset);
   if (res < 0) return err_spfs2posix(res);
   return res;
 }
@@ -396,6 +392,13 @@ static int spfs_hal_write(spfs_t *lfs, uint32_t addr, const uint8_t *buf, uint32
   return 0;
 }
 
+#if SPFS_CFG_HAL_MAP
+static const uint8_t *spfs_hal_map(spfs_t *lfs, uint32_t addr, uint32_t size) {
+  (void)size;
+  return &((st_t *)lfs->user)->img[addr];
+}
+#endif
+
 static int spfs_hal_erase(spfs_t *lfs, uint32_t addr, uint32_t size, uint32_t flags) {
   if (st->ro) return -EACCES;
   memset(&((st_t *)lfs->user)->img[addr], 0xff, size);
@@ -461,6 +464,9 @@ int main(int argc, char *argv[]) {
   fscfg.read = spfs_hal_read;
   fscfg.write = spfs_hal_write;
   fscfg.erase = spfs_hal_erase;
+#if SPFS_CFG_HAL_MAP
+  fscfg.map = spfs_hal_map;
+#endif
   fscfg.filehandle_offset = 0;
   int res = spfs_probe(&fscfg, 0, st->img_sz, st);
   if (res < 0) {
@@ -474,7 +480,7 @@ int main(int argc, char *argv[]) {
     printf("Cannot configure file system in %s: %s\n", argv[1], spfs_strerror(res));
     exit(EXIT_FAILURE);
   }
-  res = spfs_mount(st->fs, 0, 8, 16);
+  res = spfs_mount(st->fs, 0, 8, 256);
   if (res < 0) {
     cleanup(st);
     printf("Cannot mount file system in %s: %s\n", argv[1], spfs_strerror(res));
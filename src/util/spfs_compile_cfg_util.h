@@ -18,6 +18,16 @@
 
 #define SPFS_CFG_DYNAMIC                1
 
+#define SPFS_CFG_LU_MIRROR              (1)
+#define SPFS_CFG_BLOCK_STATS            (1)
+#define SPFS_CFG_PFREE_BITMAP           (1)
+#define SPFS_CFG_ID_BITMAP              (1)
+#define SPFS_CFG_IX_CACHE               (64)
+#define SPFS_CFG_NAME_HASH              (256)
+#define SPFS_CFG_NAME_BLOOM             (128)
+#define SPFS_CFG_HAL_MAP                (1)
+#define SPFS_CFG_CACHE_2Q               (1)
+
 #define SPFS_ERRSTR                     1
 #define SPFS_DUMP                       1
 #define SPFS_ASSERT                     1